@@ -0,0 +1,189 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+//admission control for expensive requests
+//summary:
+//AdmissionController caps how many searches run at once and sheds the rest immediately instead of queueing them
+//the cap adapts to measured latency with the gradient algorithm (same idea as netflix's concurrency-limits):
+//  longLatency tracks the latency the service has when it isn't overloaded (a slow-rising minimum), shortLatency is the latest window
+//  gradient = tolerance * longLatency / shortLatency, clamped to [0.5, 1]
+//  newLimit = limit * gradient + sqrt(limit), so the limit grows while latency holds and backs off once requests start queueing
+//failures in a window cut the limit by a fixed factor (the multiplicative decrease of AIMD)
+//acquiring and releasing are a few atomics, the limit is recomputed by whichever release closes the window
+
+namespace CoreSystems {
+
+    class AdmissionController {
+    public:
+        struct Options {
+            double initialLimit = 16.0;
+            double minLimit = 2.0;
+            double maxLimit = 64.0;
+            double tolerance = 1.5; //how much slower than the baseline a window can be before the limit shrinks
+            double smoothing = 0.2; //weight of the new limit against the current one
+            double failureBackoff = 0.9; //limit multiplier for a window with failures
+            std::chrono::milliseconds window{250}; //limit is recomputed at most this often
+            uint32_t minWindowSamples = 5; //and only once this many requests finished in the window
+        };
+
+        //held for the duration of one admitted request, releasing it feeds the request's latency back into the limit
+        class Permit {
+        public:
+            Permit() = default; //rejected
+            Permit(Permit&& other) noexcept
+                : controller(std::exchange(other.controller, nullptr)), startNs(other.startNs), failed(other.failed) {}
+            Permit& operator=(Permit&& other) noexcept {
+                if (this != &other) {
+                    release();
+                    controller = std::exchange(other.controller, nullptr);
+                    startNs = other.startNs;
+                    failed = other.failed;
+                }
+                return *this;
+            }
+            Permit(const Permit&) = delete;
+            Permit& operator=(const Permit&) = delete;
+            ~Permit() { release(); }
+
+            explicit operator bool() const { return controller != nullptr; }
+            void markFailed() { failed = true; } //request errored or timed out, counts against the limit
+
+        private:
+            friend class AdmissionController;
+            Permit(AdmissionController* controller, uint64_t startNs) : controller(controller), startNs(startNs) {}
+            void release() {
+                if (controller) {
+                    controller->release(startNs, failed);
+                    controller = nullptr;
+                }
+            }
+            AdmissionController* controller = nullptr;
+            uint64_t startNs = 0;
+            bool failed = false;
+        };
+
+        AdmissionController() : AdmissionController(Options{}) {}
+        explicit AdmissionController(Options options)
+            : options(options), currentLimit(std::clamp(options.initialLimit, options.minLimit, options.maxLimit)),
+              windowStartNs(nowNs()) {}
+
+        //never blocks, an empty Permit means the request should be shed
+        Permit tryAcquire() {
+            uint32_t current = inFlightCount.load(std::memory_order_relaxed);
+            while (true) {
+                if (current >= static_cast<uint32_t>(currentLimit.load(std::memory_order_relaxed))) {
+                    rejectedCount.fetch_add(1, std::memory_order_relaxed);
+                    return Permit();
+                }
+                if (inFlightCount.compare_exchange_weak(current, current + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            uint32_t seen = windowMaxInFlight.load(std::memory_order_relaxed);
+            while (current + 1 > seen && !windowMaxInFlight.compare_exchange_weak(seen, current + 1, std::memory_order_relaxed)) {
+                //another request raised it first, seen was reloaded by compare_exchange
+            }
+            admittedCount.fetch_add(1, std::memory_order_relaxed);
+            return Permit(this, nowNs());
+        }
+
+        //suggested Retry-After for shed requests: twice the recent latency, at least 1 second
+        int retryAfterSeconds() const {
+            double latencySeconds = shortLatencyUs.load(std::memory_order_relaxed) / 1e6;
+            return std::clamp(static_cast<int>(std::ceil(2.0 * latencySeconds)), 1, 30);
+        }
+
+        double limit() const { return currentLimit.load(std::memory_order_relaxed); }
+        uint32_t inFlight() const { return inFlightCount.load(std::memory_order_relaxed); }
+        uint64_t admitted() const { return admittedCount.load(std::memory_order_relaxed); }
+        uint64_t rejected() const { return rejectedCount.load(std::memory_order_relaxed); }
+        double baselineLatencyUs() const { return longLatencyUs.load(std::memory_order_relaxed); }
+        double recentLatencyUs() const { return shortLatencyUs.load(std::memory_order_relaxed); }
+
+    private:
+        //longLatency follows faster windows quickly and slower ones only very slowly,
+        //so a sustained overload doesn't become the new baseline and let the limit creep up
+        static constexpr double BASELINE_FALL_WEIGHT = 0.25;
+        static constexpr double BASELINE_RISE_WEIGHT = 0.002;
+
+        static uint64_t nowNs() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        void release(uint64_t startNs, bool failed) {
+            uint64_t endNs = nowNs();
+            inFlightCount.fetch_sub(1, std::memory_order_release);
+            windowLatencySumUs.fetch_add((endNs - startNs) / 1000, std::memory_order_relaxed);
+            uint32_t samples = windowSamples.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (failed) {
+                windowFailures.fetch_add(1, std::memory_order_relaxed);
+            }
+            uint64_t windowStart = windowStartNs.load(std::memory_order_relaxed);
+            if (samples < options.minWindowSamples ||
+                endNs - windowStart < static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(options.window).count())) {
+                return;
+            }
+            //whoever moves windowStart closes the window, everyone else just returns
+            if (!windowStartNs.compare_exchange_strong(windowStart, endNs, std::memory_order_acq_rel)) {
+                return;
+            }
+            updateLimit();
+        }
+
+        void updateLimit() {
+            //samples finishing during this swap may land in either window, that's fine for an estimate
+            uint64_t sumUs = windowLatencySumUs.exchange(0, std::memory_order_relaxed);
+            uint32_t samples = windowSamples.exchange(0, std::memory_order_relaxed);
+            uint32_t failures = windowFailures.exchange(0, std::memory_order_relaxed);
+            uint32_t maxInFlight = windowMaxInFlight.exchange(inFlightCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            if (samples == 0) return;
+
+            double shortLatency = std::max(1.0, static_cast<double>(sumUs) / samples);
+            double longLatency = longLatencyUs.load(std::memory_order_relaxed);
+            if (longLatency <= 0.0) {
+                longLatency = shortLatency;
+            } else {
+                double weight = shortLatency < longLatency ? BASELINE_FALL_WEIGHT : BASELINE_RISE_WEIGHT;
+                longLatency += (shortLatency - longLatency) * weight;
+            }
+            shortLatencyUs.store(shortLatency, std::memory_order_relaxed);
+            longLatencyUs.store(longLatency, std::memory_order_relaxed);
+
+            double limit = currentLimit.load(std::memory_order_relaxed);
+            double newLimit;
+            if (failures > 0) {
+                newLimit = limit * options.failureBackoff;
+            } else {
+                double gradient = std::clamp(options.tolerance * longLatency / shortLatency, 0.5, 1.0);
+                newLimit = limit * gradient + std::sqrt(limit);
+                if (maxInFlight < limit / 2.0) {
+                    newLimit = std::min(newLimit, limit); //traffic never came close to the limit, so latency says nothing about raising it
+                }
+            }
+            newLimit = limit * (1.0 - options.smoothing) + newLimit * options.smoothing;
+            currentLimit.store(std::clamp(newLimit, options.minLimit, options.maxLimit), std::memory_order_relaxed);
+        }
+
+        const Options options;
+        std::atomic<double> currentLimit;
+        std::atomic<uint32_t> inFlightCount{0};
+        std::atomic<uint64_t> admittedCount{0};
+        std::atomic<uint64_t> rejectedCount{0};
+
+        //current window
+        std::atomic<uint64_t> windowStartNs;
+        std::atomic<uint64_t> windowLatencySumUs{0};
+        std::atomic<uint32_t> windowSamples{0};
+        std::atomic<uint32_t> windowFailures{0};
+        std::atomic<uint32_t> windowMaxInFlight{0};
+
+        std::atomic<double> shortLatencyUs{0.0};
+        std::atomic<double> longLatencyUs{0.0};
+    };
+
+} //end of namespace CoreSystems
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include "metrics.hpp"
+//per-request memory for a search's node graph
+//summary:
+//RequestArena is a monotonic (bump pointer) memory resource: allocating is a pointer bump, deallocating does nothing
+//and every chunk goes back to the heap at once when the arena is destroyed
+//the first chunk fits a typical full search (~40 nodes with 384-float embeddings and their names), later chunks grow geometrically
+//not thread safe: only the thread running a search allocates from its context's arena (hedged attempts get their own),
+//other threads may read what's in it
+//nodes that outlive the request (the search cache) are copied out, pmr containers copy onto the default heap resource
+
+namespace CoreSystems {
+
+    class RequestArena {
+    public:
+        static constexpr size_t INITIAL_CHUNK_BYTES = 96 * 1024;
+
+        RequestArena() : resource(INITIAL_CHUNK_BYTES, &chunks) {}
+        RequestArena(const RequestArena&) = delete;
+        RequestArena& operator=(const RequestArena&) = delete;
+        ~RequestArena() {
+            if (chunks.bytes > 0) {
+                static metrics::Counter& arenas = metrics::Registry::instance().counter(
+                    "palette_request_arenas_total", "Request arenas that allocated anything");
+                static metrics::Counter& bytes = metrics::Registry::instance().counter(
+                    "palette_request_arena_bytes_total", "Bytes request arenas took from the heap, divide by arenas for the average");
+                arenas.inc();
+                bytes.inc(chunks.bytes);
+            }
+        }
+
+        std::pmr::memory_resource* get() { return &resource; }
+        size_t reservedBytes() const { return chunks.bytes; } //heap taken so far, chunk sizes not bytes handed out
+
+    private:
+        //counts the chunks the monotonic resource takes, it only calls this a handful of times per request
+        class CountingResource : public std::pmr::memory_resource {
+        public:
+            size_t bytes = 0;
+        private:
+            std::pmr::memory_resource* upstream = std::pmr::new_delete_resource();
+            void* do_allocate(size_t size, size_t alignment) override {
+                bytes += size;
+                return upstream->allocate(size, alignment);
+            }
+            void do_deallocate(void* pointer, size_t size, size_t alignment) override {
+                upstream->deallocate(pointer, size, alignment);
+            }
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+        };
+
+        CountingResource chunks;
+        std::pmr::monotonic_buffer_resource resource;
+    };
+
+} //end of namespace CoreSystems
@@ -0,0 +1,192 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "json.hpp"
+#include "metrics.hpp"
+//circuit breaker for calls to one upstream endpoint (a weaviate replica, the pinterest api)
+//summary:
+//CLOSED    - requests go through, outcomes are counted in a rolling window of 1 second buckets
+//            once the window has minRequests and at least failureThreshold of them failed, the breaker opens
+//OPEN      - requests are rejected without touching the network until openDuration has passed
+//HALF_OPEN - exactly one caller gets a probe request, its outcome closes the breaker or opens it again
+//allowRequest() is an atomic load and a clock read while the breaker is open, so rejecting costs nanoseconds
+
+namespace CoreSystems {
+
+    enum class CircuitState { CLOSED, OPEN, HALF_OPEN };
+    inline std::string circuitStateToString(CircuitState state) {
+        switch (state) {
+            case CircuitState::CLOSED: return "CLOSED";
+            case CircuitState::OPEN: return "OPEN";
+            case CircuitState::HALF_OPEN: return "HALF_OPEN";
+            default: return "UNKNOWN";
+        }
+    }
+
+    class CircuitBreaker {
+    public:
+        struct Options {
+            uint32_t minRequests = 10; //fewer outcomes than this in the window never trip the breaker
+            double failureThreshold = 0.5;
+            std::chrono::milliseconds openDuration{5000}; //how long an open breaker rejects before it lets a probe through
+        };
+
+        //what allowRequest() decided, pass it back to record() so only the probe's outcome counts in HALF_OPEN
+        enum class Admission { REJECTED, ALLOWED, PROBE };
+
+        CircuitBreaker(const std::string& upstream, const std::string& endpoint) : CircuitBreaker(upstream, endpoint, Options{}) {}
+        CircuitBreaker(const std::string& upstream, const std::string& endpoint, Options options)
+            : options(options), endpoint(endpoint),
+              stateGauge(metrics::Registry::instance().gauge("palette_circuit_state",
+                  "0 = CLOSED, 1 = OPEN, 2 = HALF_OPEN", {{"upstream", upstream}, {"endpoint", endpoint}})),
+              rejectedCounter(metrics::Registry::instance().counter("palette_circuit_rejected_total",
+                  "Requests failed fast by an open circuit breaker", {{"upstream", upstream}, {"endpoint", endpoint}})),
+              openedCounter(metrics::Registry::instance().counter("palette_circuit_opened_total",
+                  "Times the circuit breaker opened", {{"upstream", upstream}, {"endpoint", endpoint}})) {
+            stateGauge.set(0);
+        }
+        CircuitBreaker(const CircuitBreaker&) = delete;
+        CircuitBreaker& operator=(const CircuitBreaker&) = delete;
+
+        Admission allowRequest() {
+            CircuitState current = state.load(std::memory_order_acquire);
+            if (current == CircuitState::CLOSED) {
+                return Admission::ALLOWED;
+            }
+            if (current == CircuitState::OPEN && nowNs() >= openUntilNs.load(std::memory_order_relaxed)) {
+                //first caller after the cool-down becomes the probe, everyone else keeps failing fast
+                if (state.compare_exchange_strong(current, CircuitState::HALF_OPEN, std::memory_order_acq_rel)) {
+                    stateGauge.set(static_cast<int64_t>(CircuitState::HALF_OPEN));
+                    return Admission::PROBE;
+                }
+            }
+            rejectedCounter.inc();
+            return Admission::REJECTED;
+        }
+
+        void record(Admission admission, bool success) {
+            if (admission == Admission::REJECTED) return;
+            if (admission == Admission::PROBE) {
+                if (success) {
+                    resetWindow();
+                    transition(CircuitState::HALF_OPEN, CircuitState::CLOSED);
+                } else {
+                    open(CircuitState::HALF_OPEN);
+                }
+                return;
+            }
+            //a request admitted while CLOSED that finishes after the breaker opened doesn't count any more
+            if (state.load(std::memory_order_acquire) != CircuitState::CLOSED) return;
+            Bucket& bucket = currentBucket();
+            (success ? bucket.successes : bucket.failures).fetch_add(1, std::memory_order_relaxed);
+            if (!success) {
+                auto [successes, failures] = windowTotals();
+                uint64_t total = successes + failures;
+                if (total >= options.minRequests && static_cast<double>(failures) >= options.failureThreshold * static_cast<double>(total)) {
+                    open(CircuitState::CLOSED);
+                }
+            }
+        }
+
+        //for an admitted request that never produced an outcome (cancelled, skipped), so a probe can't get lost
+        void abandon(Admission admission) {
+            if (admission == Admission::PROBE) {
+                transition(CircuitState::HALF_OPEN, CircuitState::OPEN); //openUntil has passed, the next caller probes
+            }
+        }
+
+        //false while open (before the cool-down ends) or while the half-open probe is out
+        //callers that pick between endpoints use this to skip one without spending its probe
+        bool acceptsRequests() const {
+            CircuitState current = state.load(std::memory_order_acquire);
+            return current == CircuitState::CLOSED ||
+                   (current == CircuitState::OPEN && nowNs() >= openUntilNs.load(std::memory_order_relaxed));
+        }
+        CircuitState getState() const { return state.load(std::memory_order_acquire); }
+
+        nlohmann::json toJson() const {
+            auto [successes, failures] = windowTotals();
+            int64_t openForMs = 0;
+            if (getState() == CircuitState::OPEN) {
+                openForMs = std::max<int64_t>(0, (openUntilNs.load(std::memory_order_relaxed) - nowNs()) / 1'000'000);
+            }
+            return nlohmann::json{
+                {"endpoint", endpoint},
+                {"state", circuitStateToString(getState())},
+                {"window_requests", successes + failures},
+                {"window_failures", failures},
+                {"rejected", rejectedCounter.get()},
+                {"opened", openedCounter.get()},
+                {"reopens_in_ms", openForMs}
+            };
+        }
+
+    private:
+        static constexpr size_t WINDOW_BUCKETS = 10; //rolling window of 10 one-second buckets
+        struct Bucket {
+            std::atomic<int64_t> second{-1};
+            std::atomic<uint64_t> successes{0};
+            std::atomic<uint64_t> failures{0};
+        };
+
+        const Options options;
+        const std::string endpoint;
+        std::atomic<CircuitState> state{CircuitState::CLOSED};
+        std::atomic<int64_t> openUntilNs{0};
+        std::array<Bucket, WINDOW_BUCKETS> buckets;
+        metrics::Gauge& stateGauge;
+        metrics::Counter& rejectedCounter;
+        metrics::Counter& openedCounter;
+
+        static int64_t nowNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+        //same claiming scheme as WindowedLatencyHistogram, an outcome recorded during the rotation can be lost
+        Bucket& currentBucket() {
+            int64_t second = nowNs() / 1'000'000'000;
+            Bucket& bucket = buckets[static_cast<size_t>(second) % WINDOW_BUCKETS];
+            int64_t seen = bucket.second.load(std::memory_order_acquire);
+            if (seen < second && bucket.second.compare_exchange_strong(seen, second, std::memory_order_acq_rel)) {
+                bucket.successes.store(0, std::memory_order_relaxed);
+                bucket.failures.store(0, std::memory_order_relaxed);
+            }
+            return bucket;
+        }
+        std::pair<uint64_t, uint64_t> windowTotals() const {
+            int64_t second = nowNs() / 1'000'000'000;
+            uint64_t successes = 0, failures = 0;
+            for (const auto& bucket : buckets) {
+                int64_t bucketSecond = bucket.second.load(std::memory_order_acquire);
+                if (bucketSecond > second - static_cast<int64_t>(WINDOW_BUCKETS) && bucketSecond <= second) {
+                    successes += bucket.successes.load(std::memory_order_relaxed);
+                    failures += bucket.failures.load(std::memory_order_relaxed);
+                }
+            }
+            return {successes, failures};
+        }
+        void resetWindow() {
+            for (auto& bucket : buckets) {
+                bucket.second.store(-1, std::memory_order_relaxed);
+                bucket.successes.store(0, std::memory_order_relaxed);
+                bucket.failures.store(0, std::memory_order_relaxed);
+            }
+        }
+        void open(CircuitState from) {
+            openUntilNs.store(nowNs() + std::chrono::duration_cast<std::chrono::nanoseconds>(options.openDuration).count(), std::memory_order_relaxed);
+            if (transition(from, CircuitState::OPEN)) {
+                openedCounter.inc();
+            }
+        }
+        bool transition(CircuitState from, CircuitState to) {
+            if (state.compare_exchange_strong(from, to, std::memory_order_acq_rel)) {
+                stateGauge.set(static_cast<int64_t>(to));
+                return true;
+            }
+            return false;
+        }
+    };
+
+} //end of namespace CoreSystems
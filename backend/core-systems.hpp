@@ -2,9 +2,21 @@
 #include <string>    
 #include <vector>  
 #include <chrono>  
-#include <Rpc.h>
-#pragma comment(lib, "Rpcrt4.lib")       // library to generate UUIDs
 #include "json.hpp"
+#include "logging.hpp" //LOG_INFO, LOG_ERROR, ... macros
+#include "lock-free.hpp"
+#include "latency-histogram.hpp"
+#include "tracing.hpp" //ScopedSpan, RequestTrace, PipelineStage
+#include "metrics.hpp" //prometheus counters/gauges behind /metrics
+#include "resource-sampler.hpp" //process cpu% and memory for the health status
+#include "circuit-breaker.hpp" //per-upstream fast-fail for weaviate and pinterest
+#include "uuid.hpp" //time-ordered UUIDv7 ids
+#include "arena.hpp" //per-request bump allocator for the node graph
+#include "interner.hpp" //concept names stored once, keyed by 4 byte ids
+#include "embedding-store.hpp" //concept vectors packed (and optionally quantized) in one place
+#include "text-encoder.hpp" //optional in-process MiniLM query encoder, weaviate gets nearVector instead of nearText
+#include <memory_resource>
+#include <string_view>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -12,6 +24,9 @@
 #include <memory> //for smart pointers
 #include <thread>
 #include <unordered_map> //for caching
+#include <optional>
+#include <algorithm>
+#include <cctype>
 //this file defines structures and classes for core systems
 //summary:
 //class SystemManager is the brains: starts engines(for weaviate & pinterest), spawns threads, acceptes requests, and records telemetry data
@@ -35,35 +50,63 @@ namespace CoreSystems {
         }
     };
 
+    //the id string comes from whatever memory resource the node was built with,
+    //a search builds its nodes in the request's RequestArena, a NodeList passes its resource on to the nodes in it
+    //copying a node (or a NodeList) without an allocator puts the copy on the heap, that's how the cache keeps them
+    //the name is an id in the global StringInterner and the embedding a slot in the global EmbeddingStore,
+    //so every copy of a node shares one copy of its text and vector
     struct Node {
-        std::string id; //id for each node
-        std::string name; //name of the node to be displayed to user
-        std::vector<float> embedding; //embedding vector for the node, showing where it is in the vector space
-        float similarityScore; //similarity score of the node with respect to the search/center node
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        std::pmr::string id; //id for each node
+        InternedString name; //name of the node to be displayed to user
+        EmbeddingRef embedding; //embedding vector for the node, showing where it is in the vector space
+        float similarityScore = 0.0f; //similarity score of the node with respect to the search/center node
         std::chrono::system_clock::time_point timestamp; //timestamp of the node creation or last update
-        SystemHealthEnum healthStatus;  //health status of the node, defined in SystemHealth enum
-        int level; //0=query, 1=first level, 2=second level
+        SystemHealthEnum healthStatus = SystemHealthEnum::NOMINAL;  //health status of the node, defined in SystemHealth enum
+        int level = 0; //0=query, 1=first level, 2=second level
+
+        Node() = default;
+        explicit Node(const allocator_type& allocator) : id(allocator) {}
+        Node(const Node& other) = default;
+        Node(const Node& other, const allocator_type& allocator)
+            : id(other.id, allocator), name(other.name), embedding(other.embedding),
+              similarityScore(other.similarityScore), timestamp(other.timestamp), healthStatus(other.healthStatus), level(other.level) {}
+        Node(Node&& other) = default;
+        Node(Node&& other, const allocator_type& allocator)
+            : id(std::move(other.id), allocator), name(other.name), embedding(other.embedding),
+              similarityScore(other.similarityScore), timestamp(other.timestamp), healthStatus(other.healthStatus), level(other.level) {}
+        Node& operator=(const Node& other) = default;
+        Node& operator=(Node&& other) = default;
+
         //for conversion to/from JSON for api
         nlohmann::json toJson() const{
             //function that converts the Node object to a JSON object
             return nlohmann::json{
-                {"id", id},
-                {"name", name},
-                {"embedding", embedding},
+                {"id", std::string_view(id)},
+                {"name", name.view()},
+                {"embedding", EmbeddingStore::global().values(embedding)},
                 {"similarityScore", similarityScore},
                 {"timestamp", std::chrono::duration_cast<std::chrono::milliseconds>(timestamp.time_since_epoch()).count()},
                 {"healthStatus", static_cast<int>(healthStatus)},
                 {"level", level}
             };
         }
-        static Node fromJson(const nlohmann::json& j) {
+        static Node fromJson(const nlohmann::json& j, const allocator_type& allocator = {}) {
             //static method that belongs to the class, not an instance of the class
             //returns a Node object
             //takes in a reference to a JSON object
-            Node node;
+            Node node(allocator);
             node.id = j.value("id", "");
-            node.name = j.value("name", "");
-            node.embedding = j.value("embedding", std::vector<float>{});
+            node.name = StringInterner::global().intern(j.value("name", ""));
+            if (auto embedding = j.find("embedding"); embedding != j.end() && embedding->is_array()) {
+                std::vector<float> values;
+                values.reserve(embedding->size());
+                for (const auto& value : *embedding) {
+                    values.push_back(value.get<float>());
+                }
+                node.embedding = EmbeddingStore::global().put(node.name, values);
+            }
             node.similarityScore = j.value("similarityScore", 0.0f);
             node.healthStatus = static_cast<SystemHealthEnum>(j.value("healthStatus", 0));
             node.level = j.value("level", 0);
@@ -75,6 +118,92 @@ namespace CoreSystems {
         }
     };
 
+    //how much of the search pipeline runs, picked from the system health when a search starts
+    //so an overloaded service keeps answering with less detail instead of timing out
+    enum class DegradationTier {
+        FULL,       // NOMINAL: level-1, level-2 for the top 3 nodes, live pinterest fan-out
+        REDUCED,    // DEGRADED: level-2 for the top node only, pinterest images only from the image cache
+        MINIMAL     // CRITICAL: cached result even if expired, otherwise level-1 only
+    };
+    inline std::string degradationTierToString(DegradationTier tier) {
+        switch (tier) {
+            case DegradationTier::FULL: return "FULL";
+            case DegradationTier::REDUCED: return "REDUCED";
+            case DegradationTier::MINIMAL: return "MINIMAL";
+            default: return "UNKNOWN";
+        }
+    };
+    inline DegradationTier degradationTierForHealth(SystemHealthEnum health) {
+        switch (health) {
+            case SystemHealthEnum::DEGRADED: return DegradationTier::REDUCED;
+            case SystemHealthEnum::CRITICAL: return DegradationTier::MINIMAL;
+            default: return DegradationTier::FULL;
+        }
+    }
+
+    using NodeList = std::pmr::vector<Node>;
+
+    //per-request time budget, passed by reference down the whole search path (including the pinterest threads)
+    //every upstream call gets only the time that's left, work that can't start before the deadline is skipped
+    //and anything cut short marks the request partial
+    //a cancelled context behaves as if its deadline had passed (used to stop the losing side of a hedged search)
+    //it also owns the request's arena, the nodes a search builds live there (see arena.hpp for the threading rules)
+    class SearchContext {
+    public:
+        using Clock = std::chrono::steady_clock;
+        explicit SearchContext(std::chrono::milliseconds timeout) : deadline(Clock::now() + timeout), arena(std::make_shared<RequestArena>()) {}
+        explicit SearchContext(Clock::time_point deadline) : deadline(deadline), arena(std::make_shared<RequestArena>()) {}
+        SearchContext(const SearchContext&) = delete;
+        SearchContext& operator=(const SearchContext&) = delete;
+
+        Clock::time_point getDeadline() const { return deadline; }
+        std::chrono::milliseconds remaining() const {
+            if (isCancelled()) return std::chrono::milliseconds(0);
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+            return std::max(left, std::chrono::milliseconds(0));
+        }
+        bool expired() const { return isCancelled() || Clock::now() >= deadline; }
+
+        //called from any thread when a step was skipped or cut off by the deadline
+        void markPartial() const { partial.store(true, std::memory_order_relaxed); }
+        bool isPartial() const { return partial.load(std::memory_order_relaxed); }
+
+        void cancel() const { cancelled.store(true, std::memory_order_relaxed); }
+        bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+        //set once the level-1 weaviate answer (or a cache hit) is in, hedging only kicks in while it's still missing
+        void markLevel1Complete() const { level1Complete.store(true, std::memory_order_release); }
+        bool isLevel1Complete() const { return level1Complete.load(std::memory_order_acquire); }
+
+        std::pmr::memory_resource* memory() const { return arena->get(); }
+        //results hold on to the arena so their nodes stay valid after the context is gone
+        const std::shared_ptr<RequestArena>& getArena() const { return arena; }
+
+    private:
+        Clock::time_point deadline;
+        std::shared_ptr<RequestArena> arena;
+        mutable std::atomic<bool> partial{false};
+        mutable std::atomic<bool> cancelled{false};
+        mutable std::atomic<bool> level1Complete{false};
+    };
+
+    //nodes plus how they were produced, reported back to the client
+    struct SearchResult {
+        std::shared_ptr<RequestArena> arena; //what nodes are allocated from, declared first so it's destroyed after them
+        NodeList nodes;
+
+        SearchResult() = default; //nodes on the heap
+        //nodes in the context's arena, moving a NodeList from the same arena in is then just a pointer swap
+        explicit SearchResult(const SearchContext& context) : arena(context.getArena()), nodes(context.memory()) {}
+
+        DegradationTier tier = DegradationTier::FULL;
+        bool fromCache = false;
+        bool stale = false; //served from an expired cache entry (MINIMAL only)
+        bool partial = false; //the deadline cut some of the pipeline short, nodes are what finished in time
+        bool hedged = false; //the backup engine was asked too because the primary was slow
+        std::string servedBy; //engineType of the engine whose answer this is
+    };
+
     struct SearchTelemetry { //will be used to track each search and its stats
         std:: string searchId; //id for the search
         std:: string searchPhrase; //search phrase used
@@ -82,23 +211,89 @@ namespace CoreSystems {
         
         size_t nodesFound; //number of nodes found in the search
         std::chrono::system_clock::time_point timestamp; //time the search finished
+
+        uint64_t traceId = 0; //RequestTrace id, ties the record to the request's spans
+        uint64_t processingTimeNs = 0; //same as processingTime but from the root span, in nanoseconds
+        std::array<uint64_t, PIPELINE_STAGE_COUNT> stageTimeNs{}; //time spent in each PipelineStage
         nlohmann::json toJson() const {
+            nlohmann::json stages = nlohmann::json::object();
+            for (size_t i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+                stages[pipelineStageToString(static_cast<PipelineStage>(i))] = static_cast<double>(stageTimeNs[i]) / 1e6; //ms
+            }
             return nlohmann::json{
                 {"searchId", searchId},
                 {"searchPhrase", searchPhrase},
                 {"processingTime", processingTime},
                 {"nodesFound", nodesFound},
-                {"timestamp", std::chrono::duration_cast<std::chrono::milliseconds>(timestamp.time_since_epoch()).count()}
+                {"timestamp", std::chrono::duration_cast<std::chrono::milliseconds>(timestamp.time_since_epoch()).count()},
+                {"traceId", tracing::traceIdToString(traceId)},
+                {"processingTimeNs", processingTimeNs},
+                {"stagesMs", stages}
             };
         }
     };
 
+    //fixed-size copy of SearchTelemetry for the history ring buffer
+    //the ring copies raw bytes so it can't hold std::string, long phrases are cut off at MAX_PHRASE_LENGTH
+    struct TelemetryRecord {
+        static constexpr size_t MAX_ID_LENGTH = 40;
+        static constexpr size_t MAX_PHRASE_LENGTH = 96;
+        char searchId[MAX_ID_LENGTH];
+        char searchPhrase[MAX_PHRASE_LENGTH];
+        uint64_t processingTime;
+        uint64_t nodesFound;
+        int64_t timestampMs;
+        uint64_t traceId;
+        uint64_t processingTimeNs;
+        std::array<uint64_t, PIPELINE_STAGE_COUNT> stageTimeNs;
+
+        static TelemetryRecord fromTelemetry(const SearchTelemetry& telemetry) {
+            TelemetryRecord record{};
+            copyTruncated(record.searchId, MAX_ID_LENGTH, telemetry.searchId);
+            copyTruncated(record.searchPhrase, MAX_PHRASE_LENGTH, telemetry.searchPhrase);
+            record.processingTime = telemetry.processingTime;
+            record.nodesFound = telemetry.nodesFound;
+            record.timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(telemetry.timestamp.time_since_epoch()).count();
+            record.traceId = telemetry.traceId;
+            record.processingTimeNs = telemetry.processingTimeNs;
+            record.stageTimeNs = telemetry.stageTimeNs;
+            return record;
+        }
+        SearchTelemetry toTelemetry() const {
+            SearchTelemetry telemetry;
+            telemetry.searchId = searchId;
+            telemetry.searchPhrase = searchPhrase;
+            telemetry.processingTime = processingTime;
+            telemetry.nodesFound = nodesFound;
+            telemetry.timestamp = std::chrono::system_clock::time_point(std::chrono::milliseconds(timestampMs));
+            telemetry.traceId = traceId;
+            telemetry.processingTimeNs = processingTimeNs;
+            telemetry.stageTimeNs = stageTimeNs;
+            return telemetry;
+        }
+    private:
+        static void copyTruncated(char* destination, size_t capacity, const std::string& source) {
+            size_t length = std::min(source.size(), capacity - 1); //leaving room for the null terminator
+            //a cut inside a multi-byte UTF-8 character backs off to where that character starts, so the record stays valid text
+            //(source[length] being a 10xxxxxx continuation byte means the cut is mid-character, at most 3 of them in valid UTF-8)
+            for (size_t backedOff = 0; length < source.size() && length > 0 && backedOff < 3 &&
+                 (static_cast<unsigned char>(source[length]) & 0xC0) == 0x80; backedOff++) {
+                length--;
+            }
+            std::memcpy(destination, source.data(), length);
+            destination[length] = '\0';
+        }
+    };
+
     struct SystemHealthMetrics { //will be used to track system health and performance 
-        std::atomic<float> cpuUsage{0.0f};
-        std::atomic<float> memoryUsage{0.0f};
+        std::atomic<float> cpuUsage{0.0f}; //process cpu %, normalized to the cores it can use (see ResourceSampler)
+        std::atomic<float> memoryUsage{0.0f}; //resident memory as % of the cgroup limit (or physical memory)
+        std::atomic<uint64_t> residentMemoryBytes{0};
+        std::atomic<uint64_t> heapInUseBytes{0};
+        std::atomic<float> availableCores{1.0f};
         std::atomic<size_t> activeConnections{0};
         std::atomic<uint64_t> lastHeartbeat;
-        std::atomic<float> errorRate{0.0f};
+        std::atomic<float> errorRate{0.0f}; //smoothed share of failed searches, updated by healthMonitorWorker
             // Atomic variables for thread-safe operations on a single variable
             //will ensure that operations on shared variables are indivisible, preventing race conditions
         SystemHealthEnum getHealthStatus() const {
@@ -118,6 +313,9 @@ namespace CoreSystems {
             return nlohmann::json{
                 {"cpuUsage", cpuUsage.load()},
                 {"memoryUsage", memoryUsage.load()},
+                {"residentMemoryBytes", residentMemoryBytes.load()},
+                {"heapInUseBytes", heapInUseBytes.load()},
+                {"availableCores", availableCores.load()},
                 {"activeConnections", activeConnections.load()},
                 {"lastHeartbeat", lastHeartbeat.load()},
                 {"errorRate", errorRate.load()},
@@ -126,25 +324,61 @@ namespace CoreSystems {
         }
     };
 
+    //how SystemManager spreads searches over its engines
+    enum class BalancingMode {
+        FAILOVER,           // everything goes to the primary, the backup only takes over when the primary is down
+        LEAST_OUTSTANDING,  // engine with the fewest searches in flight, ties go to the lower latency
+        EWMA_LATENCY        // lowest smoothed latency weighted by searches in flight (peak-EWMA style)
+    };
+    inline std::string balancingModeToString(BalancingMode mode) {
+        switch (mode) {
+            case BalancingMode::FAILOVER: return "FAILOVER";
+            case BalancingMode::LEAST_OUTSTANDING: return "LEAST_OUTSTANDING";
+            case BalancingMode::EWMA_LATENCY: return "EWMA_LATENCY";
+            default: return "UNKNOWN";
+        }
+    }
+    //accepts failover, least_outstanding and ewma (any case), anything else keeps fallback
+    inline BalancingMode balancingModeFromString(std::string name, BalancingMode fallback) {
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (name == "failover") return BalancingMode::FAILOVER;
+        if (name == "least_outstanding") return BalancingMode::LEAST_OUTSTANDING;
+        if (name == "ewma" || name == "ewma_latency") return BalancingMode::EWMA_LATENCY;
+        return fallback;
+    }
+
     //forward declarations
     class VectorEngine;
     class TelemetryProcessor;
+    class EngineCache;
 
     class SystemManager { //main class to manage the system
     private: //methods cannot be accessed outside the class
+        std::shared_ptr<EngineCache> engineCache; //one cache for every engine
+        std::shared_ptr<QueryEncoder> queryEncoder; //PALETTE_LOCAL_ENCODER, shared by every engine, nullptr means weaviate embeds queries
         std::unique_ptr<VectorEngine> primaryVectorEngine;
         std::unique_ptr<VectorEngine> backupVectorEngine;
+        std::vector<std::unique_ptr<VectorEngine>> replicaEngines; //one per url in PALETTE_WEAVIATE_REPLICAS
         std::unique_ptr<TelemetryProcessor> telemetryProcessor;
         std::unique_ptr<SystemHealthMetrics> healthMetrics;
             //std::unique_ptr is a smart pointer that deletes the object when it goes out of scope
             //ensures that the object is deleted when the SystemManager object is destroyed
         
-        //thread-safe telemetry queue
-        std::queue<SearchTelemetry> telemetryQueue;
+        //lock-free telemetry queue
+        //every http worker pushes into it, telemetryWorker is the only consumer and drains it in batches
+        //when it's full the record is dropped and counted, so telemetry can never slow a search down
+        static constexpr size_t TELEMETRY_QUEUE_CAPACITY = 8192;
+        static constexpr size_t TELEMETRY_BATCH_SIZE = 512;
+        static constexpr std::chrono::milliseconds TELEMETRY_DRAIN_INTERVAL{50};
+        static constexpr std::chrono::milliseconds HEALTH_SAMPLE_INTERVAL{500};
+        static constexpr float ERROR_RATE_SMOOTHING = 0.2f; //EWMA weight of the newest interval
+        lockfree::BoundedMpscQueue<SearchTelemetry> telemetryQueue{TELEMETRY_QUEUE_CAPACITY};
         std::mutex telemetryMutex;
-            //wil be used to protect the telemetryQueue from concurrent access+stop race conditions
-            //code wrapped in telemetryMutex.lock() and telemetryMutex.unlock() can only be accessed by one thread at a time
+            //only used to let shutdown() wake the background workers early, recordTelemetry never touches it
         std::condition_variable telemetryCv;
+        std::atomic<uint64_t> searchAttempts{0};
+        std::atomic<uint64_t> searchFailures{0};
+            //healthMonitorWorker turns these into errorRate once per sample
         std::atomic<bool> shutdownRequested{false};
             //atomic variable to indicate if a shutdown has been requested
             //load() - read value
@@ -154,10 +388,55 @@ namespace CoreSystems {
         //background threads
         std::thread telemetryThread;
         std::thread healthMonitorThread;
+        std::thread probeThread;
         std::chrono::system_clock::time_point startTime;
         //functions that will run each background thread
         void telemetryWorker();
         void healthMonitorWorker();
+        void probeWorker(); //readiness probe for every engine each PROBE_INTERVAL
+        static constexpr std::chrono::seconds PROBE_INTERVAL{5};
+
+        //balancing: which engine a search goes to (PALETTE_BALANCING, default least_outstanding)
+        BalancingMode balancingMode = BalancingMode::LEAST_OUTSTANDING;
+        std::vector<VectorEngine*> allEngines() const; //primary, backup, then replicas
+        //best engine by balancingMode among the ones accepting searches that pass their probes (any accepting one if none do)
+        //engines whose circuit breaker is open are never picked
+        VectorEngine* pickEngine(const VectorEngine* exclude = nullptr) const;
+        void registerMetrics(); //scrape-time gauges and histograms that read this SystemManager
+
+        //hedged requests: if the chosen engine's level-1 call is slower than hedgePercentile of its recent latency,
+        //the same search is sent to a second engine (the backup, or the next best when balancing) and whichever answers first is used
+        //hedges spend tokens (hedgeMaxRate per search, capped at HEDGE_BURST) so they add at most that share of load
+        double hedgePercentile = 0.95; //PALETTE_HEDGE_PERCENTILE, 0 turns hedging off
+        double hedgeMaxRate = 0.05; //PALETTE_HEDGE_MAX_RATE
+        static constexpr int64_t HEDGE_TOKEN_UNIT = 1000; //tokens are kept in thousandths so they fit in an atomic integer
+        static constexpr int64_t HEDGE_BURST = 5 * HEDGE_TOKEN_UNIT;
+        static constexpr size_t HEDGE_MIN_SAMPLES = 20; //no hedging until the engine has this many level-1 samples
+        static constexpr std::chrono::milliseconds HEDGE_MIN_DELAY{2};
+        std::atomic<int64_t> hedgeTokens{HEDGE_BURST};
+        //the first attempt runs on the caller's thread, hedgeWorker wakes at each hedgeAt and only then starts a thread for the second
+        struct HedgeRace; //one hedged search, shared by the caller and its hedge attempt
+        struct PendingHedge {
+            SearchContext::Clock::time_point hedgeAt;
+            std::shared_ptr<HedgeRace> race;
+            bool operator>(const PendingHedge& other) const { return hedgeAt > other.hedgeAt; }
+        };
+        std::priority_queue<PendingHedge, std::vector<PendingHedge>, std::greater<PendingHedge>> pendingHedges; //guarded by hedgeMutex
+        std::vector<std::pair<std::thread, std::shared_ptr<HedgeRace>>> hedgeAttempts; //only hedgeWorker touches it, shutdown() joins what's left
+        std::mutex hedgeMutex;
+        std::condition_variable hedgeCv;
+        std::thread hedgeThread;
+        void hedgeWorker();
+        void launchHedge(const std::shared_ptr<HedgeRace>& race);
+        metrics::Counter* hedgesIssued = nullptr;
+        metrics::Counter* hedgesSkippedBudget = nullptr;
+        metrics::Counter* hedgeWinsOriginal = nullptr;
+        metrics::Counter* hedgeWinsHedge = nullptr;
+        bool takeHedgeToken();
+        //picks the engine(s) per balancingMode and runs the search, throws when none can take it
+        SearchResult routeSearch(const std::string& query, const SearchContext& context, DegradationTier tier);
+        SearchResult hedgedSearch(const std::string& query, const SearchContext& context, DegradationTier tier,
+                                  VectorEngine* first, VectorEngine* second);
 
     public:
         //constructor and destructor for SystemManager class
@@ -167,59 +446,149 @@ namespace CoreSystems {
         //methods to manage the system
         bool initialize(); 
         void shutdown(); 
-        std::vector<Node> search(const std::string& query);
+        SearchResult search(const std::string& query, const SearchContext& context); //tier follows getSystemHealth() at the time of the call
         SystemHealthEnum getSystemHealth() const; //no parameters, returns a SystemHealthEnum 
         SystemHealthMetrics& getHealthMetrics() const;
             //this will reurn healthMetrics object, which is a unique_ptr
             //unique_ptr objects cant be copied, so we return a reference to the object
             //which is why the signatur includes &
-        void recordTelemetry(const SearchTelemetry& telemetry);
+        void recordTelemetry(SearchTelemetry telemetry); //never blocks, drops the record if the queue is full
+        uint64_t getDroppedTelemetryCount() const { return telemetryQueue.droppedCount(); }
         bool emergencySubsystemRestart(const std::string& subsystem_name);
 
         VectorEngine* getPrimaryVectorEngine() const { return primaryVectorEngine.get(); }
         VectorEngine* getBackupVectorEngine() const { return backupVectorEngine.get(); }
+        BalancingMode getBalancingMode() const { return balancingMode; }
+        nlohmann::json getEngineReport() const; //per-engine load, latency and probe state for system_health
+        nlohmann::json getCircuitBreakerReport() const; //state of every weaviate breaker and the shared pinterest one
         TelemetryProcessor* getTelemetryProcessor() const { return telemetryProcessor.get(); }
         uint64_t getUptimeMs() const;
             //asterisks indicate that the method returns a pointer to a VectorEngine/TelemetryProcessor object
     };
+    //search results and pinterest images, shared by every VectorEngine so a result fetched through one engine
+    //is served by all of them (the engines only differ in which weaviate replica they talk to)
+    //search results are keyed by the query text itself (capped at MAX_SEARCH_CACHE_ENTRIES), images by interned concept name,
+    //an image lookup with a name weaviate never returned is a miss without taking the cache lock
+    class EngineCache {
+    public:
+        EngineCache();
+        //allowStale returns expired entries too (and sets *stale), otherwise expired entries are ignored
+        //the copy handed out is allocated from memory (the caller's request arena)
+        NodeList lookup(std::string_view query, std::pmr::memory_resource* memory, bool allowStale = false, bool* stale = nullptr);
+        void store(std::string_view query, const NodeList& nodes); //copied onto the heap, the cache outlives any request
+        std::vector<struct PinterestImage> images(InternedString conceptName);
+        std::vector<struct PinterestImage> images(std::string_view conceptName); //also finds concepts only refreshed by name
+        void storeImages(InternedString conceptName, std::vector<struct PinterestImage> images);
+        //for refresh_pinterest_data, a concept weaviate hasn't returned yet goes in the bounded refreshedImages instead of the interner
+        void storeImages(std::string_view conceptName, std::vector<struct PinterestImage> images);
+        void eraseImages(std::string_view conceptName); //empty conceptName clears every image
+        void clear();
+        size_t size();
+
+    private:
+        struct SearchCacheEntry {
+            NodeList nodes; //heap allocated
+            std::chrono::system_clock::time_point storedAt; //each entry expires on its own
+        };
+        std::unordered_map<std::string, SearchCacheEntry> searchCache; //keyed by the raw query, user text is never interned
+        std::unordered_map<InternedString, std::vector<struct PinterestImage>> imageCache;
+        //images refreshed by name for concepts no weaviate response has interned, user text never goes in the interner
+        std::unordered_map<std::string, std::vector<struct PinterestImage>> refreshedImages;
+        std::mutex cacheMutex;
+
+        static constexpr std::chrono::minutes CACHE_EXPIRY_TIME{10};
+        static constexpr size_t MAX_SEARCH_CACHE_ENTRIES = 1000;
+        static constexpr size_t SEARCH_CACHE_TRIM = 100; //oldest entries dropped when the cache is full
+        static constexpr size_t MAX_REFRESHED_IMAGE_ENTRIES = 256; //an arbitrary entry is dropped to make room
+
+        //per-cache counters for /metrics, registered once in the constructor so lookups never touch the registry
+        struct CacheMetrics {
+            metrics::Counter* hits;
+            metrics::Counter* misses;
+            metrics::Counter* evictions; //trimmed for size, clear() doesn't count
+            metrics::Gauge* entries;
+        };
+        CacheMetrics searchCacheMetrics;
+        CacheMetrics imageCacheMetrics;
+        static CacheMetrics registerCacheMetrics(const std::string& cacheName);
+    };
+
     class VectorEngine { //deals with weaviate/pinterest, caches results and handles images
     private:
         std::string engineId;
-        std::string engineType; //"primary" or "backup"
+        std::string engineType; //"primary", "backup" or "replica-N"
+        std::string weaviateUrl; //empty until initialize() resolves it from the environment
+        TelemetryProcessor* telemetryProcessor; //for per-stage latency, owned by SystemManager, can be nullptr
         std::atomic<bool> isOperational {false}; //indicates if the engine is operational
 
         //connection pools for external services w/ unique_ptr
         std::unique_ptr<class WeaviateClient> weaviateClient;
         std::unique_ptr<class PinterestClient> pinterestClient;   
 
-        //local cache
-        std::unordered_map<std::string, std::vector<Node>> searchCache;
-        std::unordered_map<std::string, std::vector<struct PinterestImage>> imageCache;
-        std::mutex cacheMutex;
+        std::shared_ptr<EngineCache> cache; //owned by SystemManager and shared with the other engines
+        std::shared_ptr<QueryEncoder> queryEncoder; //owned by SystemManager and shared, nullptr when no local encoder is configured
 
-        std::chrono::system_clock::time_point lastCacheUpdate;
-        static constexpr std::chrono::minutes CACHE_EXPIRY_TIME{10};
+        //level-2 fan-out per tier (MINIMAL skips level-2 entirely)
+        static constexpr size_t LEVEL2_NODES_FULL = 3;
+        static constexpr size_t LEVEL2_NODES_REDUCED = 1;
+
+        WindowedLatencyHistogram level1Latency; //this engine's own level-1 latency, SystemManager hedges against it
+
+        //load and latency the balancer scores engines by
+        //latencyEwmaUs is updated with a plain load/store, two searches finishing together can lose one sample, fine for an estimate
+        std::atomic<uint32_t> outstandingSearches{0};
+        std::atomic<double> latencyEwmaUs{0.0};
+        std::atomic<uint64_t> completedSearches{0};
+        static constexpr double LATENCY_EWMA_WEIGHT = 0.2;
+        static constexpr uint64_t FAILURE_PENALTY_US = 1'000'000; //an empty answer counts as this slow, so a failing engine doesn't look fast
+        void recordOutcome(uint64_t latencyUs, bool failed);
+
+        //readiness probe state, an engine starts unproven and takes traffic once a probe passes
+        std::atomic<bool> probeHealthy{false};
+        std::atomic<uint32_t> consecutiveProbeFailures{0};
+        static constexpr uint32_t PROBE_FAILURE_THRESHOLD = 2;
+        static constexpr std::chrono::milliseconds PROBE_TIMEOUT{1000};
 
 
+        tracing::ScopedSpan stageSpan(PipelineStage stage, const char* name); //span that also feeds the stage's histogram
+
         // std::atomic<bool> isOperationalCheck() const {
         //     return isOperational.load();
         // }
 
     public:
-        VectorEngine(const std::string& engineType); //constructor
+        //constructor, an engine without a cache gets its own, an empty weaviateUrl is resolved from the environment by engineType
+        //without a queryEncoder level-1 searches send nearText and weaviate embeds the query
+        VectorEngine(const std::string& engineType, TelemetryProcessor* telemetryProcessor = nullptr,
+                     std::shared_ptr<EngineCache> cache = nullptr, std::string weaviateUrl = "",
+                     std::shared_ptr<QueryEncoder> queryEncoder = nullptr);
         ~VectorEngine(); //destructor
 
         bool initialize(); //initializes the engine
         void shutdown(); //shuts down the engine
         //main vector search function
-        std::vector<Node> vectorSearch(const std::string& query);
+        SearchResult vectorSearch(const std::string& query, const SearchContext& context, DegradationTier tier = DegradationTier::FULL);
         bool isEngineOperational() const {
             return isOperational.load();
         }
+        bool acceptsSearches() const; //operational and its weaviate circuit breaker isn't open
+        nlohmann::json getBreakerStats() const;
+        //quantile (0-1) of recent level-1 latency, nothing if there are fewer than minSamples in the last minute
+        std::optional<std::chrono::microseconds> level1LatencyQuantile(double quantile, size_t minSamples) const;
+        const std::string& getEngineType() const { return engineType; }
+
+        //balancing and probes
+        uint32_t getOutstandingSearches() const { return outstandingSearches.load(std::memory_order_relaxed); }
+        double getLatencyEwmaUs() const { return latencyEwmaUs.load(std::memory_order_relaxed); }
+        uint64_t getCompletedSearches() const { return completedSearches.load(std::memory_order_relaxed); }
+        bool isProbeHealthy() const { return probeHealthy.load(std::memory_order_relaxed); }
+        bool probe(); //asks weaviate's readiness endpoint, updates isProbeHealthy(), only called from SystemManager::probeWorker
+        nlohmann::json getStats() const;
         //cache related
-        std::vector<Node> checkCache(const std::string& query);
-        void updateCache(const std::string& query, const std::vector<Node>& nodes);
-        std::vector<Node> enhanceWithPinterestData(std::vector<Node> nodes); //adding images from pinterest to nodes
+        //allowStale returns expired entries too (and sets *stale), otherwise expired entries are dropped
+        NodeList checkCache(std::string_view query, std::pmr::memory_resource* memory, bool allowStale = false, bool* stale = nullptr);
+        void updateCache(std::string_view query, const NodeList& nodes); //only FULL results should be cached
+        NodeList enhanceWithPinterestData(NodeList nodes, const SearchContext& context); //adding images from pinterest to nodes
         void clearCache();
         size_t getCacheSize();
 
@@ -232,16 +601,21 @@ namespace CoreSystems {
     private:
         std::atomic<bool> isRunning{false};
             //atomic types make operations on them indivisible, preventing race conditions
-        mutable std::mutex processingMutex;
-            //mutable allows the mutex to be modified even in const methods
         
-        std::vector<SearchTelemetry> telemetryHistory;
         static constexpr size_t MAX_TELEMETRY_RECORDS = 10000;
+        lockfree::SeqlockRing<TelemetryRecord, MAX_TELEMETRY_RECORDS> telemetryHistory;
+            //once full, each new record overwrites the oldest one in place
+            //only telemetryWorker writes to it, readers snapshot it without blocking that thread
+        static constexpr size_t RECENT_SEARCHES_IN_REPORT = 10;
 
         //performance tracking
         std::atomic<size_t> totalQueries{0};
         std::atomic<uint64_t> totalResponseTime{0};
         std::atomic<size_t> totalErrors{0};
+
+        //latency distributions, recorded straight from the request threads with relaxed atomics
+        WindowedLatencyHistogram searchLatency; //end to end, per search_concepts request
+        std::array<WindowedLatencyHistogram, PIPELINE_STAGE_COUNT> stageLatency;
     public:
         TelemetryProcessor() = default;
         ~TelemetryProcessor() = default;
@@ -249,7 +623,8 @@ namespace CoreSystems {
         void start();
         void stop();
 
-        void processTelemetry(const SearchTelemetry& telemetry);
+        void processTelemetry(const SearchTelemetry& telemetry); //single writer: only call from SystemManager::telemetryWorker
+        std::vector<SearchTelemetry> getRecentTelemetry(size_t maxRecords) const; //newest records, oldest first
 
         // Analytics functions - implemented
         float getAverageResponseTime() const {
@@ -266,13 +641,22 @@ namespace CoreSystems {
             return totalQueries.load();
         }
         
+        //latency recording, safe from any thread and lock free
+        void recordSearchLatency(uint64_t latencyUs) { searchLatency.record(latencyUs); }
+        void recordStageLatency(PipelineStage stage, uint64_t latencyUs) {
+            stageLatency[static_cast<size_t>(stage)].record(latencyUs);
+        }
+        WindowedLatencyHistogram* stageHistogram(PipelineStage stage) { return &stageLatency[static_cast<size_t>(stage)]; }
+        const WindowedLatencyHistogram& getStageLatency(PipelineStage stage) const { return stageLatency[static_cast<size_t>(stage)]; }
+        const WindowedLatencyHistogram& getSearchLatency() const { return searchLatency; }
+        nlohmann::json getLatencyReport() const; //p50/p90/p99/p99.9/max over 1m, 5m and 1h
+
         nlohmann::json getPerformanceReport() const;
     };
     namespace utils { 
-        inline std::string generateUUID(); //function to generate a UUID
+        inline std::string generateUUID(); //UUIDv7 as a string, uuid::generateV7() skips the allocation
         std::chrono::system_clock::time_point getCurrentTime();
         uint64_t getTimestampMs();
-        float calculateSystemLoad();
 
         class PerformanceTimer { //to time events
         private:
@@ -281,6 +665,11 @@ namespace CoreSystems {
             PerformanceTimer() : startTime(std::chrono::high_resolution_clock::now()) {}
                 //constructor for the class that defines startTime as the current time
             
+            uint64_t elapsedUs() const {
+                auto endTime = std::chrono::high_resolution_clock::now();
+                return std::chrono::duration_cast<std::chrono::microseconds>(
+                    endTime - startTime).count();
+            }
             uint64_t elapsedMs() const {
                 //function to calc time elapses from startTime to now
                 auto endTime = std::chrono::high_resolution_clock::now();
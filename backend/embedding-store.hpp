@@ -0,0 +1,418 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "interner.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define PALETTE_EMBEDDING_AVX2 1
+#endif
+//one copy of every concept's embedding, packed next to each other instead of a heap vector per node
+//summary:
+//a concept's vector doesn't depend on the query it was found for, so vectors are keyed by the concept's interned name:
+//the same concept in many cached results (or at level 1 and level 2) is stored once, nodes carry a 4 byte EmbeddingRef
+//storage is structure-of-arrays: blocks of SLOTS_PER_BLOCK vectors, each vector 64 byte aligned, int8 scales in their own array
+//PALETTE_EMBEDDING_FORMAT picks how vectors are kept:
+//  float32 - the default, exact, 4 bytes per dimension
+//  float16 - opt-in, 2 bytes per dimension, ~3 significant digits which is far below the noise in the similarity scores
+//  int8    - opt-in, 1 byte per dimension with one scale per vector (max |value| / 127)
+//the quantized formats also round what clients get back as a node's embedding and the level-2 nearVector inputs sent to weaviate
+//dot() and dotMany() dequantize inside the kernel, AVX2/FMA/F16C when the cpu has them (checked once at startup), scalar otherwise
+//the first vector stored fixes the dimension, a vector of another length isn't stored (its node has no embedding)
+//the first vector stored for a name wins, weaviate gives the same vector for a concept every time
+//  after weaviate's data is re-imported, clear_cache calls forgetNames() so the next put() for a name stores the new vector
+//  the dimension stays fixed for the life of the process, a model with another dimension needs a restart
+//only named vectors are stored, an unnamed one has nothing to share it by and would take a slot per response forever
+//vectors are never freed, so like the interner this only grows with the dataset (and each forgetNames()), capped at MAX_SLOTS
+
+namespace CoreSystems {
+
+    enum class EmbeddingFormat : uint8_t {
+        FLOAT32,
+        FLOAT16,
+        INT8
+    };
+    inline const char* embeddingFormatToString(EmbeddingFormat format) {
+        switch (format) {
+            case EmbeddingFormat::FLOAT32: return "float32";
+            case EmbeddingFormat::FLOAT16: return "float16";
+            case EmbeddingFormat::INT8: return "int8";
+            default: return "unknown";
+        }
+    }
+    //accepts float32/f32, float16/f16 and int8/i8 (any case), nothing for anything else
+    inline std::optional<EmbeddingFormat> parseEmbeddingFormat(std::string name) {
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (name == "float32" || name == "f32") return EmbeddingFormat::FLOAT32;
+        if (name == "float16" || name == "f16") return EmbeddingFormat::FLOAT16;
+        if (name == "int8" || name == "i8") return EmbeddingFormat::INT8;
+        return std::nullopt;
+    }
+
+    //a vector in an EmbeddingStore, the default one is "no embedding"
+    class EmbeddingRef {
+    public:
+        EmbeddingRef() = default;
+        bool empty() const { return index == 0; }
+        uint32_t slot() const { return index - 1; }
+        friend bool operator==(EmbeddingRef a, EmbeddingRef b) { return a.index == b.index; }
+        friend bool operator!=(EmbeddingRef a, EmbeddingRef b) { return a.index != b.index; }
+
+    private:
+        friend class EmbeddingStore;
+        explicit EmbeddingRef(uint32_t slot) : index(slot + 1) {}
+        uint32_t index = 0;
+    };
+
+    namespace detail {
+        //ieee binary16 conversions with round to nearest even, only used when storing, kernels use F16C when they can
+        inline uint32_t floatBits(float value) { uint32_t bits; std::memcpy(&bits, &value, 4); return bits; }
+        inline float bitsFloat(uint32_t bits) { float value; std::memcpy(&value, &bits, 4); return value; }
+        inline uint16_t floatToHalf(float value) {
+            uint32_t x = floatBits(value);
+            uint32_t sign = x & 0x80000000u;
+            x ^= sign;
+            uint32_t half;
+            if (x >= 0x47800000u) { //too big for a half (or inf/nan)
+                half = x > 0x7F800000u ? 0x7E00 : 0x7C00;
+            } else if (x < 0x38800000u) { //half subnormal or zero, the float add does the rounding
+                half = floatBits(bitsFloat(x) + bitsFloat(126u << 23)) - (126u << 23);
+            } else {
+                uint32_t odd = (x >> 13) & 1;
+                x += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFF + odd;
+                half = x >> 13;
+            }
+            return static_cast<uint16_t>(half | (sign >> 16));
+        }
+        inline float halfToFloat(uint16_t half) {
+            uint32_t bits = static_cast<uint32_t>(half & 0x7FFF) << 13;
+            uint32_t exponent = bits & (0x7C00u << 13);
+            bits += static_cast<uint32_t>(127 - 15) << 23;
+            if (exponent == (0x7C00u << 13)) { //inf/nan
+                bits += static_cast<uint32_t>(128 - 16) << 23;
+            } else if (exponent == 0) { //subnormal
+                bits += 1u << 23;
+                bits = floatBits(bitsFloat(bits) - bitsFloat(113u << 23));
+            }
+            return bitsFloat(bits | (static_cast<uint32_t>(half & 0x8000) << 16));
+        }
+
+        //dot product of a stored vector with a float query, int8 results still have to be multiplied by the vector's scale
+        using DotKernel = float (*)(const void* stored, const float* query, size_t dimension);
+
+        inline float dotFloat32Scalar(const void* stored, const float* query, size_t dimension) {
+            const float* values = static_cast<const float*>(stored);
+            float sum = 0.0f;
+            for (size_t i = 0; i < dimension; i++) sum += values[i] * query[i];
+            return sum;
+        }
+        inline float dotFloat16Scalar(const void* stored, const float* query, size_t dimension) {
+            const uint16_t* values = static_cast<const uint16_t*>(stored);
+            float sum = 0.0f;
+            for (size_t i = 0; i < dimension; i++) sum += halfToFloat(values[i]) * query[i];
+            return sum;
+        }
+        inline float dotInt8Scalar(const void* stored, const float* query, size_t dimension) {
+            const int8_t* values = static_cast<const int8_t*>(stored);
+            float sum = 0.0f;
+            for (size_t i = 0; i < dimension; i++) sum += static_cast<float>(values[i]) * query[i];
+            return sum;
+        }
+
+#if defined(PALETTE_EMBEDDING_AVX2)
+        //compiled for avx2 regardless of -march, only called after the cpu check in EmbeddingStore
+        __attribute__((target("avx2,fma"))) inline float horizontalSum(__m256 v) {
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+            return _mm_cvtss_f32(sum);
+        }
+        //two accumulators so consecutive fmas don't wait on each other
+        __attribute__((target("avx2,fma"))) inline float dotFloat32Avx2(const void* stored, const float* query, size_t dimension) {
+            const float* values = static_cast<const float*>(stored);
+            __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+            size_t i = 0;
+            for (; i + 16 <= dimension; i += 16) {
+                sum0 = _mm256_fmadd_ps(_mm256_load_ps(values + i), _mm256_loadu_ps(query + i), sum0);
+                sum1 = _mm256_fmadd_ps(_mm256_load_ps(values + i + 8), _mm256_loadu_ps(query + i + 8), sum1);
+            }
+            for (; i + 8 <= dimension; i += 8) {
+                sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(values + i), _mm256_loadu_ps(query + i), sum0);
+            }
+            float sum = horizontalSum(_mm256_add_ps(sum0, sum1));
+            for (; i < dimension; i++) sum += values[i] * query[i];
+            return sum;
+        }
+        __attribute__((target("avx2,fma,f16c"))) inline float dotFloat16Avx2(const void* stored, const float* query, size_t dimension) {
+            const uint16_t* values = static_cast<const uint16_t*>(stored);
+            __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+            size_t i = 0;
+            for (; i + 16 <= dimension; i += 16) {
+                __m256i halves = _mm256_load_si256(reinterpret_cast<const __m256i*>(values + i));
+                sum0 = _mm256_fmadd_ps(_mm256_cvtph_ps(_mm256_castsi256_si128(halves)), _mm256_loadu_ps(query + i), sum0);
+                sum1 = _mm256_fmadd_ps(_mm256_cvtph_ps(_mm256_extracti128_si256(halves, 1)), _mm256_loadu_ps(query + i + 8), sum1);
+            }
+            for (; i + 8 <= dimension; i += 8) {
+                __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+                sum0 = _mm256_fmadd_ps(_mm256_cvtph_ps(halves), _mm256_loadu_ps(query + i), sum0);
+            }
+            float sum = horizontalSum(_mm256_add_ps(sum0, sum1));
+            for (; i < dimension; i++) sum += halfToFloat(values[i]) * query[i];
+            return sum;
+        }
+        __attribute__((target("avx2,fma"))) inline float dotInt8Avx2(const void* stored, const float* query, size_t dimension) {
+            const int8_t* values = static_cast<const int8_t*>(stored);
+            __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+            size_t i = 0;
+            for (; i + 16 <= dimension; i += 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+                __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes));
+                __m256 high = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(bytes, 8)));
+                sum0 = _mm256_fmadd_ps(low, _mm256_loadu_ps(query + i), sum0);
+                sum1 = _mm256_fmadd_ps(high, _mm256_loadu_ps(query + i + 8), sum1);
+            }
+            float sum = horizontalSum(_mm256_add_ps(sum0, sum1));
+            for (; i < dimension; i++) sum += static_cast<float>(values[i]) * query[i];
+            return sum;
+        }
+        inline bool cpuHasAvx2() {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+        }
+#else
+        inline bool cpuHasAvx2() { return false; }
+#endif
+    } //end of namespace detail
+
+    class EmbeddingStore {
+    public:
+        static constexpr size_t SLOTS_PER_BLOCK = 1024;
+        static constexpr size_t MAX_BLOCKS = 1024;
+        static constexpr size_t MAX_SLOTS = SLOTS_PER_BLOCK * MAX_BLOCKS;
+        static constexpr size_t ALIGNMENT = 64; //a cache line, and enough for aligned avx loads
+
+        //the store every node uses, format from PALETTE_EMBEDDING_FORMAT (default float32)
+        static EmbeddingStore& global() {
+            static EmbeddingStore* store = new EmbeddingStore(configuredFormat(), "global"); //leaked on purpose, like the interner
+            return *store;
+        }
+        static EmbeddingFormat configuredFormat() {
+            const char* configured = std::getenv("PALETTE_EMBEDDING_FORMAT");
+            if (!configured || !*configured) return EmbeddingFormat::FLOAT32;
+            std::optional<EmbeddingFormat> format = parseEmbeddingFormat(configured);
+            if (!format) {
+                LOG_WARN("PALETTE_EMBEDDING_FORMAT '" << configured << "' isn't float32, float16 or int8, storing embeddings as float32");
+                return EmbeddingFormat::FLOAT32;
+            }
+            return *format;
+        }
+
+        //storeName labels this store's metrics
+        explicit EmbeddingStore(EmbeddingFormat format, const std::string& storeName = "")
+            : format(format), elementBytes(format == EmbeddingFormat::FLOAT32 ? 4 : format == EmbeddingFormat::FLOAT16 ? 2 : 1) {
+            bool avx2 = detail::cpuHasAvx2();
+            switch (format) {
+                case EmbeddingFormat::FLOAT32: kernel = detail::dotFloat32Scalar; break;
+                case EmbeddingFormat::FLOAT16: kernel = detail::dotFloat16Scalar; break;
+                case EmbeddingFormat::INT8: kernel = detail::dotInt8Scalar; break;
+            }
+#if defined(PALETTE_EMBEDDING_AVX2)
+            if (avx2) {
+                switch (format) {
+                    case EmbeddingFormat::FLOAT32: kernel = detail::dotFloat32Avx2; break;
+                    case EmbeddingFormat::FLOAT16: kernel = detail::dotFloat16Avx2; break;
+                    case EmbeddingFormat::INT8: kernel = detail::dotInt8Avx2; break;
+                }
+            }
+#endif
+            simd = avx2;
+            if (!storeName.empty()) {
+                metrics::Labels labels = {{"store", storeName}, {"format", embeddingFormatToString(format)}};
+                auto& registry = metrics::Registry::instance();
+                registry.valueFunction("palette_embedding_vectors", "Vectors held by the embedding store", metrics::MetricType::GAUGE,
+                                       labels, this, [this]() { return static_cast<double>(size()); });
+                registry.valueFunction("palette_embedding_bytes", "Bytes allocated for embedding blocks", metrics::MetricType::GAUGE,
+                                       labels, this, [this]() { return static_cast<double>(allocatedBytes()); });
+                rejected = &registry.counter("palette_embedding_rejected_total",
+                                             "Vectors not stored because of a dimension mismatch or a full store", labels);
+            }
+        }
+        ~EmbeddingStore() {
+            metrics::Registry::instance().removeOwner(this);
+            for (auto& block : blocks) {
+                Block* owned = block.load(std::memory_order_relaxed);
+                if (!owned) continue;
+                ::operator delete(owned->data, std::align_val_t(ALIGNMENT));
+                delete owned;
+            }
+        }
+        EmbeddingStore(const EmbeddingStore&) = delete;
+        EmbeddingStore& operator=(const EmbeddingStore&) = delete;
+
+        //the vector stored for name, storing values first if there isn't one yet
+        //an empty ref if name or values is empty, values has the wrong dimension, or the store is full
+        EmbeddingRef put(InternedString name, const float* values, size_t count) {
+            if (count == 0 || name.empty()) return EmbeddingRef();
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex);
+                auto found = slots.find(name);
+                if (found != slots.end()) return EmbeddingRef(found->second);
+            }
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            auto found = slots.find(name);
+            if (found != slots.end()) return EmbeddingRef(found->second);
+            size_t expected = dimension.load(std::memory_order_relaxed);
+            if (expected == 0) {
+                dimension.store(count, std::memory_order_relaxed);
+                stride = (count * elementBytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+            } else if (expected != count || used >= MAX_SLOTS) {
+                if (rejected) rejected->inc();
+                return EmbeddingRef();
+            }
+            uint32_t slot = static_cast<uint32_t>(used);
+            Block* block = blockFor(slot);
+            size_t offset = slot % SLOTS_PER_BLOCK;
+            encode(values, count, block->data + offset * stride, block->scales[offset]);
+            slots.emplace(name, slot);
+            used++;
+            vectorCount.store(used, std::memory_order_release);
+            return EmbeddingRef(slot);
+        }
+        EmbeddingRef put(InternedString name, const std::vector<float>& values) { return put(name, values.data(), values.size()); }
+        EmbeddingRef find(InternedString name) const {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto found = slots.find(name);
+            return found == slots.end() ? EmbeddingRef() : EmbeddingRef(found->second);
+        }
+        //drops every name's vector so the next put() stores what weaviate hands back now
+        //refs already handed out stay readable (nodes in flight still hold them), their slots just aren't reused
+        void forgetNames() {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            slots.clear();
+        }
+
+        //dot product with a float vector of dimension() values, 0 for an empty ref
+        float dot(EmbeddingRef ref, const float* query) const {
+            if (ref.empty()) return 0.0f;
+            const Block* block = blocks[ref.slot() / SLOTS_PER_BLOCK].load(std::memory_order_acquire);
+            size_t offset = ref.slot() % SLOTS_PER_BLOCK;
+            return kernel(block->data + offset * stride, query, dimension.load(std::memory_order_relaxed)) * block->scales[offset];
+        }
+        //dot products of query with many stored vectors, the batch form of dot() for scoring a whole result set
+        void dotMany(const float* query, const EmbeddingRef* refs, size_t count, float* out) const {
+            size_t length = dimension.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count; i++) {
+                if (refs[i].empty()) {
+                    out[i] = 0.0f;
+                    continue;
+                }
+                const Block* block = blocks[refs[i].slot() / SLOTS_PER_BLOCK].load(std::memory_order_acquire);
+                size_t offset = refs[i].slot() % SLOTS_PER_BLOCK;
+                out[i] = kernel(block->data + offset * stride, query, length) * block->scales[offset];
+            }
+        }
+        //the stored vector as floats (what was put in, give or take the format's rounding)
+        void decode(EmbeddingRef ref, float* out) const {
+            if (ref.empty()) return;
+            const Block* block = blocks[ref.slot() / SLOTS_PER_BLOCK].load(std::memory_order_acquire);
+            size_t offset = ref.slot() % SLOTS_PER_BLOCK;
+            const unsigned char* data = block->data + offset * stride;
+            size_t length = dimension.load(std::memory_order_relaxed);
+            float scale = block->scales[offset];
+            for (size_t i = 0; i < length; i++) {
+                switch (format) {
+                    case EmbeddingFormat::FLOAT32: out[i] = reinterpret_cast<const float*>(data)[i]; break;
+                    case EmbeddingFormat::FLOAT16: out[i] = detail::halfToFloat(reinterpret_cast<const uint16_t*>(data)[i]); break;
+                    case EmbeddingFormat::INT8: out[i] = static_cast<float>(reinterpret_cast<const int8_t*>(data)[i]) * scale; break;
+                }
+            }
+        }
+        std::vector<float> values(EmbeddingRef ref) const {
+            if (ref.empty()) return {};
+            std::vector<float> decoded(dimension.load(std::memory_order_relaxed));
+            decode(ref, decoded.data());
+            return decoded;
+        }
+
+        EmbeddingFormat getFormat() const { return format; }
+        bool usesSimd() const { return simd; }
+        size_t getDimension() const { return dimension.load(std::memory_order_relaxed); }
+        size_t size() const { return vectorCount.load(std::memory_order_acquire); }
+        size_t bytesPerVector() const { return stride + sizeof(float); }
+        size_t allocatedBytes() const { return allocatedBlocks.load(std::memory_order_relaxed) * SLOTS_PER_BLOCK * bytesPerVector(); }
+
+    private:
+        struct Block {
+            unsigned char* data; //SLOTS_PER_BLOCK vectors, stride bytes apart
+            std::array<float, SLOTS_PER_BLOCK> scales; //1 unless the format is int8
+        };
+
+        //mutex held
+        Block* blockFor(uint32_t slot) {
+            std::atomic<Block*>& entry = blocks[slot / SLOTS_PER_BLOCK];
+            Block* block = entry.load(std::memory_order_relaxed);
+            if (!block) {
+                block = new Block();
+                block->data = static_cast<unsigned char*>(::operator new(SLOTS_PER_BLOCK * stride, std::align_val_t(ALIGNMENT)));
+                std::memset(block->data, 0, SLOTS_PER_BLOCK * stride); //padding after each vector stays zero
+                block->scales.fill(1.0f);
+                entry.store(block, std::memory_order_release);
+                allocatedBlocks.fetch_add(1, std::memory_order_relaxed);
+            }
+            return block;
+        }
+        void encode(const float* values, size_t count, unsigned char* out, float& scale) const {
+            switch (format) {
+                case EmbeddingFormat::FLOAT32:
+                    std::memcpy(out, values, count * sizeof(float));
+                    break;
+                case EmbeddingFormat::FLOAT16: {
+                    uint16_t* halves = reinterpret_cast<uint16_t*>(out);
+                    for (size_t i = 0; i < count; i++) halves[i] = detail::floatToHalf(values[i]);
+                    break;
+                }
+                case EmbeddingFormat::INT8: {
+                    float largest = 0.0f;
+                    for (size_t i = 0; i < count; i++) largest = std::max(largest, std::fabs(values[i]));
+                    scale = largest > 0.0f ? largest / 127.0f : 1.0f;
+                    int8_t* bytes = reinterpret_cast<int8_t*>(out);
+                    for (size_t i = 0; i < count; i++) {
+                        bytes[i] = static_cast<int8_t>(std::lround(std::clamp(values[i] / scale, -127.0f, 127.0f)));
+                    }
+                    break;
+                }
+            }
+        }
+
+        const EmbeddingFormat format;
+        const size_t elementBytes;
+        detail::DotKernel kernel = nullptr;
+        bool simd = false;
+        metrics::Counter* rejected = nullptr;
+
+        mutable std::shared_mutex mutex; //writers only, readers go through blocks
+        std::unordered_map<InternedString, uint32_t> slots;
+        std::atomic<size_t> dimension{0};
+        size_t stride = 0; //bytes from one vector to the next, set with dimension
+        size_t used = 0;
+        std::atomic<size_t> vectorCount{0};
+        std::atomic<size_t> allocatedBlocks{0};
+        std::array<std::atomic<Block*>, MAX_BLOCKS> blocks{};
+    };
+
+} //end of namespace CoreSystems
@@ -5,6 +5,7 @@
 #include <atomic>
 #include <memory>
 #include "core-systems.hpp"
+#include "admission-control.hpp"
 #include "vector-engine.cpp"
 
 namespace GroundControl {
@@ -14,15 +15,45 @@ namespace GroundControl {
         //shared_ptr gives shared ownership and lets multiple pointers point to the same object
         //object deleted when shared_ptr goes out of scope and other shared_ptrs refering to the same object are destroyed
         std::shared_ptr<CoreSystems::SystemManager> systemManager;
+        CoreSystems::metrics::Counter& graphqlErrors = CoreSystems::metrics::Registry::instance().counter(
+            "palette_graphql_errors_total", "GraphQL requests answered with an errors array");
+        std::array<CoreSystems::metrics::Counter*, 3> tierCounters; //indexed by DegradationTier
+        CoreSystems::metrics::Counter& partialSearches = CoreSystems::metrics::Registry::instance().counter(
+            "palette_searches_partial_total", "Searches cut short by their deadline");
+
+        //search deadline when the request doesn't send timeout_ms, PALETTE_SEARCH_TIMEOUT_MS overrides it
+        static constexpr std::chrono::milliseconds DEFAULT_SEARCH_TIMEOUT{3000};
+        static constexpr std::chrono::milliseconds MIN_SEARCH_TIMEOUT{50};
+        static constexpr std::chrono::milliseconds MAX_SEARCH_TIMEOUT{30000};
+        std::chrono::milliseconds defaultSearchTimeout = DEFAULT_SEARCH_TIMEOUT;
     public:
         //constructor
         explicit GraphQLHandler(std::shared_ptr<CoreSystems::SystemManager> sm) 
-            : systemManager(sm) {}
+            : systemManager(sm) {
+                for (size_t i = 0; i < tierCounters.size(); i++) {
+                    tierCounters[i] = &CoreSystems::metrics::Registry::instance().counter("palette_searches_total",
+                        "Searches by the degradation tier they ran at",
+                        {{"tier", CoreSystems::degradationTierToString(static_cast<CoreSystems::DegradationTier>(i))}});
+                }
+                if (const char* configured = std::getenv("PALETTE_SEARCH_TIMEOUT_MS")) {
+                    int64_t value = std::atoll(configured);
+                    if (value > 0) {
+                        defaultSearchTimeout = std::chrono::milliseconds(std::clamp<int64_t>(value, MIN_SEARCH_TIMEOUT.count(), MAX_SEARCH_TIMEOUT.count()));
+                    }
+                }
+            }
             //takes in a pointer to a SystemManager object and initializes coreSystems with cs
         
+        //operations that fan out to weaviate/pinterest and go through admission control
+        //everything else (system_health, telemetry_report, clear_cache, ...) is the priority lane and is never shed
+        static bool isExpensiveOperation(const std::string& query) {
+            return query.find("search_concepts") != std::string::npos ||
+                   query.find("refresh_pinterest_data") != std::string::npos;
+        }
+
         //hangle graohQL queries
         nlohmann::json handleQuery(const nlohmann::json& request) {
-            std::cout << "graphQL handler handling query request: " << request << std::endl;
+            LOG_DEBUG("graphQL handler handling query request: " << request);
             try {
                 std::string query = request.value("query", "");
                 nlohmann::json variables = request.value("variables", nlohmann::json::object());
@@ -46,7 +77,7 @@ namespace GroundControl {
         }
         //handle graphql mutations
         nlohmann::json handleMutation(const nlohmann::json& request) {
-            std::cout << "graphQL handler handling mutation request: " << request << std::endl;
+            LOG_DEBUG("graphQL handler handling mutation request: " << request);
             try {
                 std::string query = request.value("query", "");
                 nlohmann::json variables = request.value("variables", nlohmann::json::object());
@@ -70,18 +101,43 @@ namespace GroundControl {
         nlohmann::json handleSearchConcepts(const nlohmann::json& variables) {
             std::string searchQuery = variables.value("query", "");
             int limit = variables.value("limit", 10); //default is 10 node
+            //time budget for the whole search, upstream calls only get what's left of it
+            int64_t timeoutMs = defaultSearchTimeout.count();
+            if (variables.contains("timeout_ms")) {
+                const nlohmann::json& requested = variables["timeout_ms"];
+                //checked before converting, nlohmann throws on a string, truncates a float and wraps an unsigned past INT64_MAX
+                bool integral = requested.is_number_integer() &&
+                                !(requested.is_number_unsigned() && requested.get<uint64_t>() > static_cast<uint64_t>(MAX_SEARCH_TIMEOUT.count()));
+                timeoutMs = integral ? requested.get<int64_t>() : MAX_SEARCH_TIMEOUT.count() + 1;
+                if (timeoutMs < MIN_SEARCH_TIMEOUT.count() || timeoutMs > MAX_SEARCH_TIMEOUT.count()) {
+                    return createErrorResponse("timeout_ms must be an integer between " + std::to_string(MIN_SEARCH_TIMEOUT.count()) +
+                                               " and " + std::to_string(MAX_SEARCH_TIMEOUT.count()));
+                }
+            }
 
             if (searchQuery.empty()) {
                 return createErrorResponse("search query cannot be empty");
             }
 
-            std::cout << "Ground Control: Initiating search mission for '" << searchQuery << "'" << std::endl;
+            LOG_DEBUG("Ground Control: Initiating search mission for '" << searchQuery << "'");
+
+            //starting the request's trace, every span below (including ones on pinterest threads) reports into it
+            auto trace = CoreSystems::tracing::RequestTrace::start();
+            CoreSystems::tracing::ScopedContext traceScope(trace);
+            CoreSystems::tracing::ScopedSpan requestSpan("graphql.search_concepts");
+            auto telemetryProcessor = systemManager->getTelemetryProcessor();
 
             //starting timer for performance
             CoreSystems::utils::PerformanceTimer timer;
 
             //executing search for nodes
-            auto nodes = systemManager -> search(searchQuery); //using -> bc coreSystems is a pointer to the acc system manager object
+            CoreSystems::SearchContext searchContext{std::chrono::milliseconds(timeoutMs)};
+            auto result = systemManager -> search(searchQuery, searchContext); //using -> bc coreSystems is a pointer to the acc system manager object
+            auto& nodes = result.nodes;
+            tierCounters[static_cast<size_t>(result.tier)]->inc();
+            if (result.partial) {
+                partialSearches.inc();
+            }
             //enforce limit if needed
             if (limit > 0 && nodes.size() > static_cast<size_t>(limit)) {
                 nodes.resize(limit); //will cut off elements at the end if the size of nodes is greater than limit
@@ -89,36 +145,56 @@ namespace GroundControl {
 
             auto processingTime = timer.elapsedMs();
             auto healthStatus = systemManager -> getSystemHealth();
-            //record telemetry 
+
+            //building graphQL response
+            nlohmann::json data;
+            {
+                CoreSystems::tracing::ScopedSpan buildSpan("graphql.response_build", CoreSystems::PipelineStage::RESPONSE_BUILD,
+                    telemetryProcessor ? telemetryProcessor->stageHistogram(CoreSystems::PipelineStage::RESPONSE_BUILD) : nullptr);
+                data = {
+                    {"search_concepts", {
+                        {"mission_id", CoreSystems::utils::generateUUID()},
+                        {"trace_id", CoreSystems::tracing::traceIdToString(trace->getTraceId())},
+                        {"query", searchQuery},
+                        {"nodes", nlohmann::json::array()},
+                        {"processing_time_ms", processingTime},
+                        {"system_status", CoreSystems::systemHealthToString(healthStatus)},
+                        {"degradation_tier", CoreSystems::degradationTierToString(result.tier)},
+                        {"served_from_cache", result.fromCache},
+                        {"stale", result.stale},
+                        {"partial", result.partial},
+                        {"hedged", result.hedged},
+                        {"served_by", result.servedBy},
+                        {"timeout_ms", timeoutMs},
+                        {"pinterest_integration_status", "ACTIVE"},
+                        {"timestamp", CoreSystems::utils::getTimestampMs()}
+                    }}
+                };
+                //converting nodes to JSON
+                for (const auto& node : nodes) {
+                    data["search_concepts"]["nodes"].push_back(node.toJson());
+                }
+            }
+
+            //record telemetry, with the per-stage breakdown collected by the trace
             CoreSystems::SearchTelemetry telemetry;
             telemetry.searchId = CoreSystems::utils::generateUUID();
             telemetry.searchPhrase = searchQuery;
             telemetry.processingTime = processingTime;
             telemetry.nodesFound = nodes.size();
             telemetry.timestamp = CoreSystems::utils::getCurrentTime();
-            systemManager -> recordTelemetry(telemetry);
-
-            //building graphQL response
-            nlohmann::json data = {
-                {"search_concepts", {
-                    {"mission_id", CoreSystems::utils::generateUUID()},
-                    {"query", searchQuery},
-                    {"nodes", nlohmann::json::array()},
-                    {"processing_time_ms", processingTime},
-                    {"system_status", CoreSystems::systemHealthToString(healthStatus)},
-                    {"pinterest_integration_status", "ACTIVE"},
-                    {"timestamp", CoreSystems::utils::getTimestampMs()}
-                }}
-            };
-            //converting nodes to JSON
-            for (const auto& node : nodes) {
-                data["search_concepts"]["nodes"].push_back(node.toJson());
+            telemetry.traceId = trace->getTraceId();
+            telemetry.processingTimeNs = requestSpan.elapsedNs();
+            telemetry.stageTimeNs = trace->stageBreakdownNs();
+            if (telemetryProcessor) {
+                telemetryProcessor->recordSearchLatency(telemetry.processingTimeNs / 1000);
             }
+            systemManager -> recordTelemetry(std::move(telemetry));
             return {{"data", data}};
         }
 
         nlohmann::json handleSystemHealth() {
-            std::cout << "ground control system health check starting..." << std::endl;
+            LOG_DEBUG("ground control system health check starting...");
             try {
                 auto healthStatus = systemManager -> getSystemHealth();
                 auto& healthMetrics = systemManager -> getHealthMetrics();
@@ -127,13 +203,18 @@ namespace GroundControl {
                         {"status", CoreSystems::systemHealthToString(healthStatus)},
                         {"cpu_useage", healthMetrics.cpuUsage.load()},
                         {"memory_usage", healthMetrics.memoryUsage.load()},
+                        {"resident_memory_bytes", healthMetrics.residentMemoryBytes.load()},
+                        {"available_cores", healthMetrics.availableCores.load()},
                         {"timestamp", CoreSystems::utils::getTimestampMs()},
                         {"active_connections", healthMetrics.activeConnections.load()},
                         {"error_rate", healthMetrics.errorRate.load()},
                         //{"uptime_ms", CoreSystems::utils::getTimestampMs()},
                         {"version", "1.0.0"},
                         {"primary_engine_operational", systemManager->getPrimaryVectorEngine() ? systemManager->getPrimaryVectorEngine()->isEngineOperational() : false},
-                        {"backup_engine_operational", systemManager->getBackupVectorEngine() ? systemManager->getBackupVectorEngine()->isEngineOperational() : false}
+                        {"backup_engine_operational", systemManager->getBackupVectorEngine() ? systemManager->getBackupVectorEngine()->isEngineOperational() : false},
+                        {"balancing_mode", CoreSystems::balancingModeToString(systemManager->getBalancingMode())},
+                        {"engines", systemManager->getEngineReport()},
+                        {"circuit_breakers", systemManager->getCircuitBreakerReport()}
                     }}
                 };
 
@@ -148,7 +229,7 @@ namespace GroundControl {
                 return createErrorResponse("Concept name cannot be empty");
             }
 
-            std::cout << "ground control, pinterest image request for " << conceptName << std::endl;
+            LOG_DEBUG("ground control, pinterest image request for " << conceptName);
             try {
                 std::vector<CoreSystems::PinterestImage> images;
                 //get images from vector engine cache
@@ -173,7 +254,7 @@ namespace GroundControl {
                 return {{"data", data}};
 
             } catch (const std::exception& e) {
-                std::cerr << "Failed to initialize HTTP Server: " << e.what() << std::endl;
+                LOG_ERROR("Failed to initialize HTTP Server: " << e.what());
                 return false;
             }
             
@@ -192,7 +273,7 @@ namespace GroundControl {
             // return {{"data", ""}};
         }
         nlohmann::json handleTelemetryReport() {
-            std::cout << "Ground Control: Telemetry report requested" << std::endl;
+            LOG_DEBUG("Ground Control: Telemetry report requested");
             try{
                 auto telemetryProcessor = systemManager->getTelemetryProcessor();
                 if (telemetryProcessor) {
@@ -203,6 +284,9 @@ namespace GroundControl {
                         {"average_response_time", report["average_response_time"]},
                         {"error_rate", report["error_rate"]},
                         {"telemetry_records", report["telemetry_records"]},
+                        {"recent_searches", report["recent_searches"]},
+                        {"telemetry_dropped", systemManager->getDroppedTelemetryCount()},
+                        {"latency", report["latency"]},
                         {"timestamp", report["timestamp"]}
                     };
                     return {{"data", data}};
@@ -227,7 +311,7 @@ namespace GroundControl {
         }
         nlohmann::json handleRefreshPinterestData(const nlohmann::json& variables) {
            std::string conceptName = variables.value("concept", "");
-           std::cout << "Ground Control: Pinterest data refresh for '" << conceptName << "'" << std::endl;
+           LOG_INFO("Ground Control: Pinterest data refresh for '" << conceptName << "'");
 
            try {
                 bool success = false;
@@ -261,7 +345,7 @@ namespace GroundControl {
         }
         nlohmann::json handleEmergencyRestart(const nlohmann::json& variables) {
             std::string subsystemName = variables.value("subsystem", "");
-            std::cout << "Ground Control: EMERGENCY RESTART requested for '" << subsystemName << "'" << std::endl;
+            LOG_WARN("Ground Control: EMERGENCY RESTART requested for '" << subsystemName << "'");
         
             bool success = false;
             std::string message = "Unknown subsystem";
@@ -284,7 +368,7 @@ namespace GroundControl {
             return {{"data", data}};
         }
         nlohmann::json handleClearCache() {
-            std::cout << "Ground Control: Cache clear requested" << std::endl;
+            LOG_INFO("Ground Control: Cache clear requested");
             
             try {
                 bool success = false;
@@ -321,6 +405,7 @@ namespace GroundControl {
             // return {{"data", data}};
         }
         nlohmann::json createErrorResponse(const std::string& message) {
+            graphqlErrors.inc();
             return {
                 {"errors", {{
                     {"message", message},
@@ -329,6 +414,39 @@ namespace GroundControl {
             };
         }
     };
+    //httplib's thread pool, plus gauges for how many requests are waiting for a worker and how many workers are busy
+    class InstrumentedTaskQueue : public httplib::TaskQueue {
+    public:
+        explicit InstrumentedTaskQueue(size_t threadCount) : pool(threadCount) {
+            auto& registry = CoreSystems::metrics::Registry::instance();
+            registry.gauge("palette_http_workers", "Size of the http worker pool").set(static_cast<int64_t>(threadCount));
+        }
+        bool enqueue(std::function<void()> fn) override {
+            queued.add(1);
+            bool accepted = pool.enqueue([this, fn = std::move(fn)]() {
+                queued.add(-1);
+                busy.add(1);
+                fn();
+                busy.add(-1);
+            });
+            if (!accepted) {
+                queued.add(-1);
+                rejected.inc();
+            }
+            return accepted;
+        }
+        void shutdown() override { pool.shutdown(); }
+
+    private:
+        CoreSystems::metrics::Gauge& queued = CoreSystems::metrics::Registry::instance().gauge(
+            "palette_http_queue_depth", "Accepted connections waiting for an http worker");
+        CoreSystems::metrics::Gauge& busy = CoreSystems::metrics::Registry::instance().gauge(
+            "palette_http_workers_busy", "Http workers currently handling a connection");
+        CoreSystems::metrics::Counter& rejected = CoreSystems::metrics::Registry::instance().counter(
+            "palette_http_rejected_total", "Connections the worker pool refused");
+        httplib::ThreadPool pool; //declared last so its workers stop before the gauges they update go away
+    };
+
     class HttpServer{
     private:
         std::unique_ptr<httplib::Server> server;
@@ -337,10 +455,17 @@ namespace GroundControl {
         std::atomic<bool> isRunning{false};
         std::thread serverThread;
         int port;
+
+        //in-flight cap for expensive graphql operations, always a few workers short of the pool
+        //so cheap queries and /health still find a free worker while searches are saturated
+        const size_t httpWorkers = CPPHTTPLIB_THREAD_POOL_COUNT;
+        static constexpr size_t PRIORITY_LANE_WORKERS = 2;
+        std::unique_ptr<CoreSystems::AdmissionController> admission;
     public: 
         explicit HttpServer(int port = 8080) : port(port) {} //constructor
 
         ~HttpServer(){ //deconstructor
+            CoreSystems::metrics::Registry::instance().removeOwner(this);
             shutdown();
         }
         bool initialize() {
@@ -348,7 +473,7 @@ namespace GroundControl {
                 //initializing system manager
                 systemManager = std::make_shared<CoreSystems::SystemManager>();
                 if (!systemManager -> initialize()) {
-                    std::cerr << "Failed to initialize SystemManager" << std::endl;
+                    LOG_ERROR("Failed to initialize SystemManager");
                     return false;
                 }
                 //initializing graphql handler
@@ -356,9 +481,33 @@ namespace GroundControl {
 
                 //initialzing http server
                 server = std::make_unique<httplib::Server>();
+                server -> new_task_queue = [workers = httpWorkers] { return new InstrumentedTaskQueue(workers); };
+
+                CoreSystems::AdmissionController::Options admissionOptions;
+                admissionOptions.maxLimit = static_cast<double>(std::max<size_t>(1, httpWorkers - std::min(httpWorkers - 1, PRIORITY_LANE_WORKERS)));
+                admissionOptions.minLimit = std::min(admissionOptions.minLimit, admissionOptions.maxLimit);
+                admissionOptions.initialLimit = admissionOptions.maxLimit / 2.0;
+                admission = std::make_unique<CoreSystems::AdmissionController>(admissionOptions);
+
+                //request counters, registered here so handlers never touch the registry
+                auto& registry = CoreSystems::metrics::Registry::instance();
+                auto& graphqlRequests = registry.counter("palette_http_requests_total", "Http requests by route", {{"route", "/graphql"}});
+                auto& healthRequests = registry.counter("palette_http_requests_total", "Http requests by route", {{"route", "/health"}});
+                auto& traceRequests = registry.counter("palette_http_requests_total", "Http requests by route", {{"route", "/debug/trace"}});
+                auto& metricsRequests = registry.counter("palette_http_requests_total", "Http requests by route", {{"route", "/metrics"}});
+                auto& serverErrors = registry.counter("palette_http_server_errors_total", "Http requests answered with status 500");
+                auto& shedRequests = registry.counter("palette_http_shed_total", "Expensive graphql requests rejected with 503 by admission control");
+                CoreSystems::AdmissionController* controller = admission.get();
+                registry.valueFunction("palette_admission_limit", "Current concurrency limit for expensive graphql operations",
+                    CoreSystems::metrics::MetricType::GAUGE, {}, this, [controller]() { return controller->limit(); });
+                registry.valueFunction("palette_admission_in_flight", "Expensive graphql operations currently admitted",
+                    CoreSystems::metrics::MetricType::GAUGE, {}, this, [controller]() { return static_cast<double>(controller->inFlight()); });
+                registry.valueFunction("palette_admission_baseline_latency_seconds", "Unloaded latency estimate the limit is adapted against",
+                    CoreSystems::metrics::MetricType::GAUGE, {}, this, [controller]() { return controller->baselineLatencyUs() / 1e6; });
 
                 //cors headers
                 server -> set_pre_routing_handler([](const httplib::Request& req, httplib::Response& res){
+                    CoreSystems::tracing::setThreadName("http-worker"); //runs on the httplib worker thread handling this request
                     res.set_header("Access-Control-Allow-Origin", "*");
                     res.set_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
                     res.set_header("Access-Control-Allow-Headers", "Content-Type, Authorization");
@@ -373,22 +522,54 @@ namespace GroundControl {
                     return;
                 });
                 //graphQL endpoint
-                server -> Post("/graphql", [this](const httplib::Request& req, httplib::Response& res){
+                server -> Post("/graphql", [this, &requests = graphqlRequests, &serverErrors = serverErrors, &shedRequests = shedRequests](const httplib::Request& req, httplib::Response& res){
                     //will reveice every GraphQL request from frontent
+                    CoreSystems::tracing::ScopedSpan httpSpan("http.graphql");
+                    requests.inc();
+                    //declared outside the try so a throwing handler can mark it failed, unwinding would release it as a success
+                    CoreSystems::AdmissionController::Permit permit;
                     try {
                         //converting raw http request into nlohmann::json object
                         auto requestJson = nlohmann::json::parse(req.body); 
 
                         nlohmann::json response; //to store graphql repsonse that will be sent to client
                         std::string query = requestJson.value("query", ""); //getting the query
+
+                        //admission control: expensive operations need a permit, when there's none left the request
+                        //is rejected right away instead of waiting behind the searches already running
+                        if (GraphQLHandler::isExpensiveOperation(query)) {
+                            permit = admission->tryAcquire();
+                            if (!permit) {
+                                shedRequests.inc();
+                                int retryAfter = admission->retryAfterSeconds();
+                                res.status = 503;
+                                res.set_header("Retry-After", std::to_string(retryAfter));
+                                nlohmann::json overloaded = {
+                                    {"errors", {{
+                                        {"message", "Server is at capacity, retry later"},
+                                        {"extensions", {{"code", "OVERLOADED"}, {"retry_after_seconds", retryAfter}}},
+                                        {"timestamp", CoreSystems::utils::getTimestampMs()}
+                                    }}}
+                                };
+                                res.set_content(overloaded.dump(), "application/json");
+                                return;
+                            }
+                        }
                         //query vs mutation handling
                         if (query.find("mutation") != std::string::npos) {
                             response = graphqlHandler->handleMutation(requestJson);
                         } else {
                             response = graphqlHandler->handleQuery(requestJson);
                         }
+                        if (permit && (response.contains("errors") ||
+                                       response.value("/data/search_concepts/partial"_json_pointer, false))) {
+                            permit.markFailed(); //errors and deadline hits both mean the limit is too high
+                        }
                         res.set_content(response.dump(), "application/json");
                     } catch (const std::exception& e) {
+                        if (permit) {
+                            permit.markFailed();
+                        }
                         nlohmann::json errorResponse = {
                             {"errors", {{
                                 {"message", std::string("Server error: ") + e.what()},
@@ -397,10 +578,12 @@ namespace GroundControl {
                         };
                         res.set_content(errorResponse.dump(), "application/json");
                         res.status = 500;
+                        serverErrors.inc();
                     }
                 });
                 //health check endpoint
-                server -> Get("/health", [this](const httplib::Request&, httplib::Response& res){
+                server -> Get("/health", [this, &requests = healthRequests, &serverErrors = serverErrors](const httplib::Request&, httplib::Response& res){
+                    requests.inc();
                     try {
                         auto health = systemManager->getSystemHealth();
                         nlohmann::json healthResponse = {
@@ -417,15 +600,40 @@ namespace GroundControl {
                         };
                         res.set_content(errorResponse.dump(), "application/json");
                         res.status = 500;
+                        serverErrors.inc();
                     }
                 });
+                //prometheus scrape endpoint, only reads atomics and lock-free histograms
+                server -> Get("/metrics", [&requests = metricsRequests](const httplib::Request&, httplib::Response& res){
+                    requests.inc();
+                    res.set_content(CoreSystems::metrics::Registry::instance().scrape(), "text/plain; version=0.0.4; charset=utf-8");
+                });
+                //recent spans from every thread as Chrome Trace Event JSON, open the file in ui.perfetto.dev
+                //GET /debug/trace?seconds=N (default 10, at most 300)
+                server -> Get("/debug/trace", [&requests = traceRequests](const httplib::Request& req, httplib::Response& res){
+                    requests.inc();
+                    int seconds = 10;
+                    if (req.has_param("seconds")) {
+                        try {
+                            seconds = std::stoi(req.get_param_value("seconds"));
+                        } catch (const std::exception&) {
+                            res.status = 400;
+                            res.set_content(nlohmann::json{{"status", "error"}, {"message", "seconds must be a number"}}.dump(), "application/json");
+                            return;
+                        }
+                    }
+                    seconds = std::clamp(seconds, 1, 300);
+                    auto trace = CoreSystems::tracing::chromeTraceJson(std::chrono::seconds(seconds));
+                    res.set_header("Content-Disposition", "attachment; filename=\"palette-trace.json\"");
+                    res.set_content(trace.dump(), "application/json");
+                });
                 // Static file serving for React frontend (optional)
                 server->set_mount_point("/", "./public");
 
-                std::cout << "Ground Control: HTTP Server initialized on port " << port << std::endl;
+                LOG_INFO("Ground Control: HTTP Server initialized on port " << port);
                 return true;
             } catch (const std::exception& e) {
-                std::cerr << "Failed to initialize HTTP Server: " << e.what() << std::endl;
+                LOG_ERROR("Failed to initialize HTTP Server: " << e.what());
                 return false;
             }
         }
@@ -433,20 +641,22 @@ namespace GroundControl {
             if (isRunning.load()) {
                 //.load() checks value of isRunning & garantees this operation cant be disturbed by other threads
                 //safer than just if (isRunning)
-                std::cout << "Ground Control: Server already running" << std::endl;
+                LOG_WARN("Ground Control: Server already running");
                 return false;
             }
             isRunning.store(true);
             //creating a new thread that starts the http server asynchronously
             serverThread = std::thread([this]() {
-                std::cout << "Ground Control: Starting HTTP server on port " << port << std::endl;
-                std::cout << "Ground Control: GraphQL endpoint available at http://localhost:" << port << "/graphql" << std::endl;
-                std::cout << "Ground Control: Health check available at http://localhost:" << port << "/health" << std::endl;
+                LOG_INFO("Ground Control: Starting HTTP server on port " << port);
+                LOG_INFO("Ground Control: GraphQL endpoint available at http://localhost:" << port << "/graphql");
+                LOG_INFO("Ground Control: Health check available at http://localhost:" << port << "/health");
+                LOG_INFO("Ground Control: Prometheus metrics available at http://localhost:" << port << "/metrics");
+                LOG_INFO("Ground Control: Span trace export available at http://localhost:" << port << "/debug/trace?seconds=10");
                 
                 //server->listen() starts the server and binds to network
                 //0.0.0.0 binds the server to all network interfaces on this port
                 if (!server->listen("0.0.0.0", port)) {
-                    std::cerr << "Ground Control: Failed to start server on port " << port << std::endl;
+                    LOG_ERROR("Ground Control: Failed to start server on port " << port);
                     isRunning.store(false);
                 }
                 //giving server some time to start
@@ -459,7 +669,7 @@ namespace GroundControl {
             if (!isRunning.load()) { //if already not running
                 return;
             }
-            std::cout << "Ground Control: Shutting down HTTP server..." << std::endl;
+            LOG_INFO("Ground Control: Shutting down HTTP server...");
             
             isRunning.store(false);
             
@@ -474,7 +684,7 @@ namespace GroundControl {
                 systemManager->shutdown();
             }
 
-            std::cout << "Ground Control: Server shutdown complete" << std::endl;
+            LOG_INFO("Ground Control: Server shutdown complete");
         }
         bool isServerRunning() const {
             return isRunning.load();
@@ -486,30 +696,37 @@ namespace GroundControl {
 std::unique_ptr < GroundControl::HttpServer > globalServer;
 
 void signalHandler(int signal) {
-    std::cout << "\n🛑 Ground Control: Mission abort signal received..." << std::endl;
+    LOG_WARN("🛑 Ground Control: Mission abort signal received...");
     if (globalServer) {
         globalServer->shutdown();
     }
     exit(0);
 }
 
+//PALETTE_NO_MAIN lets another program (microbench.cpp) include the whole server without its entry point
+#ifndef PALETTE_NO_MAIN
 int main() { //main function
-    std::cout << "🚀 Ground Control: Mission Control Server Starting..." << std::endl;
+    LOG_INFO("🚀 Ground Control: Mission Control Server Starting...");
     
-    globalServer = std::make_unique<GroundControl::HttpServer>(8080);
+    //PALETTE_PORT moves the server off 8080, e.g. when a local weaviate or the mock upstream already has it
+    int port = 8080;
+    if (const char* configuredPort = std::getenv("PALETTE_PORT")) {
+        port = std::atoi(configuredPort) > 0 ? std::atoi(configuredPort) : port;
+    }
+    globalServer = std::make_unique<GroundControl::HttpServer>(port);
 
     //initialzing + starting server
     if (!globalServer->initialize()) {
-        std::cerr << "❌ Ground Control: Failed to initialize server" << std::endl;
+        LOG_ERROR("❌ Ground Control: Failed to initialize server");
         return 1;
     }
     if (!globalServer->start()) {
-        std::cerr << "❌ Ground Control: Failed to start server" << std::endl;
+        LOG_ERROR("❌ Ground Control: Failed to start server");
         return 1;
     }
-    std::cout << "✅ Ground Control: Mission Control is GO for launch!" << std::endl;
-    std::cout << "   GraphQL Playground: http://localhost:8080/graphql" << std::endl;
-    std::cout << "   System Health: http://localhost:8080/health" << std::endl;
+    LOG_INFO("✅ Ground Control: Mission Control is GO for launch!");
+    LOG_INFO("   GraphQL Playground: http://localhost:" << port << "/graphql");
+    LOG_INFO("   System Health: http://localhost:" << port << "/health");
 
     //keeps server running until interrupted
     signal(SIGINT, signalHandler); 
@@ -523,4 +740,5 @@ int main() { //main function
     }
     
     return 0;
-}
\ No newline at end of file
+}
+#endif
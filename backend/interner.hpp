@@ -0,0 +1,179 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "metrics.hpp"
+//process-wide table of concept names, each distinct string is stored once
+//summary:
+//InternedString is a 4 byte id for a string in the table, comparing or hashing two of them never touches the text
+//the text never moves and is never freed, so view() is valid for the life of the process and readable from any thread without a lock
+//the table only grows, so only text bounded by the dataset goes in:
+//  intern() is for names weaviate hands back, past MAX_STRINGS it throws
+//  find() never adds anything, it's what user text (queries, names in requests) is looked up with, unknown text is just a miss
+//interning takes a shard lock, find() a shared one, view() is two array reads
+
+namespace CoreSystems {
+
+    class InternedString {
+    public:
+        InternedString() = default; //the empty string, id 0
+        uint32_t id() const { return index; }
+        bool empty() const { return index == 0; }
+        std::string_view view() const;
+        operator std::string_view() const { return view(); }
+        friend bool operator==(InternedString a, InternedString b) { return a.index == b.index; }
+        friend bool operator!=(InternedString a, InternedString b) { return a.index != b.index; }
+        friend std::ostream& operator<<(std::ostream& out, InternedString s) { return out << s.view(); }
+
+    private:
+        friend class StringInterner;
+        explicit InternedString(uint32_t index) : index(index) {}
+        uint32_t index = 0;
+    };
+
+    class StringInterner {
+    public:
+        static constexpr size_t BLOCK_STRINGS = 4096; //views are kept in fixed blocks so a block never moves once readers can see it
+        static constexpr size_t MAX_BLOCKS = 1024;
+        static constexpr size_t MAX_STRINGS = BLOCK_STRINGS * MAX_BLOCKS;
+        static constexpr size_t TEXT_CHUNK_BYTES = 64 * 1024;
+        static constexpr size_t SHARDS = 16;
+
+        static StringInterner& global() {
+            static StringInterner* interner = new StringInterner(); //leaked on purpose, nodes may be read during static destruction
+            return *interner;
+        }
+
+        //the same id for the same text every time, throws std::length_error past MAX_STRINGS
+        InternedString intern(std::string_view text) {
+            std::optional<InternedString> interned = insert(text);
+            if (!interned) {
+                throw std::length_error("string interner is full");
+            }
+            return *interned;
+        }
+        std::optional<InternedString> find(std::string_view text) const {
+            if (text.empty()) return InternedString();
+            size_t hash = std::hash<std::string_view>{}(text);
+            const Shard& shard = shards[hash % SHARDS];
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto found = shard.ids.find(Key{text, hash});
+            if (found == shard.ids.end()) return std::nullopt;
+            return InternedString(found->second);
+        }
+        std::string_view view(InternedString s) const {
+            if (s.index == 0) return {};
+            const std::string_view* block = blocks[s.index / BLOCK_STRINGS].load(std::memory_order_acquire);
+            return block[s.index % BLOCK_STRINGS];
+        }
+
+        size_t stringCount() const { return nextIndex.load(std::memory_order_relaxed) - 1; }
+        size_t textBytes() const { return storedBytes.load(std::memory_order_relaxed); }
+
+    private:
+        //the hash is computed once and kept with the key, the map compares it before the text
+        struct Key {
+            std::string_view text;
+            size_t hash;
+            bool operator==(const Key& other) const { return hash == other.hash && text == other.text; }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& key) const { return key.hash; }
+        };
+        struct Shard {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<Key, uint32_t, KeyHash> ids;
+            std::vector<std::unique_ptr<char[]>> chunks; //the text, bump allocated from the current chunk
+            char* chunk = nullptr;
+            size_t chunkUsed = TEXT_CHUNK_BYTES;
+        };
+
+        StringInterner() {
+            blocks[0].store(new std::string_view[BLOCK_STRINGS](), std::memory_order_release); //id 0 is the empty string
+            metrics::Registry::instance().valueFunction("palette_interned_strings", "Distinct strings in the interner",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(stringCount()); });
+            metrics::Registry::instance().valueFunction("palette_interned_bytes", "Bytes of text held by the interner",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(textBytes()); });
+        }
+
+        std::optional<InternedString> insert(std::string_view text) {
+            if (text.empty()) return InternedString();
+            size_t hash = std::hash<std::string_view>{}(text);
+            Shard& shard = shards[hash % SHARDS];
+            {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex); //almost every call finds the string already there
+                auto found = shard.ids.find(Key{text, hash});
+                if (found != shard.ids.end()) return InternedString(found->second);
+            }
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto found = shard.ids.find(Key{text, hash});
+            if (found != shard.ids.end()) return InternedString(found->second);
+            uint32_t index = nextIndex.load(std::memory_order_relaxed);
+            do {
+                if (index >= MAX_STRINGS) return std::nullopt;
+            } while (!nextIndex.compare_exchange_weak(index, index + 1, std::memory_order_relaxed));
+            std::string_view stored = copyText(shard, text);
+            blockFor(index)[index % BLOCK_STRINGS] = stored; //written before the id is published through the map
+            shard.ids.emplace(Key{stored, hash}, index);
+            storedBytes.fetch_add(text.size(), std::memory_order_relaxed);
+            return InternedString(index);
+        }
+        //shard lock held
+        std::string_view copyText(Shard& shard, std::string_view text) {
+            char* destination;
+            if (text.size() > TEXT_CHUNK_BYTES / 4) { //long strings get their own allocation instead of wasting a chunk
+                shard.chunks.push_back(std::make_unique<char[]>(text.size()));
+                destination = shard.chunks.back().get();
+            } else {
+                if (shard.chunkUsed + text.size() > TEXT_CHUNK_BYTES) {
+                    shard.chunks.push_back(std::make_unique<char[]>(TEXT_CHUNK_BYTES));
+                    shard.chunk = shard.chunks.back().get();
+                    shard.chunkUsed = 0;
+                }
+                destination = shard.chunk + shard.chunkUsed;
+                shard.chunkUsed += text.size();
+            }
+            std::memcpy(destination, text.data(), text.size());
+            return std::string_view(destination, text.size());
+        }
+        //the block holding index, created by whichever shard needs it first
+        std::string_view* blockFor(uint32_t index) {
+            std::atomic<std::string_view*>& slot = blocks[index / BLOCK_STRINGS];
+            std::string_view* block = slot.load(std::memory_order_acquire);
+            if (block) return block;
+            auto* created = new std::string_view[BLOCK_STRINGS]();
+            if (slot.compare_exchange_strong(block, created, std::memory_order_acq_rel)) {
+                return created;
+            }
+            delete[] created; //another shard got there first
+            return block;
+        }
+
+        std::array<Shard, SHARDS> shards;
+        std::array<std::atomic<std::string_view*>, MAX_BLOCKS> blocks{};
+        std::atomic<uint32_t> nextIndex{1};
+        std::atomic<size_t> storedBytes{0};
+    };
+
+    inline std::string_view InternedString::view() const { return StringInterner::global().view(*this); }
+
+} //end of namespace CoreSystems
+
+namespace std {
+    template <>
+    struct hash<CoreSystems::InternedString> {
+        size_t operator()(CoreSystems::InternedString s) const noexcept { return std::hash<uint32_t>{}(s.id()); }
+    };
+}
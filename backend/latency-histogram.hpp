@@ -0,0 +1,221 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include "json.hpp"
+//log-linear latency histograms (same idea as HdrHistogram) for tail latency reporting
+//summary:
+//LatencyHistogram counts microsecond values into buckets that double in width every 8 buckets (about 6% error)
+//recording is a couple of relaxed atomic adds, so any thread can record without locks
+//WindowedLatencyHistogram keeps time-sliced histograms so percentiles can be reported over the last 1m, 5m and 1h
+
+namespace CoreSystems {
+
+    //plain copy of a histogram's counters, used for merging windows and computing percentiles
+    struct HistogramSnapshot {
+        static constexpr int SUB_BUCKET_BITS = 3;
+        static constexpr uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS; //8 buckets per power of two
+        static constexpr uint64_t MAX_VALUE = (1ULL << 36) - 1; //~19 hours in microseconds, larger values are clamped
+        static constexpr size_t BUCKET_COUNT = (36 - SUB_BUCKET_BITS) * SUB_BUCKETS + SUB_BUCKETS; //272
+
+        std::array<uint64_t, BUCKET_COUNT> counts{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+
+        //values below 16 get their own bucket, above that each power of two is split into 8 equal buckets
+        static size_t bucketIndex(uint64_t value) {
+            value = std::min(value, MAX_VALUE);
+            if (value < 2 * SUB_BUCKETS) {
+                return static_cast<size_t>(value);
+            }
+            int msb = 63 - __builtin_clzll(value);
+            int shift = msb - SUB_BUCKET_BITS;
+            return static_cast<size_t>(shift) * SUB_BUCKETS + static_cast<size_t>(value >> shift);
+        }
+        static uint64_t bucketLowerBound(size_t index) {
+            if (index < 2 * SUB_BUCKETS) {
+                return index;
+            }
+            uint64_t shift = index / SUB_BUCKETS - 1;
+            uint64_t subBucket = index - shift * SUB_BUCKETS;
+            return subBucket << shift;
+        }
+        static uint64_t bucketUpperBound(size_t index) {
+            if (index < 2 * SUB_BUCKETS) {
+                return index;
+            }
+            uint64_t shift = index / SUB_BUCKETS - 1;
+            return bucketLowerBound(index) + (1ULL << shift) - 1;
+        }
+
+        void merge(const HistogramSnapshot& other) {
+            for (size_t i = 0; i < BUCKET_COUNT; i++) {
+                counts[i] += other.counts[i];
+            }
+            count += other.count;
+            sum += other.sum;
+            max = std::max(max, other.max);
+        }
+        //value at quantile q (0.0 - 1.0), reported as the middle of its bucket but never above the recorded max
+        uint64_t valueAtQuantile(double q) const {
+            if (count == 0) return 0;
+            uint64_t target = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+            target = std::clamp<uint64_t>(target, 1, count);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKET_COUNT; i++) {
+                seen += counts[i];
+                if (seen >= target) {
+                    uint64_t middle = bucketLowerBound(i) + (bucketUpperBound(i) - bucketLowerBound(i)) / 2;
+                    return std::min(middle, max);
+                }
+            }
+            return max;
+        }
+        double mean() const {
+            return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+        }
+        //percentiles in milliseconds for the reports
+        nlohmann::json toJson() const {
+            auto ms = [](uint64_t us) { return static_cast<double>(us) / 1000.0; };
+            return nlohmann::json{
+                {"count", count},
+                {"mean_ms", mean() / 1000.0},
+                {"p50_ms", ms(valueAtQuantile(0.50))},
+                {"p90_ms", ms(valueAtQuantile(0.90))},
+                {"p99_ms", ms(valueAtQuantile(0.99))},
+                {"p99_9_ms", ms(valueAtQuantile(0.999))},
+                {"max_ms", ms(max)}
+            };
+        }
+    };
+
+    class LatencyHistogram {
+    public:
+        void record(uint64_t valueUs) {
+            counts[HistogramSnapshot::bucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(valueUs, std::memory_order_relaxed);
+            uint64_t currentMax = max.load(std::memory_order_relaxed);
+            while (valueUs > currentMax && !max.compare_exchange_weak(currentMax, valueUs, std::memory_order_relaxed)) {
+                //another thread raised max first, currentMax was reloaded by compare_exchange
+            }
+        }
+        void reset() {
+            for (auto& bucket : counts) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            count.store(0, std::memory_order_relaxed);
+            sum.store(0, std::memory_order_relaxed);
+            max.store(0, std::memory_order_relaxed);
+        }
+        //adds this histogram's counters into out, can run while other threads are recording
+        void addTo(HistogramSnapshot& out) const {
+            uint64_t bucketTotal = 0;
+            for (size_t i = 0; i < HistogramSnapshot::BUCKET_COUNT; i++) {
+                uint64_t c = counts[i].load(std::memory_order_relaxed);
+                out.counts[i] += c;
+                bucketTotal += c;
+            }
+            //count comes from the buckets so percentiles stay consistent with what was copied
+            out.count += bucketTotal;
+            out.sum += sum.load(std::memory_order_relaxed);
+            out.max = std::max(out.max, max.load(std::memory_order_relaxed));
+        }
+        HistogramSnapshot snapshot() const {
+            HistogramSnapshot out;
+            addTo(out);
+            return out;
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, HistogramSnapshot::BUCKET_COUNT> counts{};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    //latency histogram over sliding windows
+    //samples go into the current 10 second slice (for the 1m window) and the current 1 minute slice (for 5m and 1h)
+    //slices are reused round robin, the first recorder to see a stale slice claims and clears it
+    //a sample recorded by another thread at that exact moment can be lost, which is fine for reporting
+    class WindowedLatencyHistogram {
+    public:
+        WindowedLatencyHistogram()
+            : fineSlices(std::make_unique<Slice[]>(FINE_SLICES)),
+              coarseSlices(std::make_unique<Slice[]>(COARSE_SLICES)) {}
+
+        void record(uint64_t valueUs) {
+            int64_t nowSeconds = secondsNow();
+            sliceFor(fineSlices.get(), FINE_SLICES, nowSeconds / FINE_WIDTH_SECONDS).record(valueUs);
+            sliceFor(coarseSlices.get(), COARSE_SLICES, nowSeconds / COARSE_WIDTH_SECONDS).record(valueUs);
+            allTime.record(valueUs);
+        }
+        void record(std::chrono::nanoseconds duration) {
+            record(static_cast<uint64_t>(std::max<int64_t>(0, duration.count() / 1000)));
+        }
+
+        //merged histogram for the last `window` (rounded to whole slices, the current partial slice included)
+        HistogramSnapshot window(std::chrono::seconds window) const {
+            HistogramSnapshot out;
+            int64_t nowSeconds = secondsNow();
+            bool fine = window.count() <= FINE_WIDTH_SECONDS * static_cast<int64_t>(FINE_SLICES - 1);
+            const Slice* slices = fine ? fineSlices.get() : coarseSlices.get();
+            size_t sliceCount = fine ? FINE_SLICES : COARSE_SLICES;
+            int64_t width = fine ? FINE_WIDTH_SECONDS : COARSE_WIDTH_SECONDS;
+            int64_t currentEpoch = nowSeconds / width;
+            int64_t slicesWanted = std::max<int64_t>(1, window.count() / width);
+            for (size_t i = 0; i < sliceCount; i++) {
+                int64_t epoch = slices[i].epoch.load(std::memory_order_acquire);
+                if (epoch > currentEpoch - slicesWanted && epoch <= currentEpoch) {
+                    slices[i].histogram.addTo(out);
+                }
+            }
+            return out;
+        }
+        HistogramSnapshot total() const { return allTime.snapshot(); }
+
+        nlohmann::json toJson() const {
+            return nlohmann::json{
+                {"1m", window(std::chrono::minutes(1)).toJson()},
+                {"5m", window(std::chrono::minutes(5)).toJson()},
+                {"1h", window(std::chrono::hours(1)).toJson()},
+                {"all", total().toJson()}
+            };
+        }
+
+    private:
+        struct Slice {
+            std::atomic<int64_t> epoch{-1}; //which time slice the counts belong to
+            LatencyHistogram histogram;
+            void record(uint64_t valueUs) { histogram.record(valueUs); }
+        };
+        static constexpr int64_t FINE_WIDTH_SECONDS = 10;
+        static constexpr size_t FINE_SLICES = 7; //6 slices for the 1m window + the one being rotated in
+        static constexpr int64_t COARSE_WIDTH_SECONDS = 60;
+        static constexpr size_t COARSE_SLICES = 61; //60 slices for the 1h window + the one being rotated in
+
+        std::unique_ptr<Slice[]> fineSlices;
+        std::unique_ptr<Slice[]> coarseSlices;
+        LatencyHistogram allTime;
+
+        static int64_t secondsNow() {
+            return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+        static Slice& sliceFor(Slice* slices, size_t sliceCount, int64_t epoch) {
+            Slice& slice = slices[static_cast<size_t>(epoch) % sliceCount];
+            int64_t seen = slice.epoch.load(std::memory_order_acquire);
+            if (seen != epoch && seen < epoch) {
+                if (slice.epoch.compare_exchange_strong(seen, epoch, std::memory_order_acq_rel)) {
+                    slice.histogram.reset(); //this thread rotated the slice, clear out the old counts
+                }
+            }
+            return slice;
+        }
+    };
+
+} //end of namespace CoreSystems
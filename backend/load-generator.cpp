@@ -0,0 +1,390 @@
+//end to end load generator for the /graphql endpoint
+//summary:
+//open loop (--mode open): requests are scheduled at a fixed arrival rate (or poisson arrivals) whether or not earlier ones finished,
+//  latency is measured from the scheduled send time, so a stalled server can't hide its queueing (coordinated omission)
+//closed loop (--mode closed): --concurrency workers each send, wait for the answer, think, repeat
+//  the corrected histogram back-fills the requests a stalled worker didn't send (HdrHistogram's expected interval correction)
+//query mix: --health-ratio of requests are system_health, the rest search_concepts
+//  --cache-hit-ratio of searches pick from a warm set of --distinct queries (zipfian popularity, --zipf exponent),
+//  the rest are never-repeated queries that must miss every cache
+//the report has throughput, status counts and both the service time and the corrected response time percentiles,
+//--json writes the same plus every non-empty histogram bucket for comparing runs
+//
+//usage: load-generator [--url http://localhost:8080] [--mode open|closed] [--rate 100] [--poisson] [--connections 64]
+//                      [--concurrency 16] [--think-ms 0] [--duration 30] [--distinct 1000] [--zipf 1.0] [--cache-hit-ratio 0.8]
+//                      [--health-ratio 0.05] [--timeout-ms 3000] [--seed backend/mock-upstream-seed.json] [--no-prewarm]
+//                      [--expected-interval-ms 0] [--json results.json]
+//run it against the server with WEAVIATE_URL/PINTEREST_API_URL pointing at mock-upstream to benchmark without live services
+#include "httplib.h"
+#include "json.hpp"
+#include "latency-histogram.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace LoadGenerator {
+
+    using CoreSystems::HistogramSnapshot;
+    using CoreSystems::LatencyHistogram;
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string url = "http://localhost:8080";
+        std::string mode = "open";
+        double rate = 100.0; //requests per second (open loop)
+        bool poisson = false;
+        int connections = 64; //open loop workers, the most requests that can be outstanding at once
+        int concurrency = 16; //closed loop workers
+        double thinkMs = 0.0;
+        double durationSeconds = 30.0;
+        size_t distinct = 1000; //warm query set
+        double zipf = 1.0; //0 = uniform popularity
+        double cacheHitRatio = 0.8;
+        double healthRatio = 0.05;
+        int timeoutMs = 3000; //sent as the search's timeout_ms
+        std::string seedPath = "backend/mock-upstream-seed.json";
+        bool prewarm = true;
+        double expectedIntervalMs = 0.0; //closed loop correction, 0 = mean latency of the prewarm requests
+        std::string jsonPath;
+        uint64_t randomSeed = 1;
+    };
+
+    //rank sampler for zipfian popularity, rank 0 is the most popular query
+    class ZipfSampler {
+    public:
+        ZipfSampler(size_t count, double exponent) : cdf(std::max<size_t>(count, 1)) {
+            double total = 0.0;
+            for (size_t rank = 0; rank < cdf.size(); rank++) {
+                total += 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+                cdf[rank] = total;
+            }
+            for (auto& value : cdf) {
+                value /= total;
+            }
+        }
+        size_t sample(std::mt19937_64& rng) const {
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+            return static_cast<size_t>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+        }
+    private:
+        std::vector<double> cdf;
+    };
+
+    class QueryMix {
+    public:
+        QueryMix(const Options& options) : options(options), popularity(options.distinct, options.zipf) {
+            //warm set: the seed file's concept names first (they match concepts exactly), then synthetic ones
+            std::ifstream file(options.seedPath);
+            if (file) {
+                try {
+                    nlohmann::json seedFile;
+                    file >> seedFile;
+                    for (const auto& item : seedFile.value("concepts", nlohmann::json::array())) {
+                        if (warmQueries.size() < options.distinct) warmQueries.push_back(item.value("name", ""));
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "ignoring seed file " << options.seedPath << ": " << e.what() << std::endl;
+                }
+            }
+            for (size_t i = 0; warmQueries.size() < options.distinct; i++) {
+                warmQueries.push_back("concept-" + std::to_string(i));
+            }
+            runId = std::to_string(std::chrono::system_clock::now().time_since_epoch().count() % 1000000007);
+        }
+
+        //graphql request body for the next request
+        std::string next(std::mt19937_64& rng) {
+            std::uniform_real_distribution<double> unit(0.0, 1.0);
+            if (unit(rng) < options.healthRatio) {
+                return R"({"query":"query { system_health }"})";
+            }
+            std::string query = unit(rng) < options.cacheHitRatio
+                ? warmQueries[popularity.sample(rng)]
+                : "cold " + runId + " " + std::to_string(coldCounter.fetch_add(1, std::memory_order_relaxed)); //never asked before
+            return searchBody(query);
+        }
+        std::string searchBody(const std::string& query) const {
+            nlohmann::json body = {
+                {"query", "query { search_concepts }"},
+                {"variables", {{"query", query}, {"limit", 10}, {"timeout_ms", options.timeoutMs}}}
+            };
+            return body.dump();
+        }
+        const std::vector<std::string>& warmSet() const { return warmQueries; }
+
+    private:
+        const Options& options;
+        ZipfSampler popularity;
+        std::vector<std::string> warmQueries;
+        std::string runId;
+        std::atomic<uint64_t> coldCounter{0};
+    };
+
+    struct Results {
+        LatencyHistogram serviceTime; //from the moment the request was actually sent
+        LatencyHistogram responseTime; //corrected for coordinated omission
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> ok{0};
+        std::atomic<uint64_t> shed{0}; //503 from admission control
+        std::atomic<uint64_t> httpErrors{0};
+        std::atomic<uint64_t> transportErrors{0};
+        std::atomic<uint64_t> graphqlErrors{0};
+        std::atomic<uint64_t> partial{0};
+        std::atomic<uint64_t> maxScheduleLagUs{0}; //open loop: how late the worst request left, > 0 means too few connections
+
+        void classify(const httplib::Result& result) {
+            completed.fetch_add(1, std::memory_order_relaxed);
+            if (!result) {
+                transportErrors.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (result->status == 503) {
+                shed.fetch_add(1, std::memory_order_relaxed);
+            } else if (result->status != 200) {
+                httpErrors.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                ok.fetch_add(1, std::memory_order_relaxed);
+                //a string search is enough here, parsing every response would make the generator the bottleneck
+                if (result->body.find("\"errors\"") != std::string::npos) graphqlErrors.fetch_add(1, std::memory_order_relaxed);
+                if (result->body.find("\"partial\":true") != std::string::npos) partial.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    inline uint64_t microsBetween(Clock::time_point from, Clock::time_point to) {
+        return static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(to - from).count()));
+    }
+
+    inline std::unique_ptr<httplib::Client> makeClient(const Options& options) {
+        auto client = std::make_unique<httplib::Client>(options.url);
+        client->set_keep_alive(true);
+        client->set_tcp_nodelay(true); //otherwise nagle + delayed acks add ~40ms to every keep-alive post
+        client->set_connection_timeout(5, 0);
+        client->set_read_timeout(std::max(10, options.timeoutMs / 1000 * 4), 0);
+        return client;
+    }
+
+    //sends every warm query once so cache-hit requests really hit, returns the mean latency in microseconds
+    inline double prewarm(const Options& options, QueryMix& mix) {
+        const auto& queries = mix.warmSet();
+        std::atomic<size_t> nextQuery{0};
+        std::atomic<uint64_t> totalUs{0};
+        std::vector<std::thread> workers;
+        int threads = std::max(1, std::min(options.connections, 32));
+        for (int w = 0; w < threads; w++) {
+            workers.emplace_back([&]() {
+                auto client = makeClient(options);
+                for (size_t i = nextQuery.fetch_add(1); i < queries.size(); i = nextQuery.fetch_add(1)) {
+                    auto sent = Clock::now();
+                    client->Post("/graphql", mix.searchBody(queries[i]), "application/json");
+                    totalUs.fetch_add(microsBetween(sent, Clock::now()));
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        return queries.empty() ? 0.0 : static_cast<double>(totalUs.load()) / static_cast<double>(queries.size());
+    }
+
+    inline void runOpenLoop(const Options& options, QueryMix& mix, Results& results) {
+        //arrival times are fixed up front, workers claim the next slot and send at its time (or as soon as they're free)
+        std::mt19937_64 arrivalRng(options.randomSeed);
+        std::vector<std::chrono::nanoseconds> arrivals;
+        double intervalNs = 1e9 / options.rate;
+        std::exponential_distribution<double> gaps(1.0);
+        double at = 0.0;
+        while (at < options.durationSeconds * 1e9) {
+            arrivals.emplace_back(static_cast<int64_t>(at));
+            at += options.poisson ? gaps(arrivalRng) * intervalNs : intervalNs;
+        }
+        std::atomic<size_t> nextSlot{0};
+        auto start = Clock::now();
+        std::vector<std::thread> workers;
+        for (int w = 0; w < options.connections; w++) {
+            workers.emplace_back([&, w]() {
+                auto client = makeClient(options);
+                std::mt19937_64 rng(options.randomSeed * 7919 + static_cast<uint64_t>(w));
+                for (size_t slot = nextSlot.fetch_add(1); slot < arrivals.size(); slot = nextSlot.fetch_add(1)) {
+                    auto intended = start + arrivals[slot];
+                    std::this_thread::sleep_until(intended);
+                    std::string body = mix.next(rng);
+                    auto sent = Clock::now();
+                    uint64_t lag = microsBetween(intended, sent);
+                    uint64_t seenLag = results.maxScheduleLagUs.load(std::memory_order_relaxed);
+                    while (lag > seenLag && !results.maxScheduleLagUs.compare_exchange_weak(seenLag, lag, std::memory_order_relaxed)) {}
+                    auto result = client->Post("/graphql", body, "application/json");
+                    auto done = Clock::now();
+                    results.serviceTime.record(microsBetween(sent, done));
+                    results.responseTime.record(microsBetween(intended, done)); //includes time spent waiting for a free worker
+                    results.classify(result);
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+    }
+
+    inline void runClosedLoop(const Options& options, QueryMix& mix, Results& results, uint64_t expectedIntervalUs) {
+        auto end = Clock::now() + std::chrono::microseconds(static_cast<int64_t>(options.durationSeconds * 1e6));
+        std::vector<std::thread> workers;
+        for (int w = 0; w < options.concurrency; w++) {
+            workers.emplace_back([&, w]() {
+                auto client = makeClient(options);
+                std::mt19937_64 rng(options.randomSeed * 7919 + static_cast<uint64_t>(w));
+                while (Clock::now() < end) {
+                    std::string body = mix.next(rng);
+                    auto sent = Clock::now();
+                    auto result = client->Post("/graphql", body, "application/json");
+                    uint64_t latencyUs = microsBetween(sent, Clock::now());
+                    results.serviceTime.record(latencyUs);
+                    results.responseTime.record(latencyUs);
+                    //a request that took k expected intervals stood for k-1 requests this worker would have sent meanwhile
+                    if (expectedIntervalUs > 0) {
+                        for (uint64_t missing = latencyUs > expectedIntervalUs ? latencyUs - expectedIntervalUs : 0;
+                             missing >= expectedIntervalUs; missing -= expectedIntervalUs) {
+                            results.responseTime.record(missing);
+                        }
+                    }
+                    results.classify(result);
+                    if (options.thinkMs > 0.0) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(options.thinkMs * 1000.0)));
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+    }
+
+    inline nlohmann::json percentiles(const HistogramSnapshot& snapshot) {
+        nlohmann::json out = snapshot.toJson();
+        out["p99_99_ms"] = static_cast<double>(snapshot.valueAtQuantile(0.9999)) / 1000.0;
+        return out;
+    }
+    inline nlohmann::json buckets(const HistogramSnapshot& snapshot) {
+        nlohmann::json out = nlohmann::json::array();
+        for (size_t i = 0; i < HistogramSnapshot::BUCKET_COUNT; i++) {
+            if (snapshot.counts[i] > 0) {
+                out.push_back({{"upper_us", HistogramSnapshot::bucketUpperBound(i)}, {"count", snapshot.counts[i]}});
+            }
+        }
+        return out;
+    }
+
+    inline bool parseArgs(int argc, char* argv[], Options& options) {
+        for (int i = 1; i < argc; i++) {
+            std::string flag = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::runtime_error("missing value for " + flag);
+                return argv[++i];
+            };
+            if (flag == "--url") options.url = value();
+            else if (flag == "--mode") options.mode = value();
+            else if (flag == "--rate") options.rate = std::stod(value());
+            else if (flag == "--poisson") options.poisson = true;
+            else if (flag == "--connections") options.connections = std::stoi(value());
+            else if (flag == "--concurrency") options.concurrency = std::stoi(value());
+            else if (flag == "--think-ms") options.thinkMs = std::stod(value());
+            else if (flag == "--duration") options.durationSeconds = std::stod(value());
+            else if (flag == "--distinct") options.distinct = std::stoul(value());
+            else if (flag == "--zipf") options.zipf = std::stod(value());
+            else if (flag == "--cache-hit-ratio") options.cacheHitRatio = std::stod(value());
+            else if (flag == "--health-ratio") options.healthRatio = std::stod(value());
+            else if (flag == "--timeout-ms") options.timeoutMs = std::stoi(value());
+            else if (flag == "--seed") options.seedPath = value();
+            else if (flag == "--no-prewarm") options.prewarm = false;
+            else if (flag == "--expected-interval-ms") options.expectedIntervalMs = std::stod(value());
+            else if (flag == "--json") options.jsonPath = value();
+            else if (flag == "--random-seed") options.randomSeed = std::stoull(value());
+            else {
+                std::cerr << "unknown flag " << flag << std::endl;
+                return false;
+            }
+        }
+        if (options.mode != "open" && options.mode != "closed") {
+            std::cerr << "--mode must be open or closed" << std::endl;
+            return false;
+        }
+        if (options.rate <= 0.0 || options.connections < 1 || options.concurrency < 1 || options.durationSeconds <= 0.0) {
+            std::cerr << "--rate, --connections, --concurrency and --duration must be positive" << std::endl;
+            return false;
+        }
+        options.distinct = std::max<size_t>(1, options.distinct);
+        return true;
+    }
+
+} //end of namespace LoadGenerator
+
+int main(int argc, char* argv[]) {
+    using namespace LoadGenerator;
+    Options options;
+    try {
+        if (!parseArgs(argc, argv, options)) return 1;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    QueryMix mix(options);
+    double prewarmMeanUs = 0.0;
+    if (options.prewarm && options.cacheHitRatio > 0.0) {
+        std::cout << "prewarming " << mix.warmSet().size() << " queries..." << std::endl;
+        prewarmMeanUs = prewarm(options, mix);
+    }
+
+    Results results;
+    uint64_t expectedIntervalUs = 0;
+    auto start = Clock::now();
+    if (options.mode == "open") {
+        std::cout << "open loop: " << options.rate << " req/s" << (options.poisson ? " (poisson)" : "")
+                  << " for " << options.durationSeconds << "s over " << options.connections << " connections" << std::endl;
+        runOpenLoop(options, mix, results);
+    } else {
+        expectedIntervalUs = static_cast<uint64_t>(options.expectedIntervalMs > 0.0 ? options.expectedIntervalMs * 1000.0 : prewarmMeanUs);
+        std::cout << "closed loop: " << options.concurrency << " workers for " << options.durationSeconds << "s"
+                  << ", expected interval " << expectedIntervalUs / 1000.0 << "ms" << std::endl;
+        runClosedLoop(options, mix, results, expectedIntervalUs);
+    }
+    double elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    HistogramSnapshot service = results.serviceTime.snapshot();
+    HistogramSnapshot response = results.responseTime.snapshot();
+    nlohmann::json report = {
+        {"options", {
+            {"url", options.url}, {"mode", options.mode}, {"rate", options.rate}, {"poisson", options.poisson},
+            {"connections", options.connections}, {"concurrency", options.concurrency}, {"think_ms", options.thinkMs},
+            {"duration_s", options.durationSeconds}, {"distinct", options.distinct}, {"zipf", options.zipf},
+            {"cache_hit_ratio", options.cacheHitRatio}, {"health_ratio", options.healthRatio}, {"timeout_ms", options.timeoutMs},
+            {"expected_interval_ms", expectedIntervalUs / 1000.0}
+        }},
+        {"elapsed_s", elapsedSeconds},
+        {"throughput_rps", static_cast<double>(results.completed.load()) / elapsedSeconds},
+        {"requests", {
+            {"completed", results.completed.load()}, {"ok", results.ok.load()}, {"shed_503", results.shed.load()},
+            {"http_errors", results.httpErrors.load()}, {"transport_errors", results.transportErrors.load()},
+            {"graphql_errors", results.graphqlErrors.load()}, {"partial", results.partial.load()}
+        }},
+        {"max_schedule_lag_ms", results.maxScheduleLagUs.load() / 1000.0},
+        {"service_time", percentiles(service)},
+        {"response_time_corrected", percentiles(response)}
+    };
+    std::cout << report.dump(2) << std::endl;
+    if (options.mode == "open" && results.maxScheduleLagUs.load() > 100000) {
+        std::cout << "note: requests left up to " << results.maxScheduleLagUs.load() / 1000 << "ms late, "
+                  << "the corrected percentiles include that wait (raise --connections if the server wasn't the bottleneck)" << std::endl;
+    }
+    if (!options.jsonPath.empty()) {
+        report["service_time"]["buckets"] = buckets(service);
+        report["response_time_corrected"]["buckets"] = buckets(response);
+        std::ofstream out(options.jsonPath);
+        out << report.dump(2) << std::endl;
+        std::cout << "wrote " << options.jsonPath << std::endl;
+    }
+    return results.completed.load() > 0 ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+//lock-free containers shared by the telemetry pipeline
+//summary:
+//SeqlockRing is a fixed-capacity history written by one thread and read by any number of threads without blocking either side
+//BoundedMpscQueue hands records from many producer threads to one consumer, dropping (and counting) when full
+//OwnedSlotPool recycles per-thread buffers (span rings, log rings) between threads without a lock on either side
+
+namespace CoreSystems {
+namespace lockfree {
+
+    //fixed-capacity ring where one writer overwrites the oldest entry and readers take consistent snapshots
+    //each slot has its own sequence number (seqlock): odd while it's being written, 2*(index+1) once record #index is in it
+    //a reader copies the slot and checks the sequence didn't move, so a torn or overwritten slot is skipped instead of waited on
+    //the payload is kept in relaxed atomic words so the concurrent copy is well defined, which is why T must be trivially copyable
+    template <typename T, size_t Capacity>
+    class SeqlockRing {
+        static_assert(std::is_trivially_copyable_v<T>, "SeqlockRing stores raw bytes, T must be trivially copyable");
+        static_assert(Capacity > 0, "SeqlockRing needs at least one slot");
+    public:
+        SeqlockRing() : slots(std::make_unique<Slot[]>(Capacity)) {}
+
+        //only one thread may call push
+        void push(const T& value) {
+            uint64_t index = written.load(std::memory_order_relaxed);
+            Slot& slot = slots[index % Capacity];
+            slot.sequence.store(2 * index + 1, std::memory_order_relaxed); //odd = write in progress
+            std::atomic_thread_fence(std::memory_order_release);
+
+            uint64_t buffer[WORDS] = {};
+            std::memcpy(buffer, &value, sizeof(T));
+            for (size_t i = 0; i < WORDS; i++) {
+                slot.words[i].store(buffer[i], std::memory_order_relaxed);
+            }
+            slot.sequence.store(2 * (index + 1), std::memory_order_release);
+            written.store(index + 1, std::memory_order_release);
+        }
+
+        //copies up to maxRecords of the newest entries into out, oldest first
+        //safe from any thread, never blocks the writer (entries overwritten mid-copy are left out)
+        size_t snapshot(std::vector<T>& out, size_t maxRecords = Capacity) const {
+            uint64_t end = written.load(std::memory_order_acquire);
+            uint64_t count = std::min<uint64_t>({end, Capacity, maxRecords});
+            size_t copied = 0;
+            out.reserve(out.size() + count);
+            for (uint64_t index = end - count; index < end; index++) {
+                T value;
+                if (read(index, value)) {
+                    out.push_back(value);
+                    copied++;
+                }
+            }
+            return copied;
+        }
+
+        size_t size() const { return static_cast<size_t>(std::min<uint64_t>(written.load(std::memory_order_acquire), Capacity)); }
+        uint64_t totalWritten() const { return written.load(std::memory_order_acquire); }
+        static constexpr size_t capacity() { return Capacity; }
+
+    private:
+        static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        struct Slot {
+            std::atomic<uint64_t> sequence{0};
+            std::array<std::atomic<uint64_t>, WORDS> words{};
+        };
+
+        bool read(uint64_t index, T& value) const {
+            const Slot& slot = slots[index % Capacity];
+            uint64_t expected = 2 * (index + 1);
+            if (slot.sequence.load(std::memory_order_acquire) != expected) {
+                return false; //being written or already replaced by a newer record
+            }
+            uint64_t buffer[WORDS];
+            for (size_t i = 0; i < WORDS; i++) {
+                buffer[i] = slot.words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != expected) {
+                return false; //writer came back around while we were copying
+            }
+            std::memcpy(&value, buffer, sizeof(T));
+            return true;
+        }
+
+        std::unique_ptr<Slot[]> slots;
+        alignas(64) std::atomic<uint64_t> written{0}; //number of records ever pushed
+    };
+
+    //bounded multi-producer/single-consumer queue (Vyukov's array queue with a single consumer)
+    //producers claim a cell with one CAS on enqueuePos and publish it through the cell's sequence number
+    //when the queue is full tryPush gives up immediately and counts the drop, so producers never wait on the consumer
+    template <typename T>
+    class BoundedMpscQueue {
+    public:
+        explicit BoundedMpscQueue(size_t requestedCapacity) {
+            size_t capacity = 2;
+            while (capacity < requestedCapacity) capacity <<= 1; //power of two so positions wrap with a mask
+            mask = capacity - 1;
+            cells = std::make_unique<Cell[]>(capacity);
+            for (size_t i = 0; i < capacity; i++) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        //safe from any number of threads, returns false (and counts it) if the queue is full
+        bool tryPush(T value) {
+            size_t position = enqueuePos.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true) {
+                cell = &cells[position & mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0) { //cell is free for this position, try to claim it
+                    if (enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (difference < 0) { //consumer hasn't freed this cell yet, queue is full
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else { //another producer claimed it first
+                    position = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->value = std::move(value);
+            cell->sequence.store(position + 1, std::memory_order_release); //publishes the value to the consumer
+            return true;
+        }
+
+        //moves up to maxItems into out, only the single consumer thread may call this
+        template <typename OutputIt>
+        size_t popBatch(OutputIt out, size_t maxItems) {
+            size_t position = dequeuePos.load(std::memory_order_relaxed);
+            size_t popped = 0;
+            while (popped < maxItems) {
+                Cell& cell = cells[position & mask];
+                if (cell.sequence.load(std::memory_order_acquire) != position + 1) {
+                    break; //empty, or the producer that claimed this cell hasn't finished writing it
+                }
+                *out++ = std::move(cell.value);
+                cell.sequence.store(position + mask + 1, std::memory_order_release); //frees the cell for the next lap
+                position++;
+                popped++;
+            }
+            dequeuePos.store(position, std::memory_order_relaxed);
+            return popped;
+        }
+
+        size_t approximateSize() const {
+            size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+            size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+        size_t capacity() const { return mask + 1; }
+        uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence{0};
+            T value{};
+        };
+        std::unique_ptr<Cell[]> cells;
+        size_t mask = 0;
+        alignas(64) std::atomic<size_t> enqueuePos{0}; //shared by producers
+        alignas(64) std::atomic<size_t> dequeuePos{0}; //only written by the consumer, atomic so approximateSize can read it
+        alignas(64) std::atomic<uint64_t> dropped{0};
+    };
+
+    //fixed array of lazily created objects, each owned by at most one thread at a time
+    //a thread claims a free one with one CAS (creating a new one if none is free) and gives it back with a store,
+    //so short-lived threads reuse what exited threads left behind instead of allocating, and nothing takes a lock
+    //any thread can walk the created objects at any time, objects are never freed while the pool lives
+    //ownership hands over with acquire/release ordering, so the next owner sees everything the last one wrote
+    template <typename T, size_t MaxSlots>
+    class OwnedSlotPool {
+    public:
+        static constexpr size_t NONE = MaxSlots; //what acquire() returns when every slot is owned
+
+        OwnedSlotPool() : slots(std::make_unique<Slot[]>(MaxSlots)) {}
+        ~OwnedSlotPool() {
+            for (size_t slot = 0; slot < created(); slot++) delete slots[slot].object.load(std::memory_order_relaxed);
+        }
+        OwnedSlotPool(const OwnedSlotPool&) = delete;
+        OwnedSlotPool& operator=(const OwnedSlotPool&) = delete;
+
+        //a slot the calling thread now owns, args construct its object if a new one is needed, NONE if the pool is full
+        template <typename... Args>
+        size_t acquire(Args&&... args) {
+            size_t existing = createdCount.load(std::memory_order_acquire);
+            for (size_t slot = 0; slot < existing; slot++) {
+                //a slot without an object is still being set up by its creator, which already owns it
+                if (!slots[slot].object.load(std::memory_order_acquire)) continue;
+                bool expected = false;
+                if (!slots[slot].owned.load(std::memory_order_relaxed) &&
+                    slots[slot].owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    return slot;
+                }
+            }
+            size_t slot = createdCount.load(std::memory_order_relaxed);
+            do {
+                if (slot >= MaxSlots) return NONE;
+            } while (!createdCount.compare_exchange_weak(slot, slot + 1, std::memory_order_acq_rel));
+            slots[slot].owned.store(true, std::memory_order_relaxed);
+            //publishes owned too, acquire() reads the object before trying to claim the slot
+            slots[slot].object.store(new T(std::forward<Args>(args)...), std::memory_order_release);
+            return slot;
+        }
+        void release(size_t slot) { slots[slot].owned.store(false, std::memory_order_release); }
+        T* get(size_t slot) const { return slots[slot].object.load(std::memory_order_acquire); }
+
+        //calls f on every created object, owned or not
+        template <typename F>
+        void forEach(F&& f) const {
+            size_t existing = createdCount.load(std::memory_order_acquire);
+            for (size_t slot = 0; slot < existing; slot++) {
+                if (T* object = get(slot)) f(*object);
+            }
+        }
+        size_t created() const { return createdCount.load(std::memory_order_acquire); }
+
+    private:
+        struct Slot {
+            std::atomic<T*> object{nullptr}; //set once
+            std::atomic<bool> owned{false};
+        };
+        std::unique_ptr<Slot[]> slots;
+        std::atomic<size_t> createdCount{0};
+    };
+
+} //end of namespace lockfree
+} //end of namespace CoreSystems
@@ -0,0 +1,351 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include "json.hpp"
+#include "lock-free.hpp"
+//asynchronous logger so request threads never wait on the stdout lock
+//summary:
+//each thread that logs owns a ring buffer while it lives (one writer: that thread, one reader: the background writer)
+//rings of exited threads are handed to the next new thread, so the short-lived pinterest threads that log on failures
+//neither allocate a ring nor take a lock, if every ring is owned lines go through one shared MPSC queue instead
+//pushing a line is a couple of atomic operations, it never blocks and drops the line if the ring is full
+//a background thread drains every ring, sorts the lines by time and writes them out with one flush per batch
+//
+//levels are filtered twice:
+//  compile time - anything below PALETTE_LOG_COMPILE_LEVEL is compiled out (release builds drop DEBUG and TRACE)
+//  runtime - Logger::setLevel() or the PALETTE_LOG_LEVEL env variable (trace, debug, info, warn, error, off)
+//PALETTE_LOG_FORMAT=json switches the output to one json object per line
+
+//0=TRACE 1=DEBUG 2=INFO 3=WARN 4=ERROR
+#ifndef PALETTE_LOG_COMPILE_LEVEL
+    #ifdef NDEBUG
+        #define PALETTE_LOG_COMPILE_LEVEL 2
+    #else
+        #define PALETTE_LOG_COMPILE_LEVEL 0
+    #endif
+#endif
+
+namespace CoreSystems {
+namespace logging {
+
+    enum class LogLevel : int {
+        //mixed case on purpose, windows.h defines ERROR as a macro
+        Trace = 0,  // raw payload dumps
+        Debug = 1,  // per-request detail
+        Info = 2,   // lifecycle events
+        Warn = 3,
+        Error = 4,
+        Off = 5
+    };
+    inline const char* logLevelToString(LogLevel level) {
+        switch (level) {
+            case LogLevel::Trace: return "TRACE";
+            case LogLevel::Debug: return "DEBUG";
+            case LogLevel::Info: return "INFO";
+            case LogLevel::Warn: return "WARN";
+            case LogLevel::Error: return "ERROR";
+            default: return "OFF";
+        }
+    }
+    inline LogLevel logLevelFromString(std::string name, LogLevel fallback) {
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (name == "trace") return LogLevel::Trace;
+        if (name == "debug") return LogLevel::Debug;
+        if (name == "info") return LogLevel::Info;
+        if (name == "warn" || name == "warning") return LogLevel::Warn;
+        if (name == "error") return LogLevel::Error;
+        if (name == "off") return LogLevel::Off;
+        return fallback;
+    }
+
+    struct LogEntry {
+        uint64_t timestampNs = 0; //wall clock, nanoseconds since epoch
+        uint32_t threadIndex = 0; //small per-thread number, easier to read than std::thread::id
+        LogLevel level = LogLevel::Info;
+        std::string message;
+    };
+
+    //ring buffer owned by one logging thread at a time
+    //head is only written by the owning thread and tail only by the writer thread, so no locks are needed
+    class ThreadLogBuffer {
+    public:
+        static constexpr size_t CAPACITY = 1024; //power of two so index wrapping is a mask
+
+        bool tryPush(uint32_t threadIndex, LogLevel level, uint64_t timestampNs, std::string&& message) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+                dropped.fetch_add(1, std::memory_order_relaxed); //never wait for the writer, just lose the line
+                return false;
+            }
+            LogEntry& slot = slots[h & (CAPACITY - 1)];
+            slot.timestampNs = timestampNs;
+            slot.threadIndex = threadIndex;
+            slot.level = level;
+            slot.message = std::move(message);
+            head.store(h + 1, std::memory_order_release); //publishes the slot to the writer
+            return true;
+        }
+        //moves every published entry into out, only called by the writer thread
+        size_t drainInto(std::vector<LogEntry>& out) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t h = head.load(std::memory_order_acquire);
+            for (size_t i = t; i != h; i++) {
+                out.push_back(std::move(slots[i & (CAPACITY - 1)]));
+            }
+            tail.store(h, std::memory_order_release); //hands the slots back to the owning thread
+            return h - t;
+        }
+        bool isEmpty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+        uint64_t takeDropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+
+    private:
+        std::array<LogEntry, CAPACITY> slots;
+        alignas(64) std::atomic<size_t> head{0}; //next slot to write
+        alignas(64) std::atomic<size_t> tail{0}; //next slot to read
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    class Logger {
+    public:
+        //never destroyed so threads that log during static destruction are still safe
+        //the writer thread is stopped by an atexit hook, after which lines are written synchronously
+        static Logger& instance() {
+            static Logger* logger = [] {
+                Logger* l = new Logger();
+                std::atexit([] { Logger::instance().shutdown(); });
+                return l;
+            }();
+            return *logger;
+        }
+
+        bool enabled(LogLevel level) const {
+            return static_cast<int>(level) >= runtimeLevel.load(std::memory_order_relaxed);
+        }
+        void setLevel(LogLevel level) { runtimeLevel.store(static_cast<int>(level), std::memory_order_relaxed); }
+        LogLevel getLevel() const { return static_cast<LogLevel>(runtimeLevel.load(std::memory_order_relaxed)); }
+        void setJsonOutput(bool enabled) { jsonOutput.store(enabled, std::memory_order_relaxed); }
+
+        void submit(LogLevel level, std::string&& message) {
+            uint64_t timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            if (!writerRunning.load(std::memory_order_acquire)) {
+                //writer already stopped (process is exiting), nothing will drain the rings anymore
+                LogEntry entry{timestampNs, threadBuffer().index, level, std::move(message)};
+                std::lock_guard<std::mutex> lock(outputMutex);
+                writeEntries(&entry, 1);
+                return;
+            }
+            ThreadHandle& handle = threadBuffer();
+            if (handle.buffer) {
+                handle.buffer->tryPush(handle.index, level, timestampNs, std::move(message));
+            } else {
+                overflow.tryPush(LogEntry{timestampNs, handle.index, level, std::move(message)});
+            }
+        }
+        size_t threadBufferCount() const { return buffers.created(); }
+        //blocks until everything logged so far has been written
+        void flush() {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            drainAll();
+        }
+        void shutdown() {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                if (!writerRunning.exchange(false)) return;
+            }
+            wakeCv.notify_one();
+            if (writerThread.joinable()) {
+                writerThread.join();
+            }
+            flush(); //anything pushed while the writer was stopping
+        }
+
+    private:
+        static constexpr size_t MAX_THREAD_BUFFERS = 1024; //threads logging at once, more than that share the overflow queue
+        static constexpr size_t OVERFLOW_CAPACITY = 4096;
+        using BufferPool = lockfree::OwnedSlotPool<ThreadLogBuffer, MAX_THREAD_BUFFERS>;
+
+        struct ThreadHandle { //thread_local handle that gives the ring back when its thread exits
+            size_t slot;
+            ThreadLogBuffer* buffer; //null if every ring was owned, lines then go through overflow
+            uint32_t index;
+            ~ThreadHandle() {
+                //lines still in the ring are drained as usual, the next owner just keeps appending after them
+                if (buffer) Logger::instance().buffers.release(slot);
+            }
+        };
+
+        std::atomic<int> runtimeLevel{static_cast<int>(LogLevel::Info)};
+        std::atomic<bool> jsonOutput{false};
+        std::atomic<bool> writerRunning{false};
+        std::atomic<uint32_t> nextThreadIndex{0};
+
+        BufferPool buffers;
+        lockfree::BoundedMpscQueue<LogEntry> overflow{OVERFLOW_CAPACITY};
+        uint64_t overflowDroppedReported = 0; //guarded by outputMutex
+
+        std::mutex outputMutex; //serializes draining + writing, never taken by logging threads
+        std::mutex wakeMutex;
+        std::condition_variable wakeCv;
+        std::thread writerThread;
+        static constexpr std::chrono::milliseconds DRAIN_INTERVAL{5};
+
+        std::vector<LogEntry> batch; //reused between drains, guarded by outputMutex
+        std::string stdoutText;
+        std::string stderrText;
+
+        Logger() {
+            if (const char* level = std::getenv("PALETTE_LOG_LEVEL")) {
+                setLevel(logLevelFromString(level, LogLevel::Info));
+            }
+            if (const char* format = std::getenv("PALETTE_LOG_FORMAT")) {
+                jsonOutput.store(std::string(format) == "json");
+            }
+            writerRunning.store(true);
+            writerThread = std::thread([this]() { writerLoop(); });
+        }
+
+        ThreadHandle& threadBuffer() {
+            thread_local ThreadHandle handle = [this] {
+                uint32_t index = nextThreadIndex.fetch_add(1, std::memory_order_relaxed);
+                size_t slot = buffers.acquire();
+                return ThreadHandle{slot, slot == BufferPool::NONE ? nullptr : buffers.get(slot), index};
+            }();
+            return handle;
+        }
+
+        void writerLoop() {
+            while (writerRunning.load(std::memory_order_acquire)) {
+                {
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    drainAll();
+                }
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wakeCv.wait_for(lock, DRAIN_INTERVAL, [this]() { return !writerRunning.load(); });
+            }
+        }
+
+        //caller holds outputMutex
+        void drainAll() {
+            uint64_t dropped = 0;
+            buffers.forEach([&](ThreadLogBuffer& buffer) {
+                buffer.drainInto(batch);
+                dropped += buffer.takeDropped();
+            });
+            overflow.popBatch(std::back_inserter(batch), overflow.capacity());
+            uint64_t overflowDropped = overflow.droppedCount();
+            dropped += overflowDropped - overflowDroppedReported;
+            overflowDroppedReported = overflowDropped;
+            if (dropped > 0) {
+                LogEntry notice;
+                notice.timestampNs = batch.empty() ? 0 : batch.back().timestampNs;
+                notice.level = LogLevel::Warn;
+                notice.message = "logger dropped " + std::to_string(dropped) + " lines (ring buffer full)";
+                batch.push_back(std::move(notice));
+            }
+            if (batch.empty()) return;
+            //each ring is already in order, sorting merges the threads into one timeline
+            std::stable_sort(batch.begin(), batch.end(), [](const LogEntry& a, const LogEntry& b) {
+                return a.timestampNs < b.timestampNs;
+            });
+            writeEntries(batch.data(), batch.size());
+            batch.clear();
+        }
+
+        //caller holds outputMutex
+        void writeEntries(LogEntry* entries, size_t count) {
+            stdoutText.clear();
+            stderrText.clear();
+            bool json = jsonOutput.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count; i++) {
+                const LogEntry& e = entries[i];
+                //warnings and errors go to stderr like the old std::cerr calls
+                std::string& out = (e.level >= LogLevel::Warn) ? stderrText : stdoutText;
+                if (json) {
+                    out += nlohmann::json{
+                        {"ts_ns", e.timestampNs},
+                        {"level", logLevelToString(e.level)},
+                        {"thread", e.threadIndex},
+                        {"msg", e.message}
+                    }.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+                } else {
+                    appendTimestamp(out, e.timestampNs);
+                    out += ' ';
+                    out += logLevelToString(e.level);
+                    out += " [t";
+                    out += std::to_string(e.threadIndex);
+                    out += "] ";
+                    out += e.message;
+                }
+                out += '\n';
+            }
+            if (!stdoutText.empty()) {
+                std::fwrite(stdoutText.data(), 1, stdoutText.size(), stdout);
+                std::fflush(stdout);
+            }
+            if (!stderrText.empty()) {
+                std::fwrite(stderrText.data(), 1, stderrText.size(), stderr);
+                std::fflush(stderr);
+            }
+        }
+        static void appendTimestamp(std::string& out, uint64_t timestampNs) {
+            //ISO 8601 in UTC with milliseconds, e.g. 2025-01-31T14:03:12.345Z
+            std::time_t seconds = static_cast<std::time_t>(timestampNs / 1000000000ULL);
+            unsigned millis = static_cast<unsigned>((timestampNs / 1000000ULL) % 1000ULL);
+            std::tm utc{};
+        #ifdef _WIN32
+            gmtime_s(&utc, &seconds);
+        #else
+            gmtime_r(&seconds, &utc);
+        #endif
+            char text[32];
+            int length = std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ",
+                utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, millis);
+            out.append(text, static_cast<size_t>(length));
+        }
+    };
+
+    //per-thread stream reused by the LOG_ macros so formatting a line doesn't construct a new ostringstream
+    inline std::ostringstream& lineStream() {
+        thread_local std::ostringstream stream;
+        stream.str(std::string());
+        stream.clear();
+        return stream;
+    }
+
+} //end of namespace logging
+} //end of namespace CoreSystems
+
+//usage: LOG_INFO("engine " << engineId << " ready");
+//below the compile time level the whole statement, including building the message, is compiled out
+#define PALETTE_LOG(level, expr) \
+    do { \
+        if constexpr (static_cast<int>(level) >= PALETTE_LOG_COMPILE_LEVEL) { \
+            if (::CoreSystems::logging::Logger::instance().enabled(level)) { \
+                std::ostringstream& paletteLogStream = ::CoreSystems::logging::lineStream(); \
+                paletteLogStream << expr; \
+                ::CoreSystems::logging::Logger::instance().submit(level, paletteLogStream.str()); \
+            } \
+        } \
+    } while (0)
+
+#define LOG_TRACE(expr) PALETTE_LOG(::CoreSystems::logging::LogLevel::Trace, expr)
+#define LOG_DEBUG(expr) PALETTE_LOG(::CoreSystems::logging::LogLevel::Debug, expr)
+#define LOG_INFO(expr) PALETTE_LOG(::CoreSystems::logging::LogLevel::Info, expr)
+#define LOG_WARN(expr) PALETTE_LOG(::CoreSystems::logging::LogLevel::Warn, expr)
+#define LOG_ERROR(expr) PALETTE_LOG(::CoreSystems::logging::LogLevel::Error, expr)
@@ -0,0 +1,237 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <utility>
+#include <cstdio>
+#include <cstdint>
+#include "latency-histogram.hpp"
+//metrics registry for the /metrics endpoint (prometheus text exposition format)
+//summary:
+//Counter, Gauge and LatencyHistogram series are owned by the registry and updated with relaxed atomics
+//function series are read at scrape time (queue depths, rss, histograms that already exist elsewhere)
+//the registry mutex is only taken to register/remove series and to scrape, request threads keep a reference
+//to their series from startup, so a scrape never waits on (or holds up) the search path
+
+namespace CoreSystems {
+namespace metrics {
+
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    class Counter {
+    public:
+        void inc(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+        uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<uint64_t> value{0};
+    };
+
+    class Gauge {
+    public:
+        void set(int64_t newValue) { value.store(newValue, std::memory_order_relaxed); }
+        void add(int64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+        int64_t get() const { return value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<int64_t> value{0};
+    };
+
+    enum class MetricType { COUNTER, GAUGE, HISTOGRAM };
+    inline const char* metricTypeToString(MetricType type) {
+        switch (type) {
+            case MetricType::COUNTER: return "counter";
+            case MetricType::GAUGE: return "gauge";
+            case MetricType::HISTOGRAM: return "histogram";
+            default: return "untyped";
+        }
+    }
+
+    class Registry {
+    public:
+        static Registry& instance() {
+            static Registry* registry = new Registry(); //leaked on purpose, series may be touched during static destruction
+            return *registry;
+        }
+
+        //registering the same name + labels again returns the existing series (engines can be recreated)
+        Counter& counter(const std::string& name, const std::string& help, const Labels& labels = {}) {
+            std::lock_guard<std::mutex> lock(mutex);
+            Series& series = findOrAdd(name, help, MetricType::COUNTER, labels);
+            if (!series.counter) series.counter = std::make_unique<Counter>();
+            return *series.counter;
+        }
+        Gauge& gauge(const std::string& name, const std::string& help, const Labels& labels = {}) {
+            std::lock_guard<std::mutex> lock(mutex);
+            Series& series = findOrAdd(name, help, MetricType::GAUGE, labels);
+            if (!series.gauge) series.gauge = std::make_unique<Gauge>();
+            return *series.gauge;
+        }
+        //latency histogram in microseconds, exported in seconds
+        LatencyHistogram& histogram(const std::string& name, const std::string& help, const Labels& labels = {}) {
+            std::lock_guard<std::mutex> lock(mutex);
+            Series& series = findOrAdd(name, help, MetricType::HISTOGRAM, labels);
+            if (!series.histogram) series.histogram = std::make_unique<LatencyHistogram>();
+            return *series.histogram;
+        }
+
+        //counter or gauge computed at scrape time, fn runs on the scraping thread and must not take search path locks
+        //owner is used to remove the series again (see removeOwner), replaces an earlier function with the same name + labels
+        void valueFunction(const std::string& name, const std::string& help, MetricType type, const Labels& labels,
+                           const void* owner, std::function<double()> fn) {
+            std::lock_guard<std::mutex> lock(mutex);
+            Series& series = findOrAdd(name, help, type, labels);
+            series.owner = owner;
+            series.valueFn = std::move(fn);
+        }
+        void histogramFunction(const std::string& name, const std::string& help, const Labels& labels,
+                               const void* owner, std::function<HistogramSnapshot()> fn) {
+            std::lock_guard<std::mutex> lock(mutex);
+            Series& series = findOrAdd(name, help, MetricType::HISTOGRAM, labels);
+            series.owner = owner;
+            series.histogramFn = std::move(fn);
+        }
+        //drops every function series registered by owner, call before owner is destroyed
+        void removeOwner(const void* owner) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& family : families) {
+                for (auto& series : family->series) {
+                    if (series->owner == owner) {
+                        series->owner = nullptr;
+                        series->valueFn = nullptr;
+                        series->histogramFn = nullptr;
+                    }
+                }
+            }
+        }
+
+        //text exposition format 0.0.4
+        std::string scrape() const {
+            std::string out;
+            out.reserve(16 * 1024);
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& family : families) {
+                bool headerWritten = false;
+                for (const auto& series : family->series) {
+                    if (!series->hasValue()) continue; //function series whose owner is gone
+                    if (!headerWritten) {
+                        out += "# HELP " + family->name + " " + family->help + "\n";
+                        out += "# TYPE " + family->name + " " + metricTypeToString(family->type) + "\n";
+                        headerWritten = true;
+                    }
+                    if (family->type == MetricType::HISTOGRAM) {
+                        writeHistogram(out, family->name, series->labels,
+                                       series->histogram ? series->histogram->snapshot() : series->histogramFn());
+                    } else {
+                        out += family->name + formatLabels(series->labels) + " " + formatNumber(series->value()) + "\n";
+                    }
+                }
+            }
+            return out;
+        }
+
+    private:
+        struct Series {
+            Labels labels;
+            std::unique_ptr<Counter> counter;
+            std::unique_ptr<Gauge> gauge;
+            std::unique_ptr<LatencyHistogram> histogram;
+            std::function<double()> valueFn;
+            std::function<HistogramSnapshot()> histogramFn;
+            const void* owner = nullptr;
+
+            bool hasValue() const { return counter || gauge || histogram || valueFn || histogramFn; }
+            double value() const {
+                if (counter) return static_cast<double>(counter->get());
+                if (gauge) return static_cast<double>(gauge->get());
+                return valueFn();
+            }
+        };
+        struct Family {
+            std::string name;
+            std::string help;
+            MetricType type;
+            std::vector<std::unique_ptr<Series>> series; //unique_ptr so references handed out stay valid
+        };
+
+        Registry() = default;
+
+        Series& findOrAdd(const std::string& name, const std::string& help, MetricType type, const Labels& labels) {
+            Family* family = nullptr;
+            for (auto& existing : families) {
+                if (existing->name == name) {
+                    family = existing.get();
+                    break;
+                }
+            }
+            if (!family) {
+                families.push_back(std::make_unique<Family>(Family{name, help, type, {}}));
+                family = families.back().get();
+            }
+            for (auto& series : family->series) {
+                if (series->labels == labels) return *series;
+            }
+            family->series.push_back(std::make_unique<Series>());
+            family->series.back()->labels = labels;
+            return *family->series.back();
+        }
+
+        static std::string escapeLabelValue(const std::string& value) {
+            std::string escaped;
+            escaped.reserve(value.size());
+            for (char c : value) {
+                if (c == '\\' || c == '"') escaped += '\\';
+                if (c == '\n') { escaped += "\\n"; continue; }
+                escaped += c;
+            }
+            return escaped;
+        }
+        static std::string formatLabels(const Labels& labels, const std::string& le = "") {
+            if (labels.empty() && le.empty()) return "";
+            std::string out = "{";
+            for (const auto& [key, value] : labels) {
+                if (out.size() > 1) out += ",";
+                out += key + "=\"" + escapeLabelValue(value) + "\"";
+            }
+            if (!le.empty()) {
+                if (out.size() > 1) out += ",";
+                out += "le=\"" + le + "\"";
+            }
+            return out + "}";
+        }
+        static std::string formatNumber(double value) {
+            char text[32];
+            if (value == static_cast<double>(static_cast<int64_t>(value)) && value < 1e15 && value > -1e15) {
+                std::snprintf(text, sizeof(text), "%lld", static_cast<long long>(value)); //counters stay exact
+            } else {
+                std::snprintf(text, sizeof(text), "%.10g", value);
+            }
+            return text;
+        }
+
+        //buckets are the powers of two from 128us to ~16.8s, which are exact bucket edges of LatencyHistogram
+        //so the cumulative counts are exact rather than interpolated
+        static constexpr int FIRST_BUCKET_POWER = 7;
+        static constexpr int LAST_BUCKET_POWER = 24;
+        static void writeHistogram(std::string& out, const std::string& name, const Labels& labels, const HistogramSnapshot& snapshot) {
+            size_t index = 0;
+            uint64_t cumulative = 0;
+            for (int power = FIRST_BUCKET_POWER; power <= LAST_BUCKET_POWER; power++) {
+                uint64_t edge = 1ULL << power;
+                while (index < HistogramSnapshot::BUCKET_COUNT && HistogramSnapshot::bucketUpperBound(index) < edge) {
+                    cumulative += snapshot.counts[index++];
+                }
+                out += name + "_bucket" + formatLabels(labels, formatNumber(static_cast<double>(edge) / 1e6)) + " " + std::to_string(cumulative) + "\n";
+            }
+            out += name + "_bucket" + formatLabels(labels, "+Inf") + " " + std::to_string(snapshot.count) + "\n";
+            out += name + "_sum" + formatLabels(labels) + " " + formatNumber(static_cast<double>(snapshot.sum) / 1e6) + "\n";
+            out += name + "_count" + formatLabels(labels) + " " + std::to_string(snapshot.count) + "\n";
+        }
+
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<Family>> families; //kept in registration order
+    };
+
+} //end of namespace metrics
+} //end of namespace CoreSystems
@@ -0,0 +1,344 @@
+//microbenchmarks for the backend's hot paths, built on google benchmark
+//summary:
+//the whole server is compiled in (http-server.cpp with PALETTE_NO_MAIN), so these run the real code, not copies of it
+//payloads are recorded responses in backend/bench-data (captured from mock-upstream), PALETTE_BENCH_DATA points elsewhere
+//results go to microbench-results.json unless --benchmark_out is given, compare two runs with google benchmark's compare.py
+//
+//usage: microbench [--benchmark_filter=<regex>] [--benchmark_out=<file>] [--benchmark_repetitions=N]
+//any change to one of these paths should come with a before/after run of its benchmark
+#define PALETTE_NO_MAIN
+#include "http-server.cpp"
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace MicroBench {
+
+    using namespace CoreSystems;
+
+    std::string dataDirectory() {
+        if (const char* configured = std::getenv("PALETTE_BENCH_DATA")) return configured;
+        return std::filesystem::exists("backend/bench-data") ? "backend/bench-data" : "bench-data";
+    }
+    //recorded payload by file name, loaded once
+    const std::string& payload(const std::string& name) {
+        static std::mutex loadMutex;
+        static std::unordered_map<std::string, std::string> loaded;
+        std::lock_guard<std::mutex> lock(loadMutex);
+        auto found = loaded.find(name);
+        if (found != loaded.end()) return found->second;
+        std::ifstream file(dataDirectory() + "/" + name, std::ios::binary);
+        if (!file) throw std::runtime_error("missing benchmark payload " + dataDirectory() + "/" + name);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        return loaded.emplace(name, contents.str()).first->second;
+    }
+    const NodeList& recordedNodes() {
+        static const NodeList nodes = WeaviateClient::parseWeaviateResponse(payload("weaviate-response.json"), 1);
+        return nodes;
+    }
+    void setEnvDefault(const char* name, const char* value) {
+        if (std::getenv(name)) return;
+#ifdef _WIN32
+        _putenv_s(name, value);
+#else
+        setenv(name, value, 0);
+#endif
+    }
+
+    //weaviate level-1 response: 10 concepts with 384-dimension vectors, parsed by the streaming parser
+    //state.range(0): 0 = nodes on the heap, 1 = nodes in a fresh RequestArena each time (what a search does)
+    void BM_ParseWeaviateResponse(benchmark::State& state) {
+        const std::string& body = payload("weaviate-response.json");
+        bool useArena = state.range(0) == 1;
+        for (auto _ : state) {
+            RequestArena arena;
+            auto nodes = WeaviateClient::parseWeaviateResponse(body, 1, 384, useArena ? arena.get() : std::pmr::get_default_resource());
+            benchmark::DoNotOptimize(nodes.data());
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(body.size()));
+    }
+    BENCHMARK(BM_ParseWeaviateResponse)->Arg(0)->Arg(1)->ArgName("arena");
+
+    //pinterest search response, including the json::parse that searchImages does first
+    void BM_ParsePinterestResponse(benchmark::State& state) {
+        const std::string& body = payload("pinterest-response.json");
+        for (auto _ : state) {
+            auto images = PinterestClient::parsePinterestResponse(nlohmann::json::parse(body));
+            benchmark::DoNotOptimize(images.data());
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(body.size()));
+    }
+    BENCHMARK(BM_ParsePinterestResponse);
+
+    void BM_NodeToJson(benchmark::State& state) {
+        const Node& node = recordedNodes().front();
+        for (auto _ : state) {
+            nlohmann::json j = node.toJson();
+            benchmark::DoNotOptimize(j);
+        }
+    }
+    BENCHMARK(BM_NodeToJson);
+
+    void BM_NodeFromJson(benchmark::State& state) {
+        const nlohmann::json j = recordedNodes().front().toJson();
+        for (auto _ : state) {
+            Node node = Node::fromJson(j);
+            benchmark::DoNotOptimize(node);
+        }
+    }
+    BENCHMARK(BM_NodeFromJson);
+
+    //scoring a query against many stored concepts, 384 dimensions like weaviate's vectors
+    //state.range(0): 0 = float32, 1 = float16, 2 = int8 in an EmbeddingStore, 3 = a heap std::vector<float> per concept (the old layout)
+    void BM_EmbeddingDot(benchmark::State& state) {
+        constexpr size_t DIMENSION = 384;
+        constexpr size_t CONCEPTS = 4096;
+        std::mt19937 random(7);
+        std::normal_distribution<float> normal(0.0f, 0.05f);
+        auto randomVector = [&]() {
+            std::vector<float> values(DIMENSION);
+            for (float& value : values) value = normal(random);
+            return values;
+        };
+        std::vector<float> query = randomVector();
+        std::vector<float> scores(CONCEPTS);
+        if (state.range(0) == 3) {
+            std::vector<std::vector<float>> vectors;
+            for (size_t i = 0; i < CONCEPTS; i++) vectors.push_back(randomVector());
+            for (auto _ : state) {
+                for (size_t i = 0; i < CONCEPTS; i++) {
+                    float sum = 0.0f;
+                    for (size_t d = 0; d < DIMENSION; d++) sum += vectors[i][d] * query[d];
+                    scores[i] = sum;
+                }
+                benchmark::DoNotOptimize(scores.data());
+            }
+            state.counters["bytes_per_vector"] = static_cast<double>(DIMENSION * sizeof(float) + sizeof(std::vector<float>));
+        } else {
+            EmbeddingStore store(static_cast<EmbeddingFormat>(state.range(0)));
+            std::vector<EmbeddingRef> refs;
+            for (size_t i = 0; i < CONCEPTS; i++) {
+                refs.push_back(store.put(StringInterner::global().intern("bench-concept-" + std::to_string(i)), randomVector()));
+            }
+            for (auto _ : state) {
+                store.dotMany(query.data(), refs.data(), refs.size(), scores.data());
+                benchmark::DoNotOptimize(scores.data());
+            }
+            state.counters["bytes_per_vector"] = static_cast<double>(store.bytesPerVector());
+            state.SetLabel(store.usesSimd() ? "avx2" : "scalar");
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(CONCEPTS));
+    }
+    BENCHMARK(BM_EmbeddingDot)->DenseRange(0, 3)->ArgName("format");
+
+    //MiniLM-L6 sized encoder with random int8 weights and a small vocab, the real weights aren't in the repo
+    //inference cost only depends on the shapes and the token count, not on what the weights are
+    MiniLmModel::Weights buildRandomEncoderWeights() {
+        MiniLmModel::Weights weights;
+        MiniLmModel::Config& config = weights.config;
+        weights.vocab = "[PAD]\n[UNK]\n[CLS]\n[SEP]\n[MASK]\n";
+        for (const char* word : {"impression", "##ism", "claude", "monet", "water", "##color", "paint", "##ing", "art", "nouveau"}) {
+            weights.vocab += std::string(word) + "\n";
+        }
+        for (char letter = 'a'; letter <= 'z'; letter++) {
+            weights.vocab += std::string(1, letter) + "\n##" + std::string(1, letter) + "\n";
+        }
+        config.vocabSize = static_cast<uint32_t>(std::count(weights.vocab.begin(), weights.vocab.end(), '\n'));
+        std::mt19937 random(11);
+        std::uniform_int_distribution<int> weight(-127, 127);
+        std::normal_distribution<float> normal(0.0f, 0.02f);
+        auto matrix = [&](detail::Int8Rows& rows, size_t rowCount, size_t colCount, std::vector<float>* bias) {
+            rows.resize(rowCount, colCount);
+            for (size_t r = 0; r < rowCount; r++) {
+                for (size_t c = 0; c < colCount; c++) rows.row(r)[c] = static_cast<int8_t>(weight(random));
+                rows.scales[r] = 0.05f / 127.0f;
+            }
+            if (bias) bias->assign(rowCount, 0.01f);
+        };
+        auto layerNorm = [&]() { return MiniLmModel::LayerNorm{std::vector<float>(config.hidden, 1.0f), std::vector<float>(config.hidden, 0.0f)}; };
+        matrix(weights.wordEmbeddings, config.vocabSize, config.hidden, nullptr);
+        weights.positionEmbeddings.resize(static_cast<size_t>(config.maxPositions) * config.hidden);
+        for (float& value : weights.positionEmbeddings) value = normal(random);
+        weights.tokenTypeEmbeddings.assign(static_cast<size_t>(config.typeVocabSize) * config.hidden, 0.0f);
+        weights.embeddingNorm = layerNorm();
+        weights.layers.resize(config.layers);
+        for (MiniLmModel::Layer& layer : weights.layers) {
+            matrix(layer.qkv.weights, 3 * config.hidden, config.hidden, &layer.qkv.bias);
+            matrix(layer.attentionOut.weights, config.hidden, config.hidden, &layer.attentionOut.bias);
+            layer.attentionNorm = layerNorm();
+            matrix(layer.ffnIn.weights, config.intermediate, config.hidden, &layer.ffnIn.bias);
+            matrix(layer.ffnOut.weights, config.hidden, config.intermediate, &layer.ffnOut.bias);
+            layer.outputNorm = layerNorm();
+        }
+        return weights;
+    }
+    const MiniLmModel::Weights& randomEncoderWeights() { //built once, every encoder below gets a copy
+        static const MiniLmModel::Weights weights = buildRandomEncoderWeights();
+        return weights;
+    }
+
+    //QueryEncoder::encode, the local replacement for weaviate's nearText vectorization
+    //state.range(0): words in the query (each one wordpiece here, plus [CLS] and [SEP]), state.range(1): 0 = cache miss, 1 = cache hit
+    void BM_EncodeQuery(benchmark::State& state) {
+        static QueryEncoder* missEncoder = new QueryEncoder(randomEncoderWeights(), 0); //capacity 0, every call runs the model
+        static QueryEncoder* hitEncoder = new QueryEncoder(randomEncoderWeights());
+        QueryEncoder& encoder = state.range(1) == 1 ? *hitEncoder : *missEncoder;
+        std::string query = "claude";
+        for (int64_t i = 1; i < state.range(0); i++) query += " monet";
+        for (auto _ : state) {
+            std::vector<float> embedding = encoder.encode(query);
+            benchmark::DoNotOptimize(embedding.data());
+        }
+        state.SetLabel(encoder.usesSimd() ? "avx2" : "scalar");
+    }
+    BENCHMARK(BM_EncodeQuery)->ArgsProduct({{1, 4, 16}, {0, 1}})->ArgNames({"words", "cached"})->Unit(benchmark::kMicrosecond);
+
+    void BM_Tokenize(benchmark::State& state) {
+        static WordPieceTokenizer* tokenizer = new WordPieceTokenizer(randomEncoderWeights().vocab);
+        const std::string query = "Claude Monet's Impressionism: water-color painting, Art Nouveau";
+        std::vector<int32_t> tokenIds;
+        for (auto _ : state) {
+            tokenizer->tokenize(WordPieceTokenizer::normalize(query), QueryEncoder::MAX_QUERY_TOKENS, tokenIds);
+            benchmark::DoNotOptimize(tokenIds.data());
+        }
+    }
+    BENCHMARK(BM_Tokenize);
+
+    //checkCache/updateCache from several threads on one engine, 9 lookups per store like a warm cache
+    //each lookup copies into its own RequestArena like a search does, the engine is never initialize()d so nothing goes upstream
+    void BM_CacheContention(benchmark::State& state) {
+        static VectorEngine* engine = nullptr;
+        static std::vector<std::string> queries;
+        if (state.thread_index() == 0) {
+            engine = new VectorEngine("bench");
+            queries.clear();
+            for (int i = 0; i < 512; i++) {
+                queries.push_back("concept-" + std::to_string(i));
+                engine->updateCache(queries.back(), recordedNodes());
+            }
+        }
+        uint64_t i = static_cast<uint64_t>(state.thread_index()) * 7919;
+        for (auto _ : state) {
+            const std::string& query = queries[i % queries.size()];
+            if (i % 10 == 0) {
+                engine->updateCache(query, recordedNodes());
+            } else {
+                RequestArena arena;
+                auto nodes = engine->checkCache(query, arena.get());
+                benchmark::DoNotOptimize(nodes.data());
+            }
+            i++;
+        }
+        if (state.thread_index() == 0) {
+            delete engine;
+            engine = nullptr;
+        }
+    }
+    BENCHMARK(BM_CacheContention)->ThreadRange(1, 8)->UseRealTime();
+
+    //the telemetry worker's side of a search record
+    void BM_ProcessTelemetry(benchmark::State& state) {
+        TelemetryProcessor processor;
+        processor.start();
+        SearchTelemetry telemetry;
+        telemetry.searchId = utils::generateUUID();
+        telemetry.searchPhrase = "impressionism";
+        telemetry.processingTime = 120;
+        telemetry.nodesFound = 40;
+        telemetry.timestamp = utils::getCurrentTime();
+        telemetry.traceId = 42;
+        telemetry.processingTimeNs = 120'000'000;
+        for (size_t i = 0; i < telemetry.stageTimeNs.size(); i++) {
+            telemetry.stageTimeNs[i] = (i + 1) * 10'000'000;
+        }
+        for (auto _ : state) {
+            processor.processTelemetry(telemetry);
+        }
+        processor.stop();
+    }
+    BENCHMARK(BM_ProcessTelemetry);
+
+    void BM_GenerateUUID(benchmark::State& state) {
+        for (auto _ : state) {
+            std::string uuid = utils::generateUUID();
+            benchmark::DoNotOptimize(uuid.data());
+        }
+    }
+    BENCHMARK(BM_GenerateUUID)->ThreadRange(1, 8)->UseRealTime();
+
+    //the same id formatted into a stack buffer, no std::string
+    void BM_GenerateUUIDText(benchmark::State& state) {
+        for (auto _ : state) {
+            uuid::UuidText text = uuid::generateV7();
+            benchmark::DoNotOptimize(text.data());
+        }
+    }
+    BENCHMARK(BM_GenerateUUIDText);
+
+    //GraphQLHandler::handleQuery on a running SystemManager, weaviate points at a closed port so only cache hits answer
+    //state.range(0): 0 = search_concepts (cache hit), 1 = system_health, 2 = telemetry_report
+    class HandlerFixture : public benchmark::Fixture {
+    public:
+        void SetUp(const benchmark::State&) override {
+            if (systemManager) return; //shared by every benchmark using the fixture, the manager is expensive to start
+            systemManager = std::make_shared<SystemManager>();
+            if (!systemManager->initialize()) {
+                throw std::runtime_error("SystemManager failed to initialize");
+            }
+            handler = std::make_unique<GroundControl::GraphQLHandler>(systemManager);
+            systemManager->getPrimaryVectorEngine()->updateCache("impressionism", recordedNodes());
+        }
+        static std::shared_ptr<SystemManager> systemManager;
+        static std::unique_ptr<GroundControl::GraphQLHandler> handler;
+    };
+    std::shared_ptr<SystemManager> HandlerFixture::systemManager;
+    std::unique_ptr<GroundControl::GraphQLHandler> HandlerFixture::handler;
+
+    BENCHMARK_DEFINE_F(HandlerFixture, BM_HandleQuery)(benchmark::State& state) {
+        static const nlohmann::json requests[] = {
+            {{"query", "query { search_concepts }"}, {"variables", {{"query", "impressionism"}, {"limit", 10}}}},
+            {{"query", "query { system_health }"}},
+            {{"query", "query { telemetry_report }"}}
+        };
+        const nlohmann::json& request = requests[state.range(0)];
+        for (auto _ : state) {
+            nlohmann::json response = handler->handleQuery(request);
+            benchmark::DoNotOptimize(response);
+        }
+    }
+    BENCHMARK_REGISTER_F(HandlerFixture, BM_HandleQuery)->DenseRange(0, 2)->ArgName("operation");
+
+} //end of namespace MicroBench
+
+int main(int argc, char* argv[]) {
+    //nothing should reach a real upstream from here
+    MicroBench::setEnvDefault("WEAVIATE_URL", "http://127.0.0.1:9");
+    MicroBench::setEnvDefault("WEAVIATE_BACKUP_URL", "http://127.0.0.1:9");
+    MicroBench::setEnvDefault("PINTEREST_API_URL", "http://127.0.0.1:9");
+
+    //json results by default, so every run can be compared with the last one
+    std::vector<char*> args(argv, argv + argc);
+    bool hasOut = false;
+    for (int i = 1; i < argc; i++) {
+        hasOut = hasOut || std::string(argv[i]).rfind("--benchmark_out=", 0) == 0;
+    }
+    std::string outFlag = "--benchmark_out=microbench-results.json";
+    std::string formatFlag = "--benchmark_out_format=json";
+    if (!hasOut) {
+        args.push_back(outFlag.data());
+        args.push_back(formatFlag.data());
+    }
+    int count = static_cast<int>(args.size());
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    if (MicroBench::HandlerFixture::systemManager) {
+        MicroBench::HandlerFixture::handler.reset();
+        MicroBench::HandlerFixture::systemManager->shutdown();
+    }
+    return 0;
+}
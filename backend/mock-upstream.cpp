@@ -0,0 +1,422 @@
+//stand-in for weaviate and the pinterest api, for load tests and benchmarks that can't depend on live services
+//summary:
+//POST /v1/graphql        - Get { Concept(nearText: { concepts: ["..."] } limit: N) } with name, description, certainty and vector
+//                          or Concept(nearVector: { vector: [...] } limit: N), ranked by the given vector
+//                          several aliased selections in one Get (c0: Concept(...) c1: Concept(...)) each get their own array
+//GET  /v5/pins/search    - ?query=...&limit=N, pins in the shape the pinterest v5 api returns
+//GET  /v1/.well-known/ready - readiness probe used by SystemManager::probeWorker
+//GET/POST /mock/config   - current settings, a POSTed json object is merged in (change latency or error rates mid-run)
+//
+//everything served is a pure function of the seed file: concept embeddings come from a hash of the concept name,
+//query embeddings from a hash of the query text, pins from a hash of the query and the pin's position
+//so two runs with the same seed file get byte-identical responses (only latency and injected errors are random)
+//
+//usage: mock-upstream [--port 8090] [--seed backend/mock-upstream-seed.json] [--threads 64]
+//then point the backend at it: WEAVIATE_URL=http://localhost:8090 WEAVIATE_BACKUP_URL=http://localhost:8090 PINTEREST_API_URL=http://localhost:8090
+#include "httplib.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MockUpstream {
+
+    //latency of one endpoint, sampled per request
+    //"fixed": ms | "uniform": min_ms, max_ms | "lognormal": median_ms, sigma
+    //tail_probability / tail_ms add an occasional slow response on top of any distribution (gc pauses, cold shards)
+    struct LatencyModel {
+        std::string distribution = "fixed";
+        double ms = 0.0;
+        double minMs = 0.0;
+        double maxMs = 0.0;
+        double medianMs = 0.0;
+        double sigma = 0.0;
+        double tailProbability = 0.0;
+        double tailMs = 0.0;
+
+        static LatencyModel fromJson(const nlohmann::json& j) {
+            LatencyModel model;
+            model.distribution = j.value("distribution", "fixed");
+            model.ms = j.value("ms", 0.0);
+            model.minMs = j.value("min_ms", 0.0);
+            model.maxMs = j.value("max_ms", model.minMs);
+            model.medianMs = j.value("median_ms", 0.0);
+            model.sigma = j.value("sigma", 0.0);
+            model.tailProbability = j.value("tail_probability", 0.0);
+            model.tailMs = j.value("tail_ms", 0.0);
+            return model;
+        }
+        nlohmann::json toJson() const {
+            return nlohmann::json{
+                {"distribution", distribution}, {"ms", ms}, {"min_ms", minMs}, {"max_ms", maxMs},
+                {"median_ms", medianMs}, {"sigma", sigma}, {"tail_probability", tailProbability}, {"tail_ms", tailMs}
+            };
+        }
+        double sampleMs(std::mt19937_64& rng) const {
+            double value = ms;
+            if (distribution == "uniform") {
+                value = std::uniform_real_distribution<double>(minMs, std::max(minMs, maxMs))(rng);
+            } else if (distribution == "lognormal") {
+                value = medianMs > 0.0 ? std::lognormal_distribution<double>(std::log(medianMs), sigma)(rng) : 0.0;
+            }
+            if (tailProbability > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(rng) < tailProbability) {
+                value += tailMs;
+            }
+            return std::max(0.0, value);
+        }
+    };
+
+    struct EndpointConfig {
+        LatencyModel latency;
+        double errorRate = 0.0; //share of requests answered with errorStatus
+        int errorStatus = 500;
+
+        static EndpointConfig fromJson(const nlohmann::json& j, int defaultErrorStatus) {
+            EndpointConfig config;
+            if (j.contains("latency")) config.latency = LatencyModel::fromJson(j["latency"]);
+            config.errorRate = j.value("error_rate", 0.0);
+            config.errorStatus = j.value("error_status", defaultErrorStatus);
+            return config;
+        }
+        nlohmann::json toJson() const {
+            return nlohmann::json{{"latency", latency.toJson()}, {"error_rate", errorRate}, {"error_status", errorStatus}};
+        }
+    };
+
+    struct Concept {
+        std::string name;
+        std::string description;
+        std::vector<float> embedding;
+    };
+
+    //FNV-1a, the seed is mixed in first so a different seed file gives a different (but still fixed) corpus
+    inline uint64_t hashString(const std::string& text, uint64_t seed) {
+        uint64_t hash = 1469598103934665603ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+    //unit-length pseudo-random vector, same text and seed always give the same vector
+    inline std::vector<float> embed(const std::string& text, uint64_t seed, size_t dimension) {
+        std::mt19937_64 rng(hashString(text, seed));
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        std::vector<float> vector(dimension);
+        double norm = 0.0;
+        for (auto& value : vector) {
+            value = normal(rng);
+            norm += static_cast<double>(value) * value;
+        }
+        float scale = norm > 0.0 ? static_cast<float>(1.0 / std::sqrt(norm)) : 0.0f;
+        for (auto& value : vector) {
+            value *= scale;
+        }
+        return vector;
+    }
+
+    class Upstream {
+    public:
+        explicit Upstream(const nlohmann::json& seedFile) {
+            seed = seedFile.value("seed", 42ULL);
+            dimension = seedFile.value("dimension", 384);
+            defaultLimit = seedFile.value("default_limit", 10);
+            pinsPerQuery = seedFile.value("pins_per_query", 10);
+            for (const auto& item : seedFile.value("concepts", nlohmann::json::array())) {
+                addConcept(item.value("name", ""), item.value("description", ""));
+            }
+            //padding the corpus so searches rank a realistic number of vectors
+            size_t synthetic = seedFile.value("synthetic_concepts", 0);
+            for (size_t i = 0; i < synthetic; i++) {
+                addConcept("concept-" + std::to_string(i), "Synthetic concept " + std::to_string(i) + " for load testing.");
+            }
+            applyConfig(seedFile);
+        }
+
+        //merges "weaviate" / "pinterest" endpoint settings, missing keys keep their current value
+        void applyConfig(const nlohmann::json& update) {
+            std::unique_lock<std::shared_mutex> lock(configMutex);
+            if (update.contains("weaviate")) {
+                nlohmann::json merged = weaviate.toJson();
+                merged.merge_patch(update["weaviate"]);
+                weaviate = EndpointConfig::fromJson(merged, 500);
+            }
+            if (update.contains("pinterest")) {
+                nlohmann::json merged = pinterest.toJson();
+                merged.merge_patch(update["pinterest"]);
+                pinterest = EndpointConfig::fromJson(merged, 429);
+            }
+        }
+        nlohmann::json configJson() const {
+            std::shared_lock<std::shared_mutex> lock(configMutex);
+            return nlohmann::json{
+                {"seed", seed},
+                {"dimension", dimension},
+                {"concepts", concepts.size()},
+                {"weaviate", weaviate.toJson()},
+                {"pinterest", pinterest.toJson()}
+            };
+        }
+
+        void handleGraphql(const httplib::Request& req, httplib::Response& res) {
+            if (injectLatencyAndErrors(weaviateConfig(), res)) return;
+            std::string graphql;
+            try {
+                graphql = nlohmann::json::parse(req.body).value("query", "");
+            } catch (const std::exception& e) {
+                res.status = 400;
+                res.set_content(nlohmann::json{{"error", std::string("invalid json: ") + e.what()}}.dump(), "application/json");
+                return;
+            }
+            //one result array per Concept(...) selection, keyed by its alias when the request batches several
+            nlohmann::ordered_json get = nlohmann::ordered_json::object();
+            size_t position = graphql.find("Concept(");
+            while (position != std::string::npos) {
+                size_t next = graphql.find("Concept(", position + 8);
+                std::string selection = graphql.substr(position, next == std::string::npos ? std::string::npos : next - position);
+                std::vector<float> query;
+                std::string text;
+                if (extractVector(selection, query)) {
+                    if (query.size() != dimension) {
+                        res.status = 422;
+                        res.set_content(nlohmann::json{{"errors", {{{"message", "nearVector has " + std::to_string(query.size()) +
+                            " dimensions, the concepts have " + std::to_string(dimension)}}}}}.dump(), "application/json");
+                        return;
+                    }
+                } else if (extractConcept(selection, text)) {
+                    query = embed(text, seed, dimension);
+                } else {
+                    break;
+                }
+                int limit = extractLimit(selection, defaultLimit);
+                nlohmann::json matches = nlohmann::json::array();
+                for (size_t index : nearest(query, static_cast<size_t>(limit))) {
+                    matches.push_back(conceptJson(concepts[index], similarities[index]));
+                }
+                get[extractAlias(graphql, position)] = std::move(matches);
+                position = next;
+            }
+            if (get.empty() || position != std::string::npos) {
+                res.status = 422;
+                res.set_content(R"json({"errors":[{"message":"mock-upstream only supports Concept(nearText: { concepts: [...] }) and Concept(nearVector: { vector: [...] })"}]})json", "application/json");
+                return;
+            }
+            nlohmann::ordered_json body = {{"data", {{"Get", std::move(get)}}}};
+            res.set_content(body.dump(), "application/json");
+        }
+
+        void handlePins(const httplib::Request& req, httplib::Response& res) {
+            if (injectLatencyAndErrors(pinterestConfig(), res)) return;
+            std::string query = req.has_param("query") ? req.get_param_value("query") : "";
+            int limit = req.has_param("limit") ? std::atoi(req.get_param_value("limit").c_str()) : pinsPerQuery;
+            limit = std::clamp(limit, 0, 250);
+            nlohmann::json items = nlohmann::json::array();
+            for (int i = 0; i < limit; i++) {
+                uint64_t id = hashString(query + "#" + std::to_string(i), seed);
+                std::string pinId = std::to_string(id % 1000000000000000ULL);
+                items.push_back({
+                    {"id", pinId},
+                    {"description", query + " reference " + std::to_string(i + 1)},
+                    {"media", {{"images", {{"originals", {
+                        {"url", "https://i.pinimg.com/originals/mock/" + pinId + ".jpg"},
+                        {"width", 736 + static_cast<int>(id % 5) * 64},
+                        {"height", 1104 + static_cast<int>((id >> 8) % 5) * 64}
+                    }}}}}},
+                    {"board", {{"name", "mock board " + std::to_string(id % 97)}}}
+                });
+            }
+            res.set_content(nlohmann::json{{"items", std::move(items)}, {"bookmark", nullptr}}.dump(), "application/json");
+        }
+
+    private:
+        uint64_t seed = 42;
+        size_t dimension = 384;
+        int defaultLimit = 10;
+        int pinsPerQuery = 10;
+        std::vector<Concept> concepts;
+        mutable std::shared_mutex configMutex;
+        EndpointConfig weaviate;
+        EndpointConfig pinterest;
+        static thread_local std::vector<float> similarities; //scratch for nearest(), one per server thread
+
+        void addConcept(const std::string& name, const std::string& description) {
+            if (name.empty()) return;
+            concepts.push_back(Concept{name, description, embed(name, seed, dimension)});
+        }
+        EndpointConfig weaviateConfig() const {
+            std::shared_lock<std::shared_mutex> lock(configMutex);
+            return weaviate;
+        }
+        EndpointConfig pinterestConfig() const {
+            std::shared_lock<std::shared_mutex> lock(configMutex);
+            return pinterest;
+        }
+        static std::mt19937_64& threadRng() {
+            thread_local std::mt19937_64 rng(std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+                                             static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+            return rng;
+        }
+        //sleeps for the sampled latency, returns true if the request was answered with an injected error
+        static bool injectLatencyAndErrors(const EndpointConfig& config, httplib::Response& res) {
+            auto& rng = threadRng();
+            double delayMs = config.latency.sampleMs(rng);
+            if (delayMs > 0.0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(delayMs * 1000.0)));
+            }
+            if (config.errorRate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(rng) < config.errorRate) {
+                res.status = config.errorStatus;
+                res.set_content(nlohmann::json{{"error", "injected by mock-upstream"}}.dump(), "application/json");
+                return true;
+            }
+            return false;
+        }
+
+        //first string in concepts: ["..."]
+        static bool extractConcept(const std::string& graphql, std::string& out) {
+            size_t key = graphql.find("concepts");
+            if (key == std::string::npos) return false;
+            size_t open = graphql.find('"', key + 8);
+            if (open == std::string::npos) return false;
+            size_t close = graphql.find('"', open + 1);
+            if (close == std::string::npos) return false;
+            out = graphql.substr(open + 1, close - open - 1);
+            return true;
+        }
+        //the alias in front of the Concept( at position ("c0: Concept(...)"), "Concept" if there is none
+        static std::string extractAlias(const std::string& graphql, size_t position) {
+            size_t colon = graphql.find_last_not_of(" \t\n", position == 0 ? 0 : position - 1);
+            if (position == 0 || colon == std::string::npos || graphql[colon] != ':') return "Concept";
+            size_t end = graphql.find_last_not_of(" \t\n", colon - 1);
+            if (end == std::string::npos) return "Concept";
+            size_t start = end + 1;
+            while (start > 0 && (std::isalnum(static_cast<unsigned char>(graphql[start - 1])) || graphql[start - 1] == '_')) start--;
+            return start <= end ? graphql.substr(start, end - start + 1) : "Concept";
+        }
+        //the numbers in nearVector: { vector: [...] }
+        static bool extractVector(const std::string& graphql, std::vector<float>& out) {
+            size_t key = graphql.find("nearVector");
+            if (key == std::string::npos) return false;
+            size_t open = graphql.find('[', key);
+            size_t close = open == std::string::npos ? std::string::npos : graphql.find(']', open);
+            if (close == std::string::npos) return false;
+            const char* cursor = graphql.c_str() + open + 1;
+            const char* end = graphql.c_str() + close;
+            while (cursor < end) {
+                char* next = nullptr;
+                float value = std::strtof(cursor, &next);
+                if (next == cursor) {
+                    cursor++; //comma or whitespace
+                    continue;
+                }
+                out.push_back(value);
+                cursor = next;
+            }
+            return true;
+        }
+        static int extractLimit(const std::string& graphql, int fallback) {
+            size_t key = graphql.find("limit:");
+            if (key == std::string::npos) return fallback;
+            int limit = std::atoi(graphql.c_str() + key + 6);
+            return limit > 0 ? std::min(limit, 100) : fallback;
+        }
+
+        //indices of the `limit` concepts closest to query, best first (fills similarities as a side effect)
+        std::vector<size_t> nearest(const std::vector<float>& query, size_t limit) const {
+            similarities.resize(concepts.size());
+            std::vector<size_t> order(concepts.size());
+            for (size_t i = 0; i < concepts.size(); i++) {
+                const auto& embedding = concepts[i].embedding;
+                float dot = 0.0f;
+                for (size_t d = 0; d < dimension; d++) {
+                    dot += embedding[d] * query[d];
+                }
+                similarities[i] = dot;
+                order[i] = i;
+            }
+            limit = std::min(limit, order.size());
+            std::partial_sort(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(limit), order.end(),
+                              [](size_t a, size_t b) { return similarities[a] > similarities[b]; });
+            order.resize(limit);
+            return order;
+        }
+        static nlohmann::json conceptJson(const Concept& entry, float cosine) {
+            return nlohmann::json{
+                {"name", entry.name},
+                {"description", entry.description},
+                {"_additional", {
+                    {"certainty", std::clamp((1.0 + cosine) / 2.0, 0.0, 1.0)}, //weaviate's certainty for cosine distance
+                    {"vector", entry.embedding}
+                }}
+            };
+        }
+    };
+    thread_local std::vector<float> Upstream::similarities;
+
+} //end of namespace MockUpstream
+
+int main(int argc, char* argv[]) {
+    int port = 8090;
+    int threads = 64; //latency is simulated with sleeps, so every in-flight request holds a thread
+    std::string seedPath = "backend/mock-upstream-seed.json";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--port") port = std::atoi(argv[i + 1]);
+        else if (flag == "--seed") seedPath = argv[i + 1];
+        else if (flag == "--threads") threads = std::max(1, std::atoi(argv[i + 1]));
+        else {
+            std::cerr << "unknown flag " << flag << "\nusage: mock-upstream [--port 8090] [--seed file.json] [--threads 64]" << std::endl;
+            return 1;
+        }
+    }
+
+    nlohmann::json seedFile;
+    std::ifstream file(seedPath);
+    if (!file) {
+        std::cerr << "can't open seed file " << seedPath << std::endl;
+        return 1;
+    }
+    try {
+        file >> seedFile;
+    } catch (const std::exception& e) {
+        std::cerr << "invalid seed file " << seedPath << ": " << e.what() << std::endl;
+        return 1;
+    }
+    MockUpstream::Upstream upstream(seedFile);
+
+    httplib::Server server;
+    server.new_task_queue = [threads]() { return new httplib::ThreadPool(static_cast<size_t>(threads)); };
+    server.Post("/v1/graphql", [&](const httplib::Request& req, httplib::Response& res) { upstream.handleGraphql(req, res); });
+    server.Get("/v5/pins/search", [&](const httplib::Request& req, httplib::Response& res) { upstream.handlePins(req, res); });
+    server.Get("/v1/.well-known/ready", [](const httplib::Request&, httplib::Response& res) { res.status = 200; }); //httplib routes HEAD here too
+    server.Get("/mock/config", [&](const httplib::Request&, httplib::Response& res) {
+        res.set_content(upstream.configJson().dump(2), "application/json");
+    });
+    server.Post("/mock/config", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            upstream.applyConfig(nlohmann::json::parse(req.body));
+            res.set_content(upstream.configJson().dump(2), "application/json");
+        } catch (const std::exception& e) {
+            res.status = 400;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(), "application/json");
+        }
+    });
+
+    std::cout << "mock-upstream: " << upstream.configJson().value("concepts", 0) << " concepts from " << seedPath
+              << ", listening on 0.0.0.0:" << port << std::endl;
+    if (!server.listen("0.0.0.0", port)) {
+        std::cerr << "mock-upstream: failed to listen on port " << port << std::endl;
+        return 1;
+    }
+    return 0;
+}
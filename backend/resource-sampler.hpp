@@ -0,0 +1,225 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sched.h>
+    #include <malloc.h> //mallinfo2
+#endif
+//process cpu and memory sampling for healthMonitorWorker
+//summary:
+//cpu% is the process's own cpu time (user + system) over the wall time since the last sample,
+//divided by the cores the process may actually use (affinity mask and cgroup cpu quota), so 100% = every usable core busy
+//memory is the current resident set (not the peak), as a percent of the cgroup memory limit or of physical memory
+//on linux the /proc files are opened once and re-read with pread into a stack buffer, so a sample is a few syscalls
+
+namespace CoreSystems {
+
+    struct ResourceSample {
+        float cpuPercent = 0.0f; //0-100, normalized to availableCores
+        float availableCores = 1.0f;
+        uint64_t residentBytes = 0;
+        uint64_t memoryLimitBytes = 0; //cgroup limit, or physical memory if there isn't one
+        float memoryPercent = 0.0f; //residentBytes / memoryLimitBytes
+        uint64_t heapInUseBytes = 0; //allocator view: bytes handed out by malloc
+        uint64_t heapFreeBytes = 0; //allocator view: bytes malloc holds but isn't using
+    };
+
+    class ResourceSampler {
+    public:
+        ResourceSampler() {
+            #ifndef _WIN32
+                statFd = ::open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+                statmFd = ::open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+                ticksPerSecond = static_cast<double>(sysconf(_SC_CLK_TCK));
+                pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            #endif
+            refreshLimits();
+            lastCpuSeconds = processCpuSeconds();
+            lastWall = std::chrono::steady_clock::now();
+        }
+        ~ResourceSampler() {
+            #ifndef _WIN32
+                if (statFd >= 0) ::close(statFd);
+                if (statmFd >= 0) ::close(statmFd);
+            #endif
+        }
+        ResourceSampler(const ResourceSampler&) = delete;
+        ResourceSampler& operator=(const ResourceSampler&) = delete;
+
+        //only one thread should call sample(), cpu% is measured since that thread's previous call
+        ResourceSample sample() {
+            if (++samplesSinceRefresh >= LIMIT_REFRESH_SAMPLES) { //quotas and affinity can change at runtime (kubectl, taskset)
+                refreshLimits();
+                samplesSinceRefresh = 0;
+            }
+            ResourceSample out;
+            auto now = std::chrono::steady_clock::now();
+            double cpuSeconds = processCpuSeconds();
+            double wallSeconds = std::chrono::duration<double>(now - lastWall).count();
+            if (wallSeconds > 0.0 && cpuSeconds >= lastCpuSeconds) {
+                double percent = (cpuSeconds - lastCpuSeconds) / (wallSeconds * availableCores) * 100.0;
+                out.cpuPercent = static_cast<float>(std::clamp(percent, 0.0, 100.0));
+            }
+            lastCpuSeconds = cpuSeconds;
+            lastWall = now;
+
+            out.availableCores = static_cast<float>(availableCores);
+            out.residentBytes = residentBytes();
+            out.memoryLimitBytes = memoryLimitBytes;
+            if (memoryLimitBytes > 0) {
+                out.memoryPercent = static_cast<float>(static_cast<double>(out.residentBytes) / static_cast<double>(memoryLimitBytes) * 100.0);
+            }
+            readHeapStats(out);
+            return out;
+        }
+
+    private:
+        static constexpr int LIMIT_REFRESH_SAMPLES = 120; //once a minute at the 500ms interval
+        double availableCores = 1.0;
+        uint64_t memoryLimitBytes = 0;
+        double lastCpuSeconds = 0.0;
+        std::chrono::steady_clock::time_point lastWall;
+        int samplesSinceRefresh = 0;
+
+    #ifdef _WIN32
+        void refreshLimits() {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            availableCores = std::max<double>(1.0, info.dwNumberOfProcessors);
+            MEMORYSTATUSEX status;
+            status.dwLength = sizeof(status);
+            if (GlobalMemoryStatusEx(&status)) {
+                memoryLimitBytes = static_cast<uint64_t>(status.ullTotalPhys);
+            }
+        }
+        double processCpuSeconds() {
+            FILETIME creation, exitTime, kernel, user;
+            if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user)) return lastCpuSeconds;
+            auto toSeconds = [](const FILETIME& time) {
+                return static_cast<double>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7; //100ns units
+            };
+            return toSeconds(kernel) + toSeconds(user);
+        }
+        uint64_t residentBytes() {
+            PROCESS_MEMORY_COUNTERS pmc;
+            if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+                return static_cast<uint64_t>(pmc.WorkingSetSize);
+            }
+            return 0;
+        }
+        void readHeapStats(ResourceSample&) {} //no cheap equivalent of mallinfo on windows
+    #else
+        int statFd = -1;
+        int statmFd = -1;
+        double ticksPerSecond = 100.0;
+        uint64_t pageSize = 4096;
+
+        //reads a small file from the start into buffer, returns false if it couldn't be read
+        static bool readAt(int fd, char* buffer, size_t capacity) {
+            if (fd < 0) return false;
+            ssize_t length = ::pread(fd, buffer, capacity - 1, 0);
+            if (length <= 0) return false;
+            buffer[length] = '\0';
+            return true;
+        }
+        static bool readFile(const char* path, char* buffer, size_t capacity) {
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            bool ok = readAt(fd, buffer, capacity);
+            if (fd >= 0) ::close(fd);
+            return ok;
+        }
+
+        void refreshLimits() {
+            //cores this process may be scheduled on
+            double cores = 0.0;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+                cores = CPU_COUNT(&set);
+            }
+            if (cores <= 0.0) {
+                cores = static_cast<double>(std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)));
+            }
+            //cgroup cpu quota, v2 then v1
+            char buffer[256];
+            double quotaCores = 0.0;
+            if (readFile("/sys/fs/cgroup/cpu.max", buffer, sizeof(buffer))) {
+                //"max 100000" means no limit, otherwise "<quota> <period>"
+                if (std::strncmp(buffer, "max", 3) != 0) {
+                    double quota = 0.0, period = 0.0;
+                    if (std::sscanf(buffer, "%lf %lf", &quota, &period) == 2 && quota > 0.0 && period > 0.0) {
+                        quotaCores = quota / period;
+                    }
+                }
+            } else {
+                char periodBuffer[64];
+                if (readFile("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", buffer, sizeof(buffer)) &&
+                    readFile("/sys/fs/cgroup/cpu/cpu.cfs_period_us", periodBuffer, sizeof(periodBuffer))) {
+                    double quota = std::atof(buffer); //-1 when there's no quota
+                    double period = std::atof(periodBuffer);
+                    if (quota > 0.0 && period > 0.0) {
+                        quotaCores = quota / period;
+                    }
+                }
+            }
+            if (quotaCores > 0.0) {
+                cores = std::min(cores, quotaCores);
+            }
+            availableCores = std::max(cores, 0.01);
+
+            //memory limit: cgroup v2, cgroup v1, then physical memory
+            uint64_t limit = 0;
+            if (readFile("/sys/fs/cgroup/memory.max", buffer, sizeof(buffer)) && std::strncmp(buffer, "max", 3) != 0) {
+                limit = std::strtoull(buffer, nullptr, 10);
+            } else if (readFile("/sys/fs/cgroup/memory/memory.limit_in_bytes", buffer, sizeof(buffer))) {
+                limit = std::strtoull(buffer, nullptr, 10); //an unlimited v1 group reports a huge number, capped below
+            }
+            uint64_t physical = static_cast<uint64_t>(sysconf(_SC_PHYS_PAGES)) * pageSize;
+            if (limit == 0 || (physical > 0 && limit > physical)) {
+                limit = physical;
+            }
+            memoryLimitBytes = limit;
+        }
+
+        double processCpuSeconds() {
+            char buffer[1024];
+            if (!readAt(statFd, buffer, sizeof(buffer))) return lastCpuSeconds;
+            //the command name (field 2) is in parentheses and may contain spaces, so fields are counted from the last ')'
+            const char* cursor = std::strrchr(buffer, ')');
+            if (!cursor) return lastCpuSeconds;
+            cursor++;
+            unsigned long long utime = 0, stime = 0;
+            //after ')' come field 3 (state) ... field 14 utime, field 15 stime
+            int matched = std::sscanf(cursor, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime);
+            if (matched != 2) return lastCpuSeconds;
+            return static_cast<double>(utime + stime) / ticksPerSecond;
+        }
+        uint64_t residentBytes() {
+            char buffer[128];
+            if (!readAt(statmFd, buffer, sizeof(buffer))) return 0;
+            unsigned long long sizePages = 0, residentPages = 0;
+            if (std::sscanf(buffer, "%llu %llu", &sizePages, &residentPages) != 2) return 0;
+            return static_cast<uint64_t>(residentPages) * pageSize;
+        }
+        void readHeapStats(ResourceSample& out) {
+            #if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+                struct mallinfo2 info = mallinfo2();
+                out.heapInUseBytes = static_cast<uint64_t>(info.uordblks) + static_cast<uint64_t>(info.hblkhd); //arena + mmapped chunks
+                out.heapFreeBytes = static_cast<uint64_t>(info.fordblks);
+            #else
+                (void)out;
+            #endif
+        }
+    #endif
+    };
+
+} //end of namespace CoreSystems
@@ -0,0 +1,493 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "embedding-store.hpp" //detail::cpuHasAvx2, the same runtime check the embedding kernels use
+#include "metrics.hpp"
+#include "tokenizer.hpp"
+//in-process query encoder: the MiniLM-L6 sentence embedding weaviate's t2v-transformers module runs (multi-qa-MiniLM-L6-cos-v1 in docker-compose.yml), on the cpu
+//summary:
+//a search's level-1 nearText makes weaviate call the transformer container over http to embed the query,
+//with a local encoder the backend embeds the query itself and sends nearVector, one network hop and one python inference fewer
+//MiniLmModel is a 6 layer bert encoder (hidden 384, 12 heads, ffn 1536), mean pooled and L2 normalized like sentence-transformers
+//every linear layer is int8: weights per output row (scale = max |w| / 127), activations per token when the layer runs,
+//the products are summed in int32 (AVX2 madd when the cpu has it, the same integer math in scalar code otherwise)
+//one query runs on the calling thread, queries per core is what matters here, there is no intra-query threading
+//the weights file is written by scripts/export-minilm.py from the huggingface checkpoint, vocab.txt is inside it
+//QueryEncoder adds an LRU cache of finished embeddings keyed by the tokenizer's normalized text
+//
+//file layout (little endian):
+//  "PLTMLM01", uint32 vocabSize, hidden, layers, heads, intermediate, maxPositions, typeVocabSize, float layerNormEps,
+//  uint32 vocab bytes + vocab.txt,
+//  word embeddings (int8 matrix), position embeddings (float), token type embeddings (float), embedding layernorm,
+//  then per layer: qkv (int8 matrix, q k v stacked), attention output (int8 matrix), layernorm, ffn in, ffn out, layernorm
+//  int8 matrix = rows*cols int8, rows float scales, rows float biases (no biases for word embeddings)
+//  layernorm = hidden float gammas, hidden float betas
+
+namespace CoreSystems {
+
+    namespace detail {
+        //int8 matrix, rows padded with zeros to a multiple of 16 columns so the kernel never needs a tail loop
+        struct Int8Rows {
+            size_t rows = 0;
+            size_t cols = 0;
+            size_t stride = 0; //cols rounded up to 16
+            std::vector<int8_t> values;
+            std::vector<float> scales; //value * scale is the real weight
+
+            void resize(size_t rowCount, size_t colCount) {
+                rows = rowCount;
+                cols = colCount;
+                stride = (colCount + 15) / 16 * 16;
+                values.assign(rows * stride, 0);
+                scales.assign(rows, 1.0f);
+            }
+            const int8_t* row(size_t r) const { return values.data() + r * stride; }
+            int8_t* row(size_t r) { return values.data() + r * stride; }
+        };
+        //a layer's input quantized per token, already widened to int16 since every weight row is multiplied with it
+        struct ActivationRows {
+            size_t stride = 0;
+            std::vector<int16_t> values;
+            std::vector<float> scales;
+
+            const int16_t* row(size_t r) const { return values.data() + r * stride; }
+            void quantize(const float* input, size_t rowCount, size_t colCount) {
+                stride = (colCount + 15) / 16 * 16;
+                values.assign(rowCount * stride, 0);
+                scales.resize(rowCount);
+                for (size_t r = 0; r < rowCount; r++) {
+                    const float* source = input + r * colCount;
+                    float largest = 0.0f;
+                    for (size_t c = 0; c < colCount; c++) largest = std::max(largest, std::fabs(source[c]));
+                    float scale = largest > 0.0f ? largest / 127.0f : 1.0f;
+                    float inverse = 1.0f / scale;
+                    int16_t* destination = values.data() + r * stride;
+                    for (size_t c = 0; c < colCount; c++) {
+                        destination[c] = static_cast<int16_t>(std::lrintf(std::clamp(source[c] * inverse, -127.0f, 127.0f)));
+                    }
+                    scales[r] = scale;
+                }
+            }
+        };
+
+        //out[t] = sum over i of activations[t][i] * weights[i], for up to 4 tokens so each weight row is read once per 4 tokens
+        using Int8GemmKernel = void (*)(const int16_t* const* activations, size_t tokenCount, const int8_t* weights,
+                                        size_t stride, int32_t* out);
+        inline void gemmRowScalar(const int16_t* const* activations, size_t tokenCount, const int8_t* weights, size_t stride, int32_t* out) {
+            for (size_t t = 0; t < tokenCount; t++) {
+                int32_t sum = 0;
+                for (size_t i = 0; i < stride; i++) sum += static_cast<int32_t>(activations[t][i]) * weights[i];
+                out[t] = sum;
+            }
+        }
+#if defined(PALETTE_EMBEDDING_AVX2)
+        __attribute__((target("avx2"))) inline int32_t horizontalSumEpi32(__m256i v) {
+            __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+            return _mm_cvtsi128_si32(sum);
+        }
+        //16 weights widened once, then one madd (16 products, summed in pairs into int32) per token
+        //|values| <= 127 so a pair is at most 32258 and a lane can't overflow for any row length the model has
+        __attribute__((target("avx2"))) inline void gemmRowAvx2(const int16_t* const* activations, size_t tokenCount,
+                                                                const int8_t* weights, size_t stride, int32_t* out) {
+            __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+            __m256i sum2 = _mm256_setzero_si256(), sum3 = _mm256_setzero_si256();
+            const int16_t* a0 = activations[0];
+            const int16_t* a1 = activations[tokenCount > 1 ? 1 : 0]; //missing tokens repeat the first, their sums are ignored
+            const int16_t* a2 = activations[tokenCount > 2 ? 2 : 0];
+            const int16_t* a3 = activations[tokenCount > 3 ? 3 : 0];
+            for (size_t i = 0; i < stride; i += 16) {
+                __m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i)));
+                sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(w, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a0 + i))));
+                sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(w, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a1 + i))));
+                sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(w, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a2 + i))));
+                sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(w, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a3 + i))));
+            }
+            int32_t sums[4] = {horizontalSumEpi32(sum0), horizontalSumEpi32(sum1), horizontalSumEpi32(sum2), horizontalSumEpi32(sum3)};
+            for (size_t t = 0; t < tokenCount; t++) out[t] = sums[t];
+        }
+#endif
+    } //end of namespace detail
+
+    class MiniLmModel {
+    public:
+        struct Config {
+            uint32_t vocabSize = 30522;
+            uint32_t hidden = 384;
+            uint32_t layers = 6;
+            uint32_t heads = 12;
+            uint32_t intermediate = 1536;
+            uint32_t maxPositions = 512;
+            uint32_t typeVocabSize = 2;
+            float layerNormEps = 1e-12f;
+        };
+        struct Linear {
+            detail::Int8Rows weights; //out x in
+            std::vector<float> bias;
+        };
+        struct LayerNorm {
+            std::vector<float> gamma;
+            std::vector<float> beta;
+        };
+        struct Layer {
+            Linear qkv; //3*hidden x hidden, q k v stacked
+            Linear attentionOut;
+            LayerNorm attentionNorm;
+            Linear ffnIn;
+            Linear ffnOut;
+            LayerNorm outputNorm;
+        };
+        struct Weights {
+            Config config;
+            std::string vocab;
+            detail::Int8Rows wordEmbeddings;
+            std::vector<float> positionEmbeddings; //maxPositions x hidden
+            std::vector<float> tokenTypeEmbeddings; //typeVocabSize x hidden
+            LayerNorm embeddingNorm;
+            std::vector<Layer> layers;
+        };
+
+        static Weights load(const std::string& path) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) throw std::runtime_error("can't open encoder weights " + path);
+            Reader reader{file, path};
+            char magic[8];
+            reader.bytes(magic, sizeof(magic));
+            if (std::memcmp(magic, "PLTMLM01", sizeof(magic)) != 0) throw std::runtime_error(path + " is not a palette MiniLM weights file");
+            Weights weights;
+            Config& config = weights.config;
+            config.vocabSize = reader.u32();
+            config.hidden = reader.u32();
+            config.layers = reader.u32();
+            config.heads = reader.u32();
+            config.intermediate = reader.u32();
+            config.maxPositions = reader.u32();
+            config.typeVocabSize = reader.u32();
+            config.layerNormEps = reader.f32();
+            if (config.hidden == 0 || config.heads == 0 || config.hidden % config.heads != 0 || config.layers == 0 ||
+                config.vocabSize == 0 || config.maxPositions < 2 || config.typeVocabSize == 0 || config.intermediate == 0) {
+                throw std::runtime_error(path + " has an invalid model config");
+            }
+            weights.vocab.resize(reader.u32());
+            reader.bytes(weights.vocab.data(), weights.vocab.size());
+            reader.matrix(weights.wordEmbeddings, config.vocabSize, config.hidden, nullptr);
+            weights.positionEmbeddings = reader.floats(static_cast<size_t>(config.maxPositions) * config.hidden);
+            weights.tokenTypeEmbeddings = reader.floats(static_cast<size_t>(config.typeVocabSize) * config.hidden);
+            weights.embeddingNorm = reader.layerNorm(config.hidden);
+            weights.layers.resize(config.layers);
+            for (Layer& layer : weights.layers) {
+                reader.matrix(layer.qkv.weights, 3 * config.hidden, config.hidden, &layer.qkv.bias);
+                reader.matrix(layer.attentionOut.weights, config.hidden, config.hidden, &layer.attentionOut.bias);
+                layer.attentionNorm = reader.layerNorm(config.hidden);
+                reader.matrix(layer.ffnIn.weights, config.intermediate, config.hidden, &layer.ffnIn.bias);
+                reader.matrix(layer.ffnOut.weights, config.hidden, config.intermediate, &layer.ffnOut.bias);
+                layer.outputNorm = reader.layerNorm(config.hidden);
+            }
+            return weights;
+        }
+
+        explicit MiniLmModel(Weights modelWeights) : weights(std::move(modelWeights)) {
+            kernel = detail::gemmRowScalar;
+#if defined(PALETTE_EMBEDDING_AVX2)
+            if (detail::cpuHasAvx2()) kernel = detail::gemmRowAvx2;
+#endif
+        }
+
+        const Config& config() const { return weights.config; }
+        const std::string& vocab() const { return weights.vocab; }
+        size_t dimension() const { return weights.config.hidden; }
+        size_t maxTokens() const { return weights.config.maxPositions; }
+        bool usesSimd() const { return kernel != detail::gemmRowScalar; }
+
+        //unit length sentence embedding of tokenIds ([CLS] ... [SEP]), out gets dimension() floats
+        //safe to call from any number of threads, scratch space is per thread
+        void encode(const std::vector<int32_t>& tokenIds, float* out) const {
+            const Config& config = weights.config;
+            const size_t hidden = config.hidden;
+            const size_t tokens = std::min(tokenIds.size(), static_cast<size_t>(config.maxPositions));
+            Scratch& scratch = threadScratch();
+            scratch.prepare(tokens, config);
+
+            //embeddings: word + position + token type 0, then layernorm
+            float* x = scratch.hidden.data();
+            for (size_t t = 0; t < tokens; t++) {
+                int32_t id = tokenIds[t];
+                if (id < 0 || static_cast<uint32_t>(id) >= config.vocabSize) id = 0;
+                const int8_t* word = weights.wordEmbeddings.row(static_cast<size_t>(id));
+                float wordScale = weights.wordEmbeddings.scales[static_cast<size_t>(id)];
+                const float* position = weights.positionEmbeddings.data() + t * hidden;
+                float* row = x + t * hidden;
+                for (size_t i = 0; i < hidden; i++) {
+                    row[i] = static_cast<float>(word[i]) * wordScale + position[i] + weights.tokenTypeEmbeddings[i];
+                }
+                layerNorm(row, weights.embeddingNorm, hidden, config.layerNormEps);
+            }
+
+            const size_t heads = config.heads;
+            const size_t headSize = hidden / heads;
+            const float attentionScale = 1.0f / std::sqrt(static_cast<float>(headSize));
+            for (const Layer& layer : weights.layers) {
+                //self attention
+                linear(layer.qkv, x, tokens, scratch.qkv.data(), scratch);
+                for (size_t h = 0; h < heads; h++) {
+                    for (size_t q = 0; q < tokens; q++) {
+                        const float* query = scratch.qkv.data() + q * 3 * hidden + h * headSize;
+                        float* scores = scratch.scores.data();
+                        float largest = -INFINITY;
+                        for (size_t k = 0; k < tokens; k++) {
+                            const float* key = scratch.qkv.data() + k * 3 * hidden + hidden + h * headSize;
+                            float dot = 0.0f;
+                            for (size_t d = 0; d < headSize; d++) dot += query[d] * key[d];
+                            scores[k] = dot * attentionScale;
+                            largest = std::max(largest, scores[k]);
+                        }
+                        float total = 0.0f;
+                        for (size_t k = 0; k < tokens; k++) {
+                            scores[k] = std::exp(scores[k] - largest);
+                            total += scores[k];
+                        }
+                        float* context = scratch.context.data() + q * hidden + h * headSize;
+                        std::fill(context, context + headSize, 0.0f);
+                        for (size_t k = 0; k < tokens; k++) {
+                            const float* value = scratch.qkv.data() + k * 3 * hidden + 2 * hidden + h * headSize;
+                            float weight = scores[k] / total;
+                            for (size_t d = 0; d < headSize; d++) context[d] += weight * value[d];
+                        }
+                    }
+                }
+                linear(layer.attentionOut, scratch.context.data(), tokens, scratch.projected.data(), scratch);
+                for (size_t t = 0; t < tokens; t++) {
+                    float* row = x + t * hidden;
+                    const float* projected = scratch.projected.data() + t * hidden;
+                    for (size_t i = 0; i < hidden; i++) row[i] += projected[i];
+                    layerNorm(row, layer.attentionNorm, hidden, config.layerNormEps);
+                }
+                //feed forward, exact (erf) gelu like bert
+                linear(layer.ffnIn, x, tokens, scratch.intermediate.data(), scratch);
+                for (size_t i = 0; i < tokens * config.intermediate; i++) {
+                    float v = scratch.intermediate[i];
+                    scratch.intermediate[i] = 0.5f * v * (1.0f + std::erf(v * 0.70710678f));
+                }
+                linear(layer.ffnOut, scratch.intermediate.data(), tokens, scratch.projected.data(), scratch);
+                for (size_t t = 0; t < tokens; t++) {
+                    float* row = x + t * hidden;
+                    const float* projected = scratch.projected.data() + t * hidden;
+                    for (size_t i = 0; i < hidden; i++) row[i] += projected[i];
+                    layerNorm(row, layer.outputNorm, hidden, config.layerNormEps);
+                }
+            }
+
+            //mean over every token (a single unpadded sequence, so the attention mask is all ones), then unit length
+            std::fill(out, out + hidden, 0.0f);
+            for (size_t t = 0; t < tokens; t++) {
+                for (size_t i = 0; i < hidden; i++) out[i] += x[t * hidden + i];
+            }
+            double norm = 0.0;
+            for (size_t i = 0; i < hidden; i++) norm += static_cast<double>(out[i]) * out[i];
+            float inverse = norm > 0.0 ? static_cast<float>(1.0 / std::sqrt(norm)) : 0.0f;
+            for (size_t i = 0; i < hidden; i++) out[i] *= inverse;
+        }
+
+    private:
+        Weights weights;
+        detail::Int8GemmKernel kernel;
+
+        struct Scratch {
+            std::vector<float> hidden, qkv, context, projected, intermediate, scores;
+            detail::ActivationRows activations;
+            void prepare(size_t tokens, const Config& config) {
+                hidden.resize(tokens * config.hidden);
+                qkv.resize(tokens * 3 * config.hidden);
+                context.resize(tokens * config.hidden);
+                projected.resize(tokens * config.hidden);
+                intermediate.resize(tokens * config.intermediate);
+                scores.resize(tokens);
+            }
+        };
+        static Scratch& threadScratch() {
+            thread_local Scratch scratch;
+            return scratch;
+        }
+
+        //out (tokens x rows) = input (tokens x cols) * weights^T + bias, with input quantized per token first
+        void linear(const Linear& layer, const float* input, size_t tokens, float* out, Scratch& scratch) const {
+            const detail::Int8Rows& w = layer.weights;
+            detail::ActivationRows& a = scratch.activations;
+            a.quantize(input, tokens, w.cols);
+            for (size_t t0 = 0; t0 < tokens; t0 += 4) {
+                size_t count = std::min<size_t>(4, tokens - t0);
+                const int16_t* rows[4];
+                for (size_t k = 0; k < count; k++) rows[k] = a.row(t0 + k);
+                for (size_t o = 0; o < w.rows; o++) {
+                    int32_t sums[4];
+                    kernel(rows, count, w.row(o), w.stride, sums);
+                    for (size_t k = 0; k < count; k++) {
+                        out[(t0 + k) * w.rows + o] = static_cast<float>(sums[k]) * a.scales[t0 + k] * w.scales[o] + layer.bias[o];
+                    }
+                }
+            }
+        }
+        static void layerNorm(float* row, const LayerNorm& norm, size_t size, float eps) {
+            float mean = 0.0f;
+            for (size_t i = 0; i < size; i++) mean += row[i];
+            mean /= static_cast<float>(size);
+            float variance = 0.0f;
+            for (size_t i = 0; i < size; i++) variance += (row[i] - mean) * (row[i] - mean);
+            variance /= static_cast<float>(size);
+            float inverse = 1.0f / std::sqrt(variance + eps);
+            for (size_t i = 0; i < size; i++) row[i] = (row[i] - mean) * inverse * norm.gamma[i] + norm.beta[i];
+        }
+
+        struct Reader {
+            std::ifstream& file;
+            const std::string& path;
+            void bytes(void* destination, size_t size) {
+                if (!file.read(static_cast<char*>(destination), static_cast<std::streamsize>(size))) {
+                    throw std::runtime_error(path + " is truncated");
+                }
+            }
+            uint32_t u32() { uint32_t value; bytes(&value, 4); return value; }
+            float f32() { float value; bytes(&value, 4); return value; }
+            std::vector<float> floats(size_t count) {
+                std::vector<float> values(count);
+                bytes(values.data(), count * sizeof(float));
+                return values;
+            }
+            void matrix(detail::Int8Rows& rows, size_t rowCount, size_t colCount, std::vector<float>* bias) {
+                rows.resize(rowCount, colCount);
+                for (size_t r = 0; r < rowCount; r++) {
+                    bytes(rows.row(r), colCount);
+                }
+                bytes(rows.scales.data(), rowCount * sizeof(float));
+                if (bias) *bias = floats(rowCount);
+            }
+            LayerNorm layerNorm(size_t size) {
+                LayerNorm norm;
+                norm.gamma = floats(size);
+                norm.beta = floats(size);
+                return norm;
+            }
+        };
+    };
+
+    //finished query embeddings by normalized text, least recently used ones dropped past capacity
+    class QueryEmbeddingCache {
+    public:
+        explicit QueryEmbeddingCache(size_t capacity) : capacity(capacity) {
+            metrics::Labels labels = {{"cache", "query_embedding"}};
+            auto& registry = metrics::Registry::instance();
+            hits = &registry.counter("palette_cache_hits_total", "Cache lookups that found a usable entry", labels);
+            misses = &registry.counter("palette_cache_misses_total", "Cache lookups that found nothing usable", labels);
+            evictions = &registry.counter("palette_cache_evictions_total", "Entries removed because the cache was full", labels);
+            entries = &registry.gauge("palette_cache_entries", "Entries currently in the cache", labels);
+        }
+        bool lookup(const std::string& key, std::vector<float>& out) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = index.find(key);
+            if (found == index.end()) {
+                misses->inc();
+                return false;
+            }
+            order.splice(order.begin(), order, found->second); //most recently used first
+            out = found->second->second;
+            hits->inc();
+            return true;
+        }
+        void store(const std::string& key, const std::vector<float>& embedding) {
+            if (capacity == 0) return;
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = index.find(key);
+            if (found != index.end()) {
+                order.splice(order.begin(), order, found->second);
+                return;
+            }
+            order.emplace_front(key, embedding);
+            index.emplace(order.front().first, order.begin());
+            if (order.size() > capacity) {
+                index.erase(order.back().first);
+                order.pop_back();
+                evictions->inc();
+            }
+            entries->set(static_cast<int64_t>(order.size()));
+        }
+
+    private:
+        using Entry = std::pair<std::string, std::vector<float>>;
+        size_t capacity;
+        std::mutex mutex;
+        std::list<Entry> order;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index; //keys point into order's strings
+        metrics::Counter* hits;
+        metrics::Counter* misses;
+        metrics::Counter* evictions;
+        metrics::Gauge* entries;
+    };
+
+    //tokenizer + model + cache, shared by every VectorEngine
+    class QueryEncoder {
+    public:
+        static constexpr size_t DEFAULT_CACHE_ENTRIES = 8192;
+        static constexpr size_t MAX_QUERY_TOKENS = 128; //search phrases are a few words, this only bounds pathological input
+
+        QueryEncoder(MiniLmModel::Weights weights, size_t cacheEntries = DEFAULT_CACHE_ENTRIES)
+            : model(std::move(weights)), tokenizer(model.vocab()), cache(cacheEntries),
+              inferenceLatency(metrics::Registry::instance().histogram("palette_encoder_inference_duration_seconds",
+                  "Time to run the local query encoder on one cache miss")) {
+            if (!tokenizer.valid()) throw std::runtime_error("encoder vocab is missing [CLS], [SEP] or [UNK]");
+            if (tokenizer.vocabSize() != model.config().vocabSize) throw std::runtime_error("encoder vocab size doesn't match the model");
+        }
+        //from PALETTE_LOCAL_ENCODER (weights file) and PALETTE_LOCAL_ENCODER_CACHE (entries), nothing if the path isn't set
+        //throws if it is set but the file can't be loaded
+        static std::shared_ptr<QueryEncoder> fromEnvironment() {
+            const char* path = std::getenv("PALETTE_LOCAL_ENCODER");
+            if (!path || !*path) return nullptr;
+            size_t cacheEntries = DEFAULT_CACHE_ENTRIES;
+            if (const char* configured = std::getenv("PALETTE_LOCAL_ENCODER_CACHE")) {
+                cacheEntries = static_cast<size_t>(std::max(0L, std::atol(configured)));
+            }
+            return std::make_shared<QueryEncoder>(MiniLmModel::load(path), cacheEntries);
+        }
+
+        size_t dimension() const { return model.dimension(); }
+        bool usesSimd() const { return model.usesSimd(); }
+        //unit length embedding of text, empty if text normalizes to nothing
+        std::vector<float> encode(std::string_view text) {
+            std::string normalized = WordPieceTokenizer::normalize(text);
+            std::vector<float> embedding;
+            if (normalized.empty()) return embedding;
+            if (cache.lookup(normalized, embedding)) return embedding;
+            auto started = std::chrono::steady_clock::now();
+            thread_local std::vector<int32_t> tokenIds;
+            tokenizer.tokenize(normalized, std::min(MAX_QUERY_TOKENS, model.maxTokens()), tokenIds);
+            embedding.resize(model.dimension());
+            model.encode(tokenIds, embedding.data());
+            inferenceLatency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - started).count()));
+            cache.store(normalized, embedding);
+            return embedding;
+        }
+
+    private:
+        MiniLmModel model;
+        WordPieceTokenizer tokenizer;
+        QueryEmbeddingCache cache;
+        LatencyHistogram& inferenceLatency;
+    };
+
+} //end of namespace CoreSystems
@@ -0,0 +1,224 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+//bert's uncased wordpiece tokenizer, what the MiniLM query encoder was trained with
+//summary:
+//normalize() is bert's basic tokenizer up to the split: drops control chars, lowercases, strips accents, pads CJK
+//and punctuation with spaces and collapses whitespace, so equal queries normalize to the same string (the embedding cache key)
+//tokenize() splits the normalized text on spaces and runs greedy longest-match-first wordpiece over each word
+//unicode handling is table driven rather than a full unicode database:
+//  accents are folded for Latin-1 and Latin Extended-A, combining marks (U+0300-U+036F) are dropped,
+//  Greek and Cyrillic capitals are lowercased, other scripts pass through unchanged (most have no case)
+//  punctuation is ASCII, the Latin-1 punctuation marks, General Punctuation, CJK punctuation and the fullwidth forms
+//ids are vocab line numbers, the vocab is the model's vocab.txt one token per line
+
+namespace CoreSystems {
+
+    class WordPieceTokenizer {
+    public:
+        static constexpr size_t MAX_WORD_CHARS = 100; //longer words become [UNK] without trying, like bert
+
+        //vocabText is vocab.txt, one token per line
+        explicit WordPieceTokenizer(std::string vocabText) : vocab(std::move(vocabText)) {
+            size_t start = 0;
+            int32_t id = 0;
+            while (start < vocab.size()) {
+                size_t end = vocab.find('\n', start);
+                if (end == std::string::npos) end = vocab.size();
+                size_t length = end - start;
+                if (length > 0 && vocab[start + length - 1] == '\r') length--;
+                ids.emplace(std::string_view(vocab).substr(start, length), id++);
+                start = end + 1;
+            }
+            lineCount = static_cast<size_t>(id);
+            clsId = idOf("[CLS]");
+            sepId = idOf("[SEP]");
+            unknownId = idOf("[UNK]");
+        }
+        WordPieceTokenizer(const WordPieceTokenizer&) = delete; //ids point into vocab
+        WordPieceTokenizer& operator=(const WordPieceTokenizer&) = delete;
+
+        size_t vocabSize() const { return lineCount; } //a duplicated token keeps its first id but still takes a line
+        bool valid() const { return clsId >= 0 && sepId >= 0 && unknownId >= 0; }
+        int32_t idOf(std::string_view token) const {
+            auto found = ids.find(token);
+            return found == ids.end() ? -1 : found->second;
+        }
+
+        //cleaned, lowercased, accent-free text with single spaces between words, punctuation and CJK chars
+        static std::string normalize(std::string_view text) {
+            std::string out;
+            out.reserve(text.size() + 8);
+            bool pendingSpace = false;
+            auto appendWord = [&](uint32_t codePoint) {
+                if (pendingSpace && !out.empty()) out.push_back(' ');
+                pendingSpace = false;
+                appendUtf8(out, codePoint);
+            };
+            size_t i = 0;
+            while (i < text.size()) {
+                uint32_t codePoint = decodeUtf8(text, i);
+                if (codePoint == 0 || codePoint == 0xFFFD || isControl(codePoint)) continue;
+                if (isWhitespace(codePoint)) {
+                    pendingSpace = true;
+                    continue;
+                }
+                if (codePoint >= 0x300 && codePoint <= 0x36F) continue; //combining accent, what NFD + strip removes
+                codePoint = foldCase(codePoint);
+                if (codePoint == 0) continue;
+                if (isPunctuation(codePoint) || isCjk(codePoint)) { //a word of its own
+                    pendingSpace = true;
+                    appendWord(codePoint);
+                    pendingSpace = true;
+                    continue;
+                }
+                if (codePoint < 0x80 && codePoint >= 'A' && codePoint <= 'Z') codePoint += 'a' - 'A';
+                appendWord(codePoint);
+            }
+            return out;
+        }
+
+        //[CLS] wordpieces [SEP] for already normalized text, cut to maxTokens (which keeps the [SEP])
+        void tokenize(std::string_view normalized, size_t maxTokens, std::vector<int32_t>& out) const {
+            out.clear();
+            out.push_back(clsId);
+            std::string piece; //"##" + suffix, reused
+            size_t start = 0;
+            while (start < normalized.size() && out.size() + 1 < maxTokens) {
+                size_t end = normalized.find(' ', start);
+                if (end == std::string_view::npos) end = normalized.size();
+                if (end > start) {
+                    wordPieces(normalized.substr(start, end - start), maxTokens - 1, piece, out);
+                }
+                start = end + 1;
+            }
+            if (out.size() > maxTokens - 1) out.resize(maxTokens - 1);
+            out.push_back(sepId);
+        }
+        std::vector<int32_t> tokenize(std::string_view text, size_t maxTokens) const {
+            std::vector<int32_t> out;
+            tokenize(normalize(text), maxTokens, out);
+            return out;
+        }
+
+    private:
+        std::string vocab;
+        std::unordered_map<std::string_view, int32_t> ids;
+        size_t lineCount = 0;
+        int32_t clsId = -1;
+        int32_t sepId = -1;
+        int32_t unknownId = -1;
+
+        //greedy longest match, a word with any unmatched part is a single [UNK]
+        void wordPieces(std::string_view word, size_t limit, std::string& piece, std::vector<int32_t>& out) const {
+            size_t chars = 0;
+            for (unsigned char c : word) chars += (c & 0xC0) != 0x80;
+            if (chars > MAX_WORD_CHARS) {
+                out.push_back(unknownId);
+                return;
+            }
+            size_t firstPiece = out.size();
+            size_t start = 0;
+            while (start < word.size()) {
+                size_t end = word.size();
+                int32_t match = -1;
+                while (end > start) {
+                    std::string_view candidate = word.substr(start, end - start);
+                    if (start == 0) {
+                        match = idOf(candidate);
+                    } else {
+                        piece.assign("##");
+                        piece.append(candidate);
+                        match = idOf(piece);
+                    }
+                    if (match >= 0) break;
+                    do { end--; } while (end > start && (static_cast<unsigned char>(word[end]) & 0xC0) == 0x80); //back one utf-8 char
+                }
+                if (match < 0) {
+                    out.resize(firstPiece);
+                    out.push_back(unknownId);
+                    return;
+                }
+                if (out.size() < limit) out.push_back(match);
+                start = end;
+            }
+        }
+
+        //invalid sequences decode to U+FFFD, which normalize() drops
+        static uint32_t decodeUtf8(std::string_view text, size_t& i) {
+            unsigned char lead = static_cast<unsigned char>(text[i++]);
+            if (lead < 0x80) return lead;
+            int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+            if (extra < 0 || lead > 0xF4) return 0xFFFD;
+            uint32_t codePoint = lead & (0x3F >> extra);
+            for (int k = 0; k < extra; k++) {
+                if (i >= text.size() || (static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) return 0xFFFD;
+                codePoint = (codePoint << 6) | (static_cast<unsigned char>(text[i++]) & 0x3F);
+            }
+            return codePoint;
+        }
+        static void appendUtf8(std::string& out, uint32_t codePoint) {
+            if (codePoint < 0x80) {
+                out.push_back(static_cast<char>(codePoint));
+            } else if (codePoint < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+                out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            } else if (codePoint < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            } else {
+                out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+            }
+        }
+        static bool isWhitespace(uint32_t c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == 0xA0 || c == 0x1680 ||
+                   (c >= 0x2000 && c <= 0x200A) || c == 0x202F || c == 0x205F || c == 0x3000;
+        }
+        static bool isControl(uint32_t c) {
+            if (c == '\t' || c == '\n' || c == '\r') return false; //whitespace
+            return c < 0x20 || (c >= 0x7F && c < 0xA0) || c == 0xAD || (c >= 0x200B && c <= 0x200F) || c == 0xFEFF;
+        }
+        static bool isPunctuation(uint32_t c) {
+            if ((c >= 33 && c <= 47) || (c >= 58 && c <= 64) || (c >= 91 && c <= 96) || (c >= 123 && c <= 126)) return true;
+            if (c == 0xA1 || c == 0xA7 || c == 0xAB || c == 0xB6 || c == 0xB7 || c == 0xBB || c == 0xBF) return true;
+            if ((c >= 0x2010 && c <= 0x2027) || (c >= 0x2030 && c <= 0x205E)) return true;
+            if ((c >= 0x3001 && c <= 0x3003) || (c >= 0x3008 && c <= 0x3011) || (c >= 0x3014 && c <= 0x301F)) return true;
+            return (c >= 0xFF01 && c <= 0xFF0F) || (c >= 0xFF1A && c <= 0xFF20) || (c >= 0xFF3B && c <= 0xFF40) ||
+                   (c >= 0xFF5B && c <= 0xFF65);
+        }
+        static bool isCjk(uint32_t c) {
+            return (c >= 0x4E00 && c <= 0x9FFF) || (c >= 0x3400 && c <= 0x4DBF) || (c >= 0x20000 && c <= 0x2A6DF) ||
+                   (c >= 0x2A700 && c <= 0x2CEAF) || (c >= 0xF900 && c <= 0xFAFF) || (c >= 0x2F800 && c <= 0x2FA1F);
+        }
+        //lowercase and accent-free form of a non-ASCII code point (ASCII is handled by the caller)
+        //table chars: a letter is the base letter, '*' keeps the code point, '+' is the next code point, '#' is 0x20 further
+        static uint32_t foldCase(uint32_t c) {
+            static constexpr char LATIN1[] =
+                "aaaaaa#ceeeeiiii" "#nooooo*#uuuuy#*" "aaaaaa*ceeeeiiii" "*nooooo**uuuuy*y"; //U+00C0-U+00FF
+            static constexpr char LATIN_EXTENDED_A[] =
+                "aaaaaaccccccccdd" "+*eeeeeeeeeegggg" "gggghh+*iiiiiiii" "i*+*jjkk*llllll+"
+                "*+*nnnnnn*+*oooo" "oo+*rrrrrrssssss" "sstttt+*uuuuuuuu" "uuuuwwyyyzzzzzz*"; //U+0100-U+017F
+            char rule = '*';
+            if (c >= 0xC0 && c <= 0xFF) rule = LATIN1[c - 0xC0];
+            else if (c >= 0x100 && c <= 0x17F) rule = LATIN_EXTENDED_A[c - 0x100];
+            else if (c >= 0x391 && c <= 0x3A9 && c != 0x3A2) return c + 0x20; //Greek capitals
+            else if (c >= 0x410 && c <= 0x42F) return c + 0x20; //Cyrillic capitals
+            else if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+            switch (rule) {
+                case '*': return c;
+                case '+': return c + 1;
+                case '#': return c + 0x20;
+                default: return static_cast<uint32_t>(rule);
+            }
+        }
+    };
+
+} //end of namespace CoreSystems
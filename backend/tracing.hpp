@@ -0,0 +1,328 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <random>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include "latency-histogram.hpp"
+#include "lock-free.hpp"
+//lightweight span tracing for the search path
+//summary:
+//a RequestTrace is created per request and carries a trace id plus the time spent in each PipelineStage
+//ScopedSpan times a block with steady_clock nanoseconds, spans nest through a thread-local stack
+//work handed to another thread (std::async) takes the TraceContext along so its spans land in the same trace
+//every finished span is also kept in its thread's SeqlockRing so recent activity can be exported as a Chrome trace (Perfetto)
+
+namespace CoreSystems {
+
+    //stages of a search, each one gets its own latency histogram in TelemetryProcessor
+    enum class PipelineStage {
+        CACHE_LOOKUP,           // checking the engine's search cache
+        QUERY_ENCODE,           // embedding the query with the local encoder (only when one is loaded)
+        WEAVIATE_LEVEL1,        // nearText (or nearVector) search for the query itself
+        WEAVIATE_LEVEL2,        // expansion of the top nodes, one batched nearVector request
+        PINTEREST_ENRICHMENT,   // fanning out pinterest lookups and collecting the futures (wall time)
+        PINTEREST_REQUEST,      // time inside each pinterest call, summed across the parallel futures
+        RESPONSE_BUILD,         // turning nodes into the graphql response
+        COUNT                   // number of stages, not a stage
+    };
+    static constexpr size_t PIPELINE_STAGE_COUNT = static_cast<size_t>(PipelineStage::COUNT);
+    inline std::string pipelineStageToString(PipelineStage stage) {
+        switch (stage) {
+            case PipelineStage::CACHE_LOOKUP: return "cache_lookup";
+            case PipelineStage::QUERY_ENCODE: return "query_encode";
+            case PipelineStage::WEAVIATE_LEVEL1: return "weaviate_level1";
+            case PipelineStage::WEAVIATE_LEVEL2: return "weaviate_level2";
+            case PipelineStage::PINTEREST_ENRICHMENT: return "pinterest_enrichment";
+            case PipelineStage::PINTEREST_REQUEST: return "pinterest_request";
+            case PipelineStage::RESPONSE_BUILD: return "response_build";
+            default: return "unknown";
+        }
+    };
+
+namespace tracing {
+
+    inline uint64_t nowNs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    inline std::string traceIdToString(uint64_t traceId) {
+        char text[17];
+        std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(traceId));
+        return std::string(text, 16);
+    }
+
+    //everything recorded about one request, shared by every thread that works on it
+    class RequestTrace {
+    public:
+        explicit RequestTrace(uint64_t traceId) : traceId(traceId) {}
+
+        static std::shared_ptr<RequestTrace> start() {
+            thread_local std::mt19937_64 generator{std::random_device{}() ^ nowNs()};
+            uint64_t id = generator();
+            return std::make_shared<RequestTrace>(id == 0 ? 1 : id);
+        }
+
+        void addStageTime(PipelineStage stage, uint64_t durationNs) {
+            size_t index = static_cast<size_t>(stage);
+            stageNs[index].fetch_add(durationNs, std::memory_order_relaxed);
+            stageCalls[index].fetch_add(1, std::memory_order_relaxed);
+        }
+        std::array<uint64_t, PIPELINE_STAGE_COUNT> stageBreakdownNs() const {
+            std::array<uint64_t, PIPELINE_STAGE_COUNT> out{};
+            for (size_t i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+                out[i] = stageNs[i].load(std::memory_order_relaxed);
+            }
+            return out;
+        }
+        std::array<uint32_t, PIPELINE_STAGE_COUNT> stageCallCounts() const {
+            std::array<uint32_t, PIPELINE_STAGE_COUNT> out{};
+            for (size_t i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+                out[i] = stageCalls[i].load(std::memory_order_relaxed);
+            }
+            return out;
+        }
+        uint64_t getTraceId() const { return traceId; }
+
+    private:
+        const uint64_t traceId;
+        std::array<std::atomic<uint64_t>, PIPELINE_STAGE_COUNT> stageNs{};
+        std::array<std::atomic<uint32_t>, PIPELINE_STAGE_COUNT> stageCalls{};
+    };
+
+    //what a thread needs to continue someone else's trace: the request and the span it was started from
+    struct TraceContext {
+        std::shared_ptr<RequestTrace> trace;
+        uint64_t parentSpanId = 0;
+    };
+
+    //a finished span as kept in the per-thread buffers, plain data so it fits in a SeqlockRing
+    struct SpanRecord {
+        const char* name; //string literal
+        const char* threadName; //string literal, whatever setThreadName last set on the recording thread
+        uint64_t traceId; //0 for work outside of a request (telemetry drain, health checks)
+        uint64_t spanId;
+        uint64_t parentSpanId;
+        uint64_t threadIndex;
+        uint64_t startNs;
+        uint64_t endNs;
+    };
+    static constexpr size_t SPAN_BUFFER_CAPACITY = 2048; //per thread, ~150KB each
+    using SpanBuffer = lockfree::SeqlockRing<SpanRecord, SPAN_BUFFER_CAPACITY>;
+
+    //owns every thread's span buffer, in an OwnedSlotPool so no step takes a lock
+    //a thread claims a free buffer when it records its first span and frees it when it exits,
+    //so the short-lived std::async threads of the pinterest fan-out reuse buffers instead of allocating them
+    //exporting walks the buffers and copies each ring with its seqlock, recording threads never wait on it
+    //a freed buffer's records stay readable until the next owner overwrites them
+    //past MAX_BUFFERS threads alive at once, a new thread's spans are dropped (and counted) rather than blocking
+    class SpanRegistry {
+    public:
+        static constexpr size_t MAX_BUFFERS = 1024;
+        using BufferPool = lockfree::OwnedSlotPool<SpanBuffer, MAX_BUFFERS>;
+
+        static SpanRegistry& instance() {
+            static SpanRegistry* registry = new SpanRegistry(); //leaked on purpose, thread_local destructors may run after static ones
+            return *registry;
+        }
+
+        //slot of a buffer the calling thread now owns, BufferPool::NONE if every buffer is taken
+        size_t acquire() { return pool.acquire(); }
+        void release(size_t slot) { pool.release(slot); }
+        SpanBuffer* buffer(size_t slot) const { return pool.get(slot); }
+        void countDropped() { droppedSpans.fetch_add(1, std::memory_order_relaxed); }
+
+        //every span that ended at or after sinceNs, across all threads, ordered by start time
+        std::vector<SpanRecord> collect(uint64_t sinceNs) const {
+            std::vector<SpanRecord> records;
+            std::vector<SpanRecord> scratch;
+            pool.forEach([&](const SpanBuffer& spans) {
+                scratch.clear();
+                spans.snapshot(scratch);
+                for (const SpanRecord& record : scratch) {
+                    if (record.endNs >= sinceNs) {
+                        records.push_back(record);
+                    }
+                }
+            });
+            std::sort(records.begin(), records.end(), [](const SpanRecord& a, const SpanRecord& b) {
+                return a.startNs < b.startNs;
+            });
+            return records;
+        }
+        size_t bufferCount() const { return pool.created(); }
+        uint64_t dropped() const { return droppedSpans.load(std::memory_order_relaxed); }
+
+    private:
+        SpanRegistry() = default;
+        BufferPool pool;
+        std::atomic<uint64_t> droppedSpans{0};
+    };
+
+    class ScopedSpan;
+    struct ThreadTraceState {
+        std::shared_ptr<RequestTrace> trace; //request this thread is working on, null outside of requests
+        ScopedSpan* currentSpan = nullptr; //top of this thread's span stack
+        uint64_t inheritedParentId = 0; //span that handed work to this thread (from TraceContext)
+        uint64_t threadIndex = 0;
+        uint64_t nextSpanSequence = 0;
+        const char* threadName = "thread";
+        SpanBuffer* spanBuffer = nullptr; //taken from the registry on the first finished span
+        size_t spanBufferSlot = SpanRegistry::BufferPool::NONE;
+        bool registryFull = false; //no buffer was free, this thread's spans are dropped instead of searching again per span
+
+        ThreadTraceState() = default;
+        ThreadTraceState(const ThreadTraceState&) = delete;
+        ThreadTraceState& operator=(const ThreadTraceState&) = delete;
+        ~ThreadTraceState() {
+            if (spanBuffer) {
+                SpanRegistry::instance().release(spanBufferSlot);
+            }
+        }
+        void record(const SpanRecord& span) {
+            if (!spanBuffer && !registryFull) {
+                spanBufferSlot = SpanRegistry::instance().acquire();
+                registryFull = spanBufferSlot == SpanRegistry::BufferPool::NONE;
+                if (!registryFull) spanBuffer = SpanRegistry::instance().buffer(spanBufferSlot);
+            }
+            if (!spanBuffer) {
+                SpanRegistry::instance().countDropped();
+                return;
+            }
+            spanBuffer->push(span);
+        }
+    };
+    inline ThreadTraceState& threadState() {
+        static std::atomic<uint64_t> nextThreadIndex{1};
+        thread_local ThreadTraceState state;
+        if (state.threadIndex == 0) {
+            state.threadIndex = nextThreadIndex.fetch_add(1, std::memory_order_relaxed);
+        }
+        return state;
+    }
+    //label for this thread's track in exported traces, must be a string literal
+    inline void setThreadName(const char* name) {
+        threadState().threadName = name;
+    }
+
+    //times the enclosing block, must be destroyed on the thread that created it (it's on that thread's span stack)
+    //if a stage is given the duration is added to the current request's breakdown and to histogram (if not null)
+    class ScopedSpan {
+    public:
+        explicit ScopedSpan(const char* name, PipelineStage stage = PipelineStage::COUNT, WindowedLatencyHistogram* histogram = nullptr)
+            : name(name), stage(stage), histogram(histogram) {
+            ThreadTraceState& state = threadState();
+            previous = state.currentSpan;
+            parentId = previous ? previous->id : state.inheritedParentId;
+            id = (state.threadIndex << 40) | (++state.nextSpanSequence & ((1ULL << 40) - 1));
+            state.currentSpan = this;
+            startNs = nowNs();
+        }
+        ~ScopedSpan() {
+            uint64_t endNs = nowNs();
+            uint64_t durationNs = endNs - startNs;
+            ThreadTraceState& state = threadState();
+            state.record(SpanRecord{name, state.threadName, state.trace ? state.trace->getTraceId() : 0,
+                                    id, parentId, state.threadIndex, startNs, endNs});
+            if (stage != PipelineStage::COUNT) {
+                if (state.trace) {
+                    state.trace->addStageTime(stage, durationNs);
+                }
+                if (histogram) {
+                    histogram->record(durationNs / 1000);
+                }
+            }
+            state.currentSpan = previous;
+        }
+        ScopedSpan(const ScopedSpan&) = delete;
+        ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+        uint64_t elapsedNs() const { return nowNs() - startNs; }
+        uint64_t spanId() const { return id; }
+        uint64_t parentSpanId() const { return parentId; }
+        const char* getName() const { return name; }
+
+    private:
+        const char* name; //string literal, spans don't own their names
+        PipelineStage stage;
+        WindowedLatencyHistogram* histogram;
+        ScopedSpan* previous = nullptr;
+        uint64_t id = 0;
+        uint64_t parentId = 0;
+        uint64_t startNs = 0;
+    };
+
+    //context to hand to another thread, captures the current request and innermost span
+    inline TraceContext currentContext() {
+        ThreadTraceState& state = threadState();
+        return TraceContext{state.trace, state.currentSpan ? state.currentSpan->spanId() : state.inheritedParentId};
+    }
+    inline std::shared_ptr<RequestTrace> currentTrace() {
+        return threadState().trace;
+    }
+
+    //makes this thread work on the given trace until the end of the scope, then restores what was there before
+    class ScopedContext {
+    public:
+        explicit ScopedContext(TraceContext context) {
+            ThreadTraceState& state = threadState();
+            previousTrace = std::move(state.trace);
+            previousParentId = state.inheritedParentId;
+            state.trace = std::move(context.trace);
+            state.inheritedParentId = context.parentSpanId;
+        }
+        explicit ScopedContext(std::shared_ptr<RequestTrace> trace) : ScopedContext(TraceContext{std::move(trace), 0}) {}
+        ~ScopedContext() {
+            ThreadTraceState& state = threadState();
+            state.trace = std::move(previousTrace);
+            state.inheritedParentId = previousParentId;
+        }
+        ScopedContext(const ScopedContext&) = delete;
+        ScopedContext& operator=(const ScopedContext&) = delete;
+
+    private:
+        std::shared_ptr<RequestTrace> previousTrace;
+        uint64_t previousParentId = 0;
+    };
+
+    //spans that ended in the last `window` as Chrome Trace Event JSON (loads in Perfetto and chrome://tracing)
+    //each thread is its own track, spans become complete ("X") events with their trace and parent ids as args
+    inline nlohmann::json chromeTraceJson(std::chrono::seconds window) {
+        uint64_t now = nowNs();
+        uint64_t windowNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(window).count());
+        std::vector<SpanRecord> records = SpanRegistry::instance().collect(now > windowNs ? now - windowNs : 0);
+
+        nlohmann::json events = nlohmann::json::array();
+        events.push_back({{"name", "process_name"}, {"ph", "M"}, {"pid", 1}, {"args", {{"name", "palette-backend"}}}});
+        std::unordered_set<uint64_t> namedThreads;
+        for (const SpanRecord& record : records) {
+            if (namedThreads.insert(record.threadIndex).second) {
+                events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", record.threadIndex},
+                                  {"args", {{"name", std::string(record.threadName) + " #" + std::to_string(record.threadIndex)}}}});
+            }
+            nlohmann::json args = {{"span_id", record.spanId}, {"parent_span_id", record.parentSpanId}};
+            if (record.traceId != 0) {
+                args["trace_id"] = traceIdToString(record.traceId);
+            }
+            events.push_back({
+                {"name", record.name},
+                {"cat", record.traceId != 0 ? "request" : "background"},
+                {"ph", "X"},
+                {"pid", 1},
+                {"tid", record.threadIndex},
+                {"ts", static_cast<double>(record.startNs) / 1000.0}, //chrome traces are in microseconds
+                {"dur", static_cast<double>(record.endNs - record.startNs) / 1000.0},
+                {"args", std::move(args)}
+            });
+        }
+        return nlohmann::json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}};
+    }
+
+} //end of namespace tracing
+} //end of namespace CoreSystems
@@ -0,0 +1,1024 @@
+//unit tests for the backend's self-contained pieces, built on googletest and run by ctest
+//summary:
+//the whole server is compiled in (http-server.cpp with PALETTE_NO_MAIN) like microbench, so these test the real code, not copies of it
+//nothing here talks to weaviate or pinterest, anything that needs an upstream is a load test against mock-upstream instead
+//
+//usage: unit-tests [--gtest_filter=<Suite.Name pattern>], or ctest from the build directory
+//a fix to one of these pieces should come with a case that fails without it
+#define PALETTE_NO_MAIN
+#include "http-server.cpp"
+#include <gtest/gtest.h>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+namespace UnitTests {
+
+    using namespace CoreSystems;
+
+    //--- query encoder (tokenizer.hpp, text-encoder.hpp) ---
+
+    //bert's special tokens first, then a few whole words and suffixes, then every ascii letter alone and as a suffix
+    std::string testVocab() {
+        std::string vocab = "[PAD]\n[UNK]\n[CLS]\n[SEP]\n[MASK]\n";
+        for (const char* word : {"the", "impression", "##ism", "art", "cubism", "water", "##color", "'", ",", "!",
+                                 "paint", "##ing", "claude", "monet", "cafe", "don"}) {
+            vocab += std::string(word) + "\n";
+        }
+        for (char letter = 'a'; letter <= 'z'; letter++) {
+            vocab += std::string(1, letter) + "\n##" + std::string(1, letter) + "\n";
+        }
+        return vocab;
+    }
+    //wordpiece ids by token, so expectations read as text
+    std::vector<int32_t> ids(const WordPieceTokenizer& tokenizer, std::initializer_list<const char*> tokens) {
+        std::vector<int32_t> out;
+        for (const char* token : tokens) out.push_back(tokenizer.idOf(token));
+        return out;
+    }
+
+    TEST(WordPieceNormalize, LowercasesAndFoldsAccents) {
+        EXPECT_EQ(WordPieceTokenizer::normalize("Café CUBISM"), "cafe cubism");
+        EXPECT_EQ(WordPieceTokenizer::normalize("Ångström Œuvre"), "angstrom œuvre"); //a ligature has no decomposition, bert keeps it
+        EXPECT_EQ(WordPieceTokenizer::normalize("e\xCC\x81"), "e"); //e + combining acute, what NFD leaves behind
+        EXPECT_EQ(WordPieceTokenizer::normalize("ΑΒΓ Дом"), "αβγ дом");
+    }
+    TEST(WordPieceNormalize, CollapsesWhitespaceAndDropsControlChars) {
+        EXPECT_EQ(WordPieceTokenizer::normalize("  Claude \t MONET\n"), "claude monet");
+        EXPECT_EQ(WordPieceTokenizer::normalize(std::string("water\0color", 11)), "watercolor");
+        EXPECT_EQ(WordPieceTokenizer::normalize(" \t\r\n"), "");
+        EXPECT_EQ(WordPieceTokenizer::normalize(""), "");
+    }
+    TEST(WordPieceNormalize, SplitsPunctuationAndCjk) {
+        EXPECT_EQ(WordPieceTokenizer::normalize("Monet's"), "monet ' s");
+        EXPECT_EQ(WordPieceTokenizer::normalize("don't!"), "don ' t !");
+        EXPECT_EQ(WordPieceTokenizer::normalize("油画art"), "油 画 art");
+        EXPECT_EQ(WordPieceTokenizer::normalize("art\xE2\x80\x94paint"), "art \xE2\x80\x94 paint"); //em dash
+    }
+    TEST(WordPieceNormalize, EquivalentQueriesNormalizeTheSame) {
+        //the embedding cache is keyed by this, so these must share one entry
+        EXPECT_EQ(WordPieceTokenizer::normalize("Claude Monet"), WordPieceTokenizer::normalize("  claude   MONET "));
+        EXPECT_EQ(WordPieceTokenizer::normalize("CAFÉ"), WordPieceTokenizer::normalize("cafe"));
+    }
+
+    TEST(WordPieceTokenizer, GreedyLongestMatch) {
+        WordPieceTokenizer tokenizer(testVocab());
+        ASSERT_TRUE(tokenizer.valid());
+        EXPECT_EQ(tokenizer.tokenize("Impressionism", 128), ids(tokenizer, {"[CLS]", "impression", "##ism", "[SEP]"}));
+        EXPECT_EQ(tokenizer.tokenize("cubism", 128), ids(tokenizer, {"[CLS]", "cubism", "[SEP]"}));
+        EXPECT_EQ(tokenizer.tokenize("cubisms", 128), ids(tokenizer, {"[CLS]", "cubism", "##s", "[SEP]"}));
+        EXPECT_EQ(tokenizer.tokenize("watercolor painting", 128),
+                  ids(tokenizer, {"[CLS]", "water", "##color", "paint", "##ing", "[SEP]"}));
+        EXPECT_EQ(tokenizer.tokenize("xyz", 128), ids(tokenizer, {"[CLS]", "x", "##y", "##z", "[SEP]"}));
+    }
+    TEST(WordPieceTokenizer, UnmatchedWordIsOneUnknown) {
+        WordPieceTokenizer tokenizer(testVocab());
+        //"9" has no piece, so the whole word is [UNK] rather than "art" + [UNK]
+        EXPECT_EQ(tokenizer.tokenize("art9 monet", 128), ids(tokenizer, {"[CLS]", "[UNK]", "monet", "[SEP]"}));
+        std::string longWord(WordPieceTokenizer::MAX_WORD_CHARS + 1, 'a');
+        EXPECT_EQ(tokenizer.tokenize(longWord, 128), ids(tokenizer, {"[CLS]", "[UNK]", "[SEP]"}));
+    }
+    TEST(WordPieceTokenizer, TruncationKeepsSep) {
+        WordPieceTokenizer tokenizer(testVocab());
+        EXPECT_EQ(tokenizer.tokenize("the art the art", 4), ids(tokenizer, {"[CLS]", "the", "art", "[SEP]"}));
+        //a word's pieces are cut too, not just whole words
+        EXPECT_EQ(tokenizer.tokenize("impressionism", 3), ids(tokenizer, {"[CLS]", "impression", "[SEP]"}));
+        EXPECT_EQ(tokenizer.tokenize("", 4), ids(tokenizer, {"[CLS]", "[SEP]"}));
+    }
+    TEST(WordPieceTokenizer, VocabSizeCountsLines) {
+        //ids are line numbers, so a duplicate keeps its first id but the model still has a row for its line
+        WordPieceTokenizer tokenizer("[PAD]\n[UNK]\n[CLS]\n[SEP]\nart\nart\r\npaint\n");
+        EXPECT_EQ(tokenizer.vocabSize(), 7u);
+        EXPECT_EQ(tokenizer.idOf("art"), 4);
+        EXPECT_EQ(tokenizer.idOf("paint"), 6);
+        EXPECT_EQ(tokenizer.idOf("missing"), -1);
+        EXPECT_FALSE(WordPieceTokenizer("art\npaint\n").valid());
+    }
+
+    //random int8 weights for a small model, quantized per row the same way scripts/export-minilm.py does
+    MiniLmModel::Weights randomWeights(uint32_t seed) {
+        std::mt19937 rng(seed);
+        MiniLmModel::Weights weights;
+        MiniLmModel::Config& config = weights.config;
+        config.hidden = 64;
+        config.heads = 4;
+        config.layers = 2;
+        config.intermediate = 128;
+        config.maxPositions = 32;
+        weights.vocab = testVocab();
+        config.vocabSize = static_cast<uint32_t>(std::count(weights.vocab.begin(), weights.vocab.end(), '\n'));
+
+        auto matrix = [&](detail::Int8Rows& rows, size_t rowCount, size_t colCount, std::vector<float>* bias) {
+            std::normal_distribution<float> normal(0.0f, 0.1f);
+            rows.resize(rowCount, colCount);
+            std::vector<float> row(colCount);
+            for (size_t r = 0; r < rowCount; r++) {
+                float largest = 0.0f;
+                for (float& value : row) {
+                    value = normal(rng);
+                    largest = std::max(largest, std::fabs(value));
+                }
+                rows.scales[r] = largest / 127.0f;
+                for (size_t c = 0; c < colCount; c++) rows.row(r)[c] = static_cast<int8_t>(std::lrint(row[c] / rows.scales[r]));
+            }
+            if (bias) {
+                bias->resize(rowCount);
+                for (float& value : *bias) value = normal(rng);
+            }
+        };
+        auto floats = [&](size_t count, float mean, float deviation) {
+            std::normal_distribution<float> normal(mean, deviation);
+            std::vector<float> values(count);
+            for (float& value : values) value = normal(rng);
+            return values;
+        };
+        auto layerNorm = [&]() { return MiniLmModel::LayerNorm{floats(config.hidden, 1.0f, 0.05f), floats(config.hidden, 0.0f, 0.05f)}; };
+
+        matrix(weights.wordEmbeddings, config.vocabSize, config.hidden, nullptr);
+        weights.positionEmbeddings = floats(static_cast<size_t>(config.maxPositions) * config.hidden, 0.0f, 0.02f);
+        weights.tokenTypeEmbeddings = floats(static_cast<size_t>(config.typeVocabSize) * config.hidden, 0.0f, 0.02f);
+        weights.embeddingNorm = layerNorm();
+        weights.layers.resize(config.layers);
+        for (MiniLmModel::Layer& layer : weights.layers) {
+            matrix(layer.qkv.weights, 3 * config.hidden, config.hidden, &layer.qkv.bias);
+            matrix(layer.attentionOut.weights, config.hidden, config.hidden, &layer.attentionOut.bias);
+            layer.attentionNorm = layerNorm();
+            matrix(layer.ffnIn.weights, config.intermediate, config.hidden, &layer.ffnIn.bias);
+            matrix(layer.ffnOut.weights, config.hidden, config.intermediate, &layer.ffnOut.bias);
+            layer.outputNorm = layerNorm();
+        }
+        return weights;
+    }
+
+    //the same transformer in plain double precision with unquantized activations, what the int8 path approximates
+    std::vector<float> referenceEncode(const MiniLmModel::Weights& weights, const std::vector<int32_t>& tokenIds) {
+        const MiniLmModel::Config& config = weights.config;
+        const size_t hidden = config.hidden, tokens = tokenIds.size(), headSize = hidden / config.heads;
+        auto linear = [&](const MiniLmModel::Linear& layer, const std::vector<double>& input) {
+            size_t rows = layer.weights.rows, cols = layer.weights.cols;
+            std::vector<double> out(tokens * rows);
+            for (size_t t = 0; t < tokens; t++) {
+                for (size_t r = 0; r < rows; r++) {
+                    double sum = 0.0;
+                    for (size_t c = 0; c < cols; c++) sum += input[t * cols + c] * layer.weights.row(r)[c];
+                    out[t * rows + r] = sum * layer.weights.scales[r] + layer.bias[r];
+                }
+            }
+            return out;
+        };
+        auto layerNorm = [&](double* row, const MiniLmModel::LayerNorm& norm) {
+            double mean = 0.0, variance = 0.0;
+            for (size_t i = 0; i < hidden; i++) mean += row[i];
+            mean /= hidden;
+            for (size_t i = 0; i < hidden; i++) variance += (row[i] - mean) * (row[i] - mean);
+            variance /= hidden;
+            for (size_t i = 0; i < hidden; i++) {
+                row[i] = (row[i] - mean) / std::sqrt(variance + config.layerNormEps) * norm.gamma[i] + norm.beta[i];
+            }
+        };
+
+        std::vector<double> x(tokens * hidden);
+        for (size_t t = 0; t < tokens; t++) {
+            size_t id = static_cast<size_t>(tokenIds[t]);
+            for (size_t i = 0; i < hidden; i++) {
+                x[t * hidden + i] = weights.wordEmbeddings.row(id)[i] * static_cast<double>(weights.wordEmbeddings.scales[id]) +
+                                    weights.positionEmbeddings[t * hidden + i] + weights.tokenTypeEmbeddings[i];
+            }
+            layerNorm(&x[t * hidden], weights.embeddingNorm);
+        }
+        for (const MiniLmModel::Layer& layer : weights.layers) {
+            std::vector<double> qkv = linear(layer.qkv, x);
+            std::vector<double> context(tokens * hidden, 0.0);
+            for (size_t h = 0; h < config.heads; h++) {
+                for (size_t q = 0; q < tokens; q++) {
+                    std::vector<double> scores(tokens);
+                    double largest = -INFINITY, total = 0.0;
+                    for (size_t k = 0; k < tokens; k++) {
+                        double dot = 0.0;
+                        for (size_t d = 0; d < headSize; d++) dot += qkv[q * 3 * hidden + h * headSize + d] * qkv[k * 3 * hidden + hidden + h * headSize + d];
+                        scores[k] = dot / std::sqrt(static_cast<double>(headSize));
+                        largest = std::max(largest, scores[k]);
+                    }
+                    for (double& score : scores) total += (score = std::exp(score - largest));
+                    for (size_t k = 0; k < tokens; k++) {
+                        for (size_t d = 0; d < headSize; d++) {
+                            context[q * hidden + h * headSize + d] += scores[k] / total * qkv[k * 3 * hidden + 2 * hidden + h * headSize + d];
+                        }
+                    }
+                }
+            }
+            std::vector<double> projected = linear(layer.attentionOut, context);
+            for (size_t t = 0; t < tokens; t++) {
+                for (size_t i = 0; i < hidden; i++) x[t * hidden + i] += projected[t * hidden + i];
+                layerNorm(&x[t * hidden], layer.attentionNorm);
+            }
+            std::vector<double> intermediate = linear(layer.ffnIn, x);
+            for (double& value : intermediate) value = 0.5 * value * (1.0 + std::erf(value / std::sqrt(2.0)));
+            projected = linear(layer.ffnOut, intermediate);
+            for (size_t t = 0; t < tokens; t++) {
+                for (size_t i = 0; i < hidden; i++) x[t * hidden + i] += projected[t * hidden + i];
+                layerNorm(&x[t * hidden], layer.outputNorm);
+            }
+        }
+        std::vector<double> pooled(hidden, 0.0);
+        for (size_t t = 0; t < tokens; t++) {
+            for (size_t i = 0; i < hidden; i++) pooled[i] += x[t * hidden + i];
+        }
+        double norm = 0.0;
+        for (double value : pooled) norm += value * value;
+        std::vector<float> out(hidden);
+        for (size_t i = 0; i < hidden; i++) out[i] = static_cast<float>(pooled[i] / std::sqrt(norm));
+        return out;
+    }
+    double dot(const std::vector<float>& a, const std::vector<float>& b) {
+        double sum = 0.0;
+        for (size_t i = 0; i < a.size() && i < b.size(); i++) sum += static_cast<double>(a[i]) * b[i];
+        return sum;
+    }
+
+    TEST(MiniLmModel, Int8MatchesFloatReference) {
+        MiniLmModel::Weights weights = randomWeights(3);
+        MiniLmModel::Weights reference = weights;
+        QueryEncoder encoder(std::move(weights), 0);
+        WordPieceTokenizer tokenizer(reference.vocab);
+        for (const char* query : {"impressionism", "Claude Monet's watercolor painting!", "the cubism art of the cafe, painting water"}) {
+            std::vector<float> embedding = encoder.encode(query);
+            ASSERT_EQ(embedding.size(), reference.config.hidden);
+            EXPECT_NEAR(dot(embedding, embedding), 1.0, 1e-4) << query;
+            //per-row int8 weights are shared, so the only error is activation quantization, well under a percent
+            EXPECT_GT(dot(embedding, referenceEncode(reference, tokenizer.tokenize(query, 32))), 0.99) << query;
+        }
+    }
+    TEST(MiniLmModel, KernelsAgree) {
+        //whichever gemm kernel the cpu picks has to give the scalar kernel's exact integer sums
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> value(-127, 127);
+        const size_t stride = 64;
+        std::vector<int8_t> weights(stride);
+        for (int8_t& weight : weights) weight = static_cast<int8_t>(value(rng));
+        std::vector<std::vector<int16_t>> rows(4, std::vector<int16_t>(stride));
+        for (auto& row : rows) {
+            for (int16_t& activation : row) activation = static_cast<int16_t>(value(rng));
+        }
+        const int16_t* activations[4] = {rows[0].data(), rows[1].data(), rows[2].data(), rows[3].data()};
+        for (size_t tokenCount = 1; tokenCount <= 4; tokenCount++) {
+            int32_t scalar[4] = {}, active[4] = {};
+            detail::gemmRowScalar(activations, tokenCount, weights.data(), stride, scalar);
+#if defined(PALETTE_EMBEDDING_AVX2)
+            if (!detail::cpuHasAvx2()) GTEST_SKIP() << "no avx2 on this cpu, only the scalar kernel runs";
+            detail::gemmRowAvx2(activations, tokenCount, weights.data(), stride, active);
+#else
+            GTEST_SKIP() << "built without the avx2 kernel";
+#endif
+            for (size_t t = 0; t < tokenCount; t++) EXPECT_EQ(active[t], scalar[t]) << "token " << t << " of " << tokenCount;
+        }
+    }
+    TEST(QueryEncoder, EquivalentQueriesShareAnEmbedding) {
+        QueryEncoder encoder(randomWeights(5), 16);
+        std::vector<float> first = encoder.encode("Claude Monet");
+        EXPECT_EQ(encoder.encode("  claude   MONET "), first); //the cached entry for the same normalized text
+        EXPECT_EQ(encoder.encode("Claude Monet"), first);
+        EXPECT_LT(dot(encoder.encode("cubism"), first), 0.999);
+        EXPECT_TRUE(encoder.encode(" \t ").empty());
+    }
+    TEST(QueryEncoder, RejectsMismatchedVocab) {
+        MiniLmModel::Weights weights = randomWeights(5);
+        weights.vocab += "extra\n";
+        EXPECT_THROW(QueryEncoder(std::move(weights), 0), std::runtime_error);
+        MiniLmModel::Weights noSpecialTokens = randomWeights(5);
+        noSpecialTokens.vocab.replace(noSpecialTokens.vocab.find("[CLS]"), 5, "[XXX]");
+        EXPECT_THROW(QueryEncoder(std::move(noSpecialTokens), 0), std::runtime_error);
+    }
+
+    //PLTMLM01, the layout MiniLmModel::load reads (scripts/export-minilm.py writes it)
+    void writeWeights(const MiniLmModel::Weights& weights, const std::string& path) {
+        std::ofstream file(path, std::ios::binary);
+        auto bytes = [&](const void* data, size_t size) { file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size)); };
+        auto u32 = [&](uint32_t value) { bytes(&value, 4); };
+        auto floats = [&](const std::vector<float>& values) { bytes(values.data(), values.size() * sizeof(float)); };
+        auto matrix = [&](const detail::Int8Rows& rows, const std::vector<float>* bias) {
+            for (size_t r = 0; r < rows.rows; r++) bytes(rows.row(r), rows.cols);
+            floats(rows.scales);
+            if (bias) floats(*bias);
+        };
+        auto layerNorm = [&](const MiniLmModel::LayerNorm& norm) { floats(norm.gamma); floats(norm.beta); };
+        const MiniLmModel::Config& config = weights.config;
+        bytes("PLTMLM01", 8);
+        for (uint32_t value : {config.vocabSize, config.hidden, config.layers, config.heads, config.intermediate,
+                               config.maxPositions, config.typeVocabSize}) {
+            u32(value);
+        }
+        bytes(&config.layerNormEps, 4);
+        u32(static_cast<uint32_t>(weights.vocab.size()));
+        bytes(weights.vocab.data(), weights.vocab.size());
+        matrix(weights.wordEmbeddings, nullptr);
+        floats(weights.positionEmbeddings);
+        floats(weights.tokenTypeEmbeddings);
+        layerNorm(weights.embeddingNorm);
+        for (const MiniLmModel::Layer& layer : weights.layers) {
+            matrix(layer.qkv.weights, &layer.qkv.bias);
+            matrix(layer.attentionOut.weights, &layer.attentionOut.bias);
+            layerNorm(layer.attentionNorm);
+            matrix(layer.ffnIn.weights, &layer.ffnIn.bias);
+            matrix(layer.ffnOut.weights, &layer.ffnOut.bias);
+            layerNorm(layer.outputNorm);
+        }
+    }
+    TEST(MiniLmModel, LoadsWhatWasWritten) {
+        MiniLmModel::Weights weights = randomWeights(9);
+        std::string path = ::testing::TempDir() + "palette-minilm-test.bin";
+        writeWeights(weights, path);
+        MiniLmModel loaded(MiniLmModel::load(path));
+        MiniLmModel original(std::move(weights));
+        WordPieceTokenizer tokenizer(original.vocab());
+        std::vector<int32_t> tokenIds = tokenizer.tokenize("claude monet watercolor", 32);
+        std::vector<float> expected(original.dimension()), actual(loaded.dimension());
+        original.encode(tokenIds, expected.data());
+        loaded.encode(tokenIds, actual.data());
+        EXPECT_EQ(actual, expected);
+
+        //a cut off file is an error, not a half loaded model
+        std::string truncated = path + ".truncated";
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            std::ofstream(truncated, std::ios::binary) << contents.substr(0, contents.size() / 2);
+        }
+        EXPECT_THROW(MiniLmModel::load(truncated), std::runtime_error);
+        std::ofstream(truncated, std::ios::binary) << "GGUF0000 not ours";
+        EXPECT_THROW(MiniLmModel::load(truncated), std::runtime_error);
+        EXPECT_THROW(MiniLmModel::load(path + ".missing"), std::runtime_error);
+        std::remove(path.c_str());
+        std::remove(truncated.c_str());
+    }
+
+    //--- weaviate response parser (vector-engine.cpp) ---
+
+    //a weaviate Get response with one concept per {name, certainty, vector}, under the given class or alias
+    std::string weaviateBody(const std::string& className, std::initializer_list<std::tuple<const char*, const char*, const char*>> concepts) {
+        std::string body = "{\"data\":{\"Get\":{\"" + className + "\":[";
+        bool first = true;
+        for (const auto& [name, certainty, vector] : concepts) {
+            if (!first) body += ",";
+            first = false;
+            body += std::string("{\"name\":\"") + name + "\",\"description\":\"skipped [{\\\"}]\",\"_additional\":{\"id\":\"018f3b0e-0000-7000-8000-000000000000\","
+                    "\"certainty\":" + certainty + ",\"vector\":[" + vector + "]}}";
+        }
+        return body + "]}}}";
+    }
+
+    TEST(WeaviateResponseParser, ReadsNamesCertaintiesAndVectors) {
+        NodeList nodes = WeaviateClient::parseWeaviateResponse(
+            weaviateBody("Concept", {{"parser-cubism", "0.875", "0.5,-0.25,1"}, {"parser-fauvism", "0.5", "1,0,0"}}), 2);
+        ASSERT_EQ(nodes.size(), 2u);
+        EXPECT_EQ(nodes[0].name.view(), "parser-cubism");
+        EXPECT_FLOAT_EQ(nodes[0].similarityScore, 0.875f);
+        EXPECT_EQ(nodes[0].level, 2);
+        EXPECT_EQ(EmbeddingStore::global().values(nodes[0].embedding), (std::vector<float>{0.5f, -0.25f, 1.0f}));
+        EXPECT_EQ(nodes[1].name.view(), "parser-fauvism");
+        EXPECT_EQ(nodes[1].id.size(), 36u); //ids are minted here, weaviate's are ignored
+        EXPECT_NE(nodes[0].id, nodes[1].id);
+    }
+    TEST(WeaviateResponseParser, KeyOrderAndAliasesDontMatter) {
+        //vector before name, and a batched request's aliased arrays
+        std::string body = "{\"data\":{\"Get\":{"
+                           "\"c0\":[{\"_additional\":{\"vector\":[0,1,0],\"certainty\":0.25},\"name\":\"parser-dada\"}],"
+                           "\"c1\":[{\"name\":\"parser-bauhaus\",\"_additional\":{\"certainty\":0.75}}]}}}";
+        NodeList nodes = WeaviateClient::parseWeaviateResponse(body, 1);
+        ASSERT_EQ(nodes.size(), 2u);
+        EXPECT_EQ(nodes[0].name.view(), "parser-dada");
+        EXPECT_FLOAT_EQ(nodes[0].similarityScore, 0.25f);
+        EXPECT_EQ(EmbeddingStore::global().values(nodes[0].embedding), (std::vector<float>{0.0f, 1.0f, 0.0f}));
+        EXPECT_EQ(nodes[1].name.view(), "parser-bauhaus");
+        EXPECT_TRUE(nodes[1].embedding.empty());
+    }
+    TEST(WeaviateResponseParser, UnderflowIsSignedZero) {
+        //float can't hold these, they used to fail the whole response
+        NodeList nodes = WeaviateClient::parseWeaviateResponse(weaviateBody("Concept", {{"parser-underflow", "1e-50", "-1e-60,0.5,1e-40"}}), 1);
+        ASSERT_EQ(nodes.size(), 1u);
+        EXPECT_EQ(nodes[0].similarityScore, 0.0f);
+        std::vector<float> vector = EmbeddingStore::global().values(nodes[0].embedding);
+        ASSERT_EQ(vector.size(), 3u);
+        EXPECT_EQ(vector[0], 0.0f);
+        EXPECT_TRUE(std::signbit(vector[0]));
+        EXPECT_EQ(vector[2], 0.0f);
+        EXPECT_FALSE(std::signbit(vector[2]));
+        //past double's range too, decided from the exponent
+        nodes = WeaviateClient::parseWeaviateResponse(weaviateBody("Concept", {{"parser-deep-underflow", "1e-400", "-1e-400,0.5,0"}}), 1);
+        ASSERT_EQ(nodes.size(), 1u);
+        EXPECT_EQ(nodes[0].similarityScore, 0.0f);
+        EXPECT_TRUE(std::signbit(EmbeddingStore::global().values(nodes[0].embedding)[0]));
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse(weaviateBody("Concept", {{"parser-deep-overflow", "1e400", "0,0,1"}}), 1).empty());
+        //an overflow or a number that isn't one still is an error
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse(weaviateBody("Concept", {{"parser-overflow", "1e60", "0,0,1"}}), 1).empty());
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse(weaviateBody("Concept", {{"parser-bad-number", "0.5.5", "0,0,1"}}), 1).empty());
+    }
+    TEST(WeaviateResponseParser, EscapesDecodeToUtf8) {
+        NodeList nodes = WeaviateClient::parseWeaviateResponse(
+            "{\"data\":{\"Get\":{\"Concept\":[{\"name\":\"caf\\u00e9 \\\"noir\\\" \\ud83c\\udfa8\"}]}}}", 1);
+        ASSERT_EQ(nodes.size(), 1u);
+        EXPECT_EQ(nodes[0].name.view(), "caf\xC3\xA9 \"noir\" \xF0\x9F\x8E\xA8");
+    }
+    TEST(WeaviateResponseParser, ChunkBoundariesDontMatter) {
+        //curl hands over arbitrary slices, so every token has to survive being split
+        std::string body = weaviateBody("Concept", {{"parser-chunked \\u00e9", "0.625", "-0.5,0.125,1e-50"}});
+        NodeList whole = WeaviateClient::parseWeaviateResponse(body, 1);
+        ASSERT_EQ(whole.size(), 1u);
+        NodeList pieces;
+        WeaviateResponseParser parser(pieces, 1);
+        for (char c : body) parser.feed(&c, 1);
+        ASSERT_TRUE(parser.finish());
+        ASSERT_EQ(pieces.size(), 1u);
+        EXPECT_EQ(pieces[0].name, whole[0].name);
+        EXPECT_EQ(pieces[0].similarityScore, whole[0].similarityScore);
+        EXPECT_EQ(pieces[0].embedding, whole[0].embedding); //same name, so the store hands back the same vector
+    }
+    TEST(WeaviateResponseParser, MalformedBodiesAreEmpty) {
+        std::string good = weaviateBody("Concept", {{"parser-malformed", "0.5", "0,1,0"}});
+        EXPECT_EQ(WeaviateClient::parseWeaviateResponse(good, 1).size(), 1u);
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse(good.substr(0, good.size() - 1), 1).empty()); //cut off
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse(good + "]", 1).empty());
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse("", 1).empty());
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse("{\"data\":{\"Get\":{\"Concept\":[{\"name\":\"x\\q\"}]}}}", 1).empty());
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse("{\"data\":{\"Get\":{\"Concept\":[nope]}}}", 1).empty());
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse("{{\"a\":1}:2}", 1).empty());
+        //separators out of place, these used to be skipped like whitespace
+        for (const char* concept : {"{\"name\":\"commas\",,,,\"x\":1}", "{\"name\":\"colonvalue\":::1}", "{\"name\" \"x\"}",
+                                    "{\"name\":\"x\",}", "{,\"name\":\"x\"}", "{\"name\":\"x\" \"y\":1}", "{\"name\":}", "{\"name\"}",
+                                    "{\"name\":\"x\",\"v\":[1,,2]}", "{\"name\":\"x\",\"v\":[1 2]}", "{\"name\":\"x\",\"v\":[1,]}",
+                                    "{\"name\":\"x\",\"v\":[:1]}", "{\"name\":\"x\",\"v\":{1:2}}"}) {
+            std::string body = std::string("{\"data\":{\"Get\":{\"Concept\":[") + concept + "]}}}";
+            EXPECT_TRUE(WeaviateClient::parseWeaviateResponse(body, 1).empty()) << body;
+        }
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse(good + good, 1).empty()); //two documents
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse(good + ",", 1).empty());
+        EXPECT_TRUE(WeaviateClient::parseWeaviateResponse("{\"data\":{\"Get\":{\"Concept\":[]}}} 1", 1).empty());
+        //and the odd but valid shapes still parse
+        std::string valid = "{ \"data\" : { \"Get\" : { \"Concept\" : [ { \"name\" : \"parser-spaced\" , \"x\" : [ [ ] , { } , null , true , -1.5e3 ] , "
+                            "\"y\" : { \"z\" : [ { } ] } } , { } ] } } , \"extensions\" : { } }";
+        NodeList spaced = WeaviateClient::parseWeaviateResponse(valid, 1);
+        ASSERT_EQ(spaced.size(), 2u);
+        EXPECT_EQ(spaced[0].name.view(), "parser-spaced");
+        EXPECT_TRUE(spaced[1].name.empty());
+
+        NodeList nodes;
+        WeaviateResponseParser parser(nodes, 1);
+        std::string withErrors = "{\"data\":{\"Get\":{\"Concept\":null}},\"errors\":[{\"message\":\"no such class\"}]}";
+        parser.feed(withErrors.data(), withErrors.size());
+        EXPECT_TRUE(parser.finish());
+        EXPECT_TRUE(parser.hasErrors());
+    }
+
+    //--- telemetry history (TelemetryRecord in core-systems.hpp, SeqlockRing in lock-free.hpp) ---
+
+    TelemetryRecord recordFor(const std::string& phrase) {
+        SearchTelemetry telemetry{};
+        telemetry.searchId = "search-1";
+        telemetry.searchPhrase = phrase;
+        return TelemetryRecord::fromTelemetry(telemetry);
+    }
+
+    TEST(TelemetryRecord, ShortStringsRoundTrip) {
+        SearchTelemetry telemetry{};
+        telemetry.searchId = "018f3b0e-0000-7000-8000-000000000000";
+        telemetry.searchPhrase = "water lilies \xC3\xA9t\xC3\xA9";
+        telemetry.processingTime = 12;
+        telemetry.nodesFound = 7;
+        telemetry.traceId = 99;
+        telemetry.stageTimeNs[0] = 1234;
+        SearchTelemetry back = TelemetryRecord::fromTelemetry(telemetry).toTelemetry();
+        EXPECT_EQ(back.searchId, telemetry.searchId);
+        EXPECT_EQ(back.searchPhrase, telemetry.searchPhrase);
+        EXPECT_EQ(back.processingTime, 12u);
+        EXPECT_EQ(back.nodesFound, 7u);
+        EXPECT_EQ(back.traceId, 99u);
+        EXPECT_EQ(back.stageTimeNs[0], 1234u);
+    }
+    TEST(TelemetryRecord, TruncatesOnCharacterBoundaries) {
+        const size_t keep = TelemetryRecord::MAX_PHRASE_LENGTH - 1;
+        EXPECT_EQ(recordFor(std::string(200, 'a')).toTelemetry().searchPhrase, std::string(keep, 'a'));
+        //every alignment of a 2, 3 and 4 byte character across the cut
+        for (const std::string character : {"\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x8E\xA8"}) {
+            for (size_t pad = 0; pad < character.size(); pad++) {
+                std::string phrase(pad, 'a');
+                while (phrase.size() < 200) phrase += character;
+                std::string kept = recordFor(phrase).toTelemetry().searchPhrase;
+                size_t whole = pad + (keep - pad) / character.size() * character.size(); //the last character that fits completely
+                EXPECT_EQ(kept, phrase.substr(0, whole)) << "character of " << character.size() << " bytes, " << pad << " byte pad";
+            }
+        }
+        //bytes that aren't utf-8 are cut where they are rather than eating into the phrase
+        EXPECT_EQ(recordFor(std::string(200, '\x80')).toTelemetry().searchPhrase.size(), keep - 3);
+    }
+
+    TEST(SeqlockRing, KeepsTheNewestOldestFirst) {
+        lockfree::SeqlockRing<TelemetryRecord, 4> ring;
+        std::vector<TelemetryRecord> out;
+        EXPECT_EQ(ring.snapshot(out), 0u);
+        for (int i = 0; i < 6; i++) ring.push(recordFor("phrase " + std::to_string(i)));
+        EXPECT_EQ(ring.size(), 4u);
+        EXPECT_EQ(ring.totalWritten(), 6u);
+        ASSERT_EQ(ring.snapshot(out), 4u);
+        for (int i = 0; i < 4; i++) EXPECT_STREQ(out[i].searchPhrase, ("phrase " + std::to_string(i + 2)).c_str());
+        out.clear(); //snapshot appends
+        ASSERT_EQ(ring.snapshot(out, 2), 2u);
+        EXPECT_STREQ(out[0].searchPhrase, "phrase 4");
+        EXPECT_STREQ(out[1].searchPhrase, "phrase 5");
+    }
+    TEST(SeqlockRing, ReadersNeverSeeATornRecord) {
+        lockfree::SeqlockRing<TelemetryRecord, 8> ring;
+        std::atomic<bool> stop{false};
+        std::thread writer([&]() { //keeps overwriting until the reader is done, so every snapshot races it
+            for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); i++) {
+                TelemetryRecord record = recordFor(std::string(1 + i % 90, static_cast<char>('a' + i % 26)));
+                record.nodesFound = i % 90 + 1;
+                ring.push(record);
+            }
+        });
+        while (ring.totalWritten() < ring.capacity()) std::this_thread::yield();
+        std::vector<TelemetryRecord> out;
+        size_t checked = 0;
+        for (int round = 0; round < 20000; round++) {
+            out.clear();
+            ring.snapshot(out);
+            for (const TelemetryRecord& record : out) {
+                //a record copied while being overwritten would mix two phrases or disagree with its length
+                std::string phrase = record.searchPhrase;
+                if (phrase.size() != record.nodesFound || phrase != std::string(phrase.size(), phrase[0])) {
+                    ADD_FAILURE() << "torn record \"" << phrase << "\" of length " << record.nodesFound;
+                }
+                checked++;
+            }
+        }
+        stop = true;
+        writer.join();
+        EXPECT_GT(checked, 0u);
+    }
+    //--- latency histograms (latency-histogram.hpp) ---
+
+    TEST(LatencyHistogram, BucketsTileTheRange) {
+        for (size_t i = 0; i < HistogramSnapshot::BUCKET_COUNT; i++) {
+            uint64_t lower = HistogramSnapshot::bucketLowerBound(i), upper = HistogramSnapshot::bucketUpperBound(i);
+            ASSERT_LE(lower, upper);
+            EXPECT_EQ(HistogramSnapshot::bucketIndex(lower), i);
+            EXPECT_EQ(HistogramSnapshot::bucketIndex(upper), i);
+            EXPECT_LE(static_cast<double>(upper - lower), static_cast<double>(lower) / HistogramSnapshot::SUB_BUCKETS) << "bucket " << i;
+            if (i + 1 < HistogramSnapshot::BUCKET_COUNT) {
+                EXPECT_EQ(HistogramSnapshot::bucketLowerBound(i + 1), upper + 1);
+            }
+        }
+        EXPECT_EQ(HistogramSnapshot::bucketUpperBound(HistogramSnapshot::BUCKET_COUNT - 1), HistogramSnapshot::MAX_VALUE);
+        EXPECT_EQ(HistogramSnapshot::bucketIndex(UINT64_MAX), HistogramSnapshot::BUCKET_COUNT - 1); //clamped, not out of bounds
+    }
+    TEST(LatencyHistogram, PercentilesWithinBucketError) {
+        LatencyHistogram histogram;
+        EXPECT_EQ(histogram.snapshot().valueAtQuantile(0.99), 0u);
+        for (uint64_t us = 1; us <= 100000; us++) histogram.record(us);
+        HistogramSnapshot snapshot = histogram.snapshot();
+        EXPECT_EQ(snapshot.count, 100000u);
+        EXPECT_EQ(snapshot.max, 100000u);
+        EXPECT_DOUBLE_EQ(snapshot.mean(), 50000.5);
+        for (double q : {0.5, 0.9, 0.99, 0.999}) {
+            double exact = q * 100000;
+            EXPECT_NEAR(static_cast<double>(snapshot.valueAtQuantile(q)), exact, exact / 16) << "q " << q;
+        }
+        EXPECT_EQ(snapshot.valueAtQuantile(1.0), 100000u); //never above what was recorded
+
+        LatencyHistogram single;
+        single.record(7);
+        EXPECT_EQ(single.snapshot().valueAtQuantile(0.5), 7u); //small values are exact
+        single.reset();
+        EXPECT_EQ(single.snapshot().count, 0u);
+    }
+    TEST(LatencyHistogram, MergeAndConcurrentRecording) {
+        LatencyHistogram histogram;
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t < 4; t++) {
+            threads.emplace_back([&histogram, t]() {
+                for (uint64_t i = 0; i < 25000; i++) histogram.record(t * 1000 + i % 1000);
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+        HistogramSnapshot snapshot = histogram.snapshot();
+        EXPECT_EQ(snapshot.count, 100000u);
+        EXPECT_EQ(snapshot.sum, 25u * (0 + 1000 + 2000 + 3000) * 1000 + 4u * 25u * (999 * 1000 / 2));
+        EXPECT_EQ(snapshot.max, 3999u);
+
+        HistogramSnapshot merged = snapshot;
+        merged.merge(snapshot);
+        EXPECT_EQ(merged.count, 2 * snapshot.count);
+        EXPECT_EQ(merged.sum, 2 * snapshot.sum);
+        EXPECT_EQ(merged.valueAtQuantile(0.5), snapshot.valueAtQuantile(0.5));
+    }
+    TEST(WindowedLatencyHistogram, RecentSamplesAreInEveryWindow) {
+        WindowedLatencyHistogram histogram;
+        for (int i = 0; i < 100; i++) histogram.record(std::chrono::milliseconds(5));
+        histogram.record(std::chrono::nanoseconds(-1)); //a clock step backwards counts as 0, not 2^64
+        for (auto window : {std::chrono::seconds(60), std::chrono::seconds(300), std::chrono::seconds(3600)}) {
+            HistogramSnapshot snapshot = histogram.window(window);
+            EXPECT_EQ(snapshot.count, 101u) << window.count() << "s window";
+            EXPECT_EQ(snapshot.max, 5000u);
+        }
+        EXPECT_EQ(histogram.total().count, 101u);
+        nlohmann::json json = histogram.toJson();
+        EXPECT_DOUBLE_EQ(json["1m"]["max_ms"].get<double>(), 5.0);
+        EXPECT_EQ(json["all"]["count"].get<uint64_t>(), 101u);
+    }
+
+    //--- circuit breaker (circuit-breaker.hpp) ---
+
+    //a short cool-down so tests can wait it out, each test its own endpoint so the metrics don't mix
+    CircuitBreaker::Options fastBreaker() {
+        CircuitBreaker::Options options;
+        options.minRequests = 4;
+        options.failureThreshold = 0.5;
+        options.openDuration = std::chrono::milliseconds(20);
+        return options;
+    }
+    void recordOutcomes(CircuitBreaker& breaker, int successes, int failures) {
+        for (int i = 0; i < successes; i++) breaker.record(breaker.allowRequest(), true);
+        for (int i = 0; i < failures; i++) breaker.record(breaker.allowRequest(), false);
+    }
+
+    TEST(CircuitBreaker, OpensOnlyWithEnoughFailures) {
+        CircuitBreaker breaker("unit-test", "opens", fastBreaker());
+        recordOutcomes(breaker, 0, 3);
+        EXPECT_EQ(breaker.getState(), CircuitState::CLOSED); //3 failures are fewer than minRequests
+        recordOutcomes(breaker, 3, 0);
+        EXPECT_EQ(breaker.getState(), CircuitState::CLOSED); //3 of 6 is at the threshold, but only a failure can trip it
+        recordOutcomes(breaker, 0, 1);
+        EXPECT_EQ(breaker.getState(), CircuitState::OPEN);
+        EXPECT_FALSE(breaker.acceptsRequests());
+        EXPECT_EQ(breaker.allowRequest(), CircuitBreaker::Admission::REJECTED);
+        nlohmann::json stats = breaker.toJson();
+        EXPECT_EQ(stats["state"], "OPEN");
+        EXPECT_EQ(stats["opened"].get<uint64_t>(), 1u);
+        EXPECT_GE(stats["rejected"].get<uint64_t>(), 1u);
+    }
+    TEST(CircuitBreaker, OneProbeAfterTheCoolDown) {
+        CircuitBreaker breaker("unit-test", "probe", fastBreaker());
+        recordOutcomes(breaker, 0, 4);
+        ASSERT_EQ(breaker.getState(), CircuitState::OPEN);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        EXPECT_TRUE(breaker.acceptsRequests());
+        CircuitBreaker::Admission probe = breaker.allowRequest();
+        EXPECT_EQ(probe, CircuitBreaker::Admission::PROBE);
+        EXPECT_EQ(breaker.getState(), CircuitState::HALF_OPEN);
+        EXPECT_FALSE(breaker.acceptsRequests());
+        EXPECT_EQ(breaker.allowRequest(), CircuitBreaker::Admission::REJECTED); //only one probe at a time
+
+        breaker.record(probe, false); //a failed probe opens it for another cool-down
+        EXPECT_EQ(breaker.getState(), CircuitState::OPEN);
+        EXPECT_EQ(breaker.allowRequest(), CircuitBreaker::Admission::REJECTED);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        probe = breaker.allowRequest();
+        ASSERT_EQ(probe, CircuitBreaker::Admission::PROBE);
+        breaker.record(probe, true);
+        EXPECT_EQ(breaker.getState(), CircuitState::CLOSED);
+        //the window was reset, old failures don't count against the recovered upstream
+        recordOutcomes(breaker, 0, 1);
+        EXPECT_EQ(breaker.getState(), CircuitState::CLOSED);
+        EXPECT_EQ(breaker.toJson()["window_failures"].get<uint64_t>(), 1u);
+    }
+    TEST(CircuitBreaker, AbandonedProbeIsNotLost) {
+        CircuitBreaker breaker("unit-test", "abandon", fastBreaker());
+        recordOutcomes(breaker, 0, 4);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        CircuitBreaker::Admission probe = breaker.allowRequest();
+        ASSERT_EQ(probe, CircuitBreaker::Admission::PROBE);
+        breaker.abandon(probe);
+        EXPECT_EQ(breaker.getState(), CircuitState::OPEN);
+        EXPECT_EQ(breaker.allowRequest(), CircuitBreaker::Admission::PROBE); //the cool-down already passed, the next caller probes
+    }
+    TEST(CircuitBreaker, LateOutcomesDontCount) {
+        CircuitBreaker breaker("unit-test", "late", fastBreaker());
+        CircuitBreaker::Admission early = breaker.allowRequest();
+        recordOutcomes(breaker, 0, 4);
+        ASSERT_EQ(breaker.getState(), CircuitState::OPEN);
+        breaker.record(early, true); //admitted while closed, finished after the breaker opened
+        EXPECT_EQ(breaker.getState(), CircuitState::OPEN);
+        breaker.record(CircuitBreaker::Admission::REJECTED, true);
+        breaker.abandon(CircuitBreaker::Admission::ALLOWED);
+        EXPECT_EQ(breaker.getState(), CircuitState::OPEN);
+        EXPECT_EQ(breaker.toJson()["window_requests"].get<uint64_t>(), 4u);
+    }
+
+    //--- uuidv7 ids (uuid.hpp) ---
+
+    TEST(UuidV7, FormatsLikeRfc9562) {
+        uuid::UuidText text;
+        uuid::format(uuid::UuidBits{0x0123456789ABCDEFULL, 0xFEDCBA9876543210ULL}, text.data());
+        EXPECT_EQ(uuid::view(text), "01234567-89ab-cdef-fedc-ba9876543210");
+        uuid::format(uuid::UuidBits{0, UINT64_MAX}, text.data());
+        EXPECT_EQ(uuid::view(text), "00000000-0000-0000-ffff-ffffffffffff");
+    }
+    TEST(UuidV7, VersionVariantAndTimestamp) {
+        uint64_t before = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        uuid::UuidBits bits = uuid::generateV7Bits();
+        EXPECT_EQ((bits.high >> 12) & 0xF, 7u);
+        EXPECT_EQ(bits.low >> 62, 2u);
+        //the coarse clock can be a tick behind, and a burst can borrow from the next millisecond
+        EXPECT_NEAR(static_cast<double>(bits.high >> 16), static_cast<double>(before), 50.0);
+
+        uuid::UuidText text = uuid::generateV7();
+        std::string_view id = uuid::view(text);
+        for (size_t i = 0; i < id.size(); i++) {
+            if (i == 8 || i == 13 || i == 18 || i == 23) {
+                EXPECT_EQ(id[i], '-');
+            } else {
+                EXPECT_TRUE(std::isxdigit(static_cast<unsigned char>(id[i])) && !std::isupper(static_cast<unsigned char>(id[i]))) << id;
+            }
+        }
+        EXPECT_EQ(id[14], '7');
+        EXPECT_NE(std::string_view("89ab").find(id[19]), std::string_view::npos) << id;
+    }
+    TEST(UuidV7, OrderedWithinAThreadUniqueAcrossThreads) {
+        //more ids than the counter holds in one millisecond, so the borrow path runs too
+        std::vector<std::string> ids;
+        for (int i = 0; i < 20000; i++) {
+            uuid::UuidText text = uuid::generateV7();
+            ids.emplace_back(text.data(), text.size());
+        }
+        EXPECT_TRUE(std::is_sorted(ids.begin(), ids.end()));
+        EXPECT_EQ(std::adjacent_find(ids.begin(), ids.end()), ids.end());
+
+        std::vector<std::vector<std::string>> perThread(4);
+        std::vector<std::thread> threads;
+        for (auto& out : perThread) {
+            threads.emplace_back([&out]() {
+                for (int i = 0; i < 20000; i++) {
+                    uuid::UuidText text = uuid::generateV7();
+                    out.emplace_back(text.data(), text.size());
+                }
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+        std::unordered_set<std::string> unique(ids.begin(), ids.end());
+        for (const auto& out : perThread) unique.insert(out.begin(), out.end());
+        EXPECT_EQ(unique.size(), 5u * 20000u);
+    }
+
+    //--- string interner (interner.hpp) ---
+
+    TEST(StringInterner, SameTextSameId) {
+        StringInterner& interner = StringInterner::global();
+        InternedString first = interner.intern("interner-pointillism");
+        InternedString again = interner.intern(std::string("interner-") + "pointillism"); //equal text at another address
+        EXPECT_EQ(first, again);
+        EXPECT_NE(first, interner.intern("interner-Pointillism"));
+        EXPECT_EQ(first.view(), "interner-pointillism");
+        EXPECT_EQ(std::hash<InternedString>{}(first), std::hash<InternedString>{}(again));
+
+        InternedString empty = interner.intern("");
+        EXPECT_TRUE(empty.empty());
+        EXPECT_EQ(empty.id(), 0u);
+        EXPECT_EQ(empty, InternedString());
+        EXPECT_EQ(empty.view(), "");
+    }
+    TEST(StringInterner, FindNeverInserts) {
+        StringInterner& interner = StringInterner::global();
+        size_t strings = interner.stringCount(), bytes = interner.textBytes();
+        EXPECT_FALSE(interner.find("interner-never-interned").has_value());
+        EXPECT_EQ(interner.stringCount(), strings);
+        EXPECT_EQ(interner.textBytes(), bytes);
+        EXPECT_EQ(interner.find("")->id(), 0u);
+
+        InternedString known = interner.intern("interner-orphism");
+        EXPECT_EQ(interner.stringCount(), strings + 1);
+        EXPECT_EQ(interner.textBytes(), bytes + std::strlen("interner-orphism"));
+        ASSERT_TRUE(interner.find("interner-orphism").has_value());
+        EXPECT_EQ(*interner.find("interner-orphism"), known);
+    }
+    TEST(StringInterner, ViewsNeverMove) {
+        StringInterner& interner = StringInterner::global();
+        InternedString early = interner.intern("interner-vorticism");
+        std::string_view before = early.view();
+        std::string longText(StringInterner::TEXT_CHUNK_BYTES / 2, 'x'); //gets its own allocation
+        InternedString big = interner.intern(longText);
+        //enough strings to start new text chunks in every shard and a new view block
+        for (size_t i = 0; i < StringInterner::BLOCK_STRINGS + 100; i++) interner.intern("interner-filler-" + std::to_string(i));
+        EXPECT_EQ(early.view().data(), before.data());
+        EXPECT_EQ(early.view(), "interner-vorticism");
+        EXPECT_EQ(big.view(), longText);
+        EXPECT_EQ(interner.intern("interner-filler-7").view(), "interner-filler-7");
+    }
+    TEST(StringInterner, ConcurrentInternsAgree) {
+        //threads racing on the same new strings all get the one id each string ends up with
+        std::vector<std::vector<InternedString>> perThread(4);
+        std::vector<std::thread> threads;
+        for (auto& out : perThread) {
+            threads.emplace_back([&out]() {
+                for (int i = 0; i < 2000; i++) out.push_back(StringInterner::global().intern("interner-race-" + std::to_string(i)));
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+        std::unordered_set<uint32_t> distinct;
+        for (int i = 0; i < 2000; i++) {
+            for (const auto& out : perThread) EXPECT_EQ(out[i], perThread[0][i]);
+            EXPECT_EQ(perThread[0][i].view(), "interner-race-" + std::to_string(i));
+            distinct.insert(perThread[0][i].id());
+        }
+        EXPECT_EQ(distinct.size(), 2000u);
+    }
+
+    //--- embedding store (embedding-store.hpp) ---
+
+    TEST(HalfFloat, EveryHalfRoundTrips) {
+        for (uint32_t half = 0; half <= 0xFFFF; half++) {
+            float value = detail::halfToFloat(static_cast<uint16_t>(half));
+            bool nan = (half & 0x7C00) == 0x7C00 && (half & 0x03FF) != 0;
+            if (nan) {
+                EXPECT_TRUE(std::isnan(value)) << std::hex << half;
+                EXPECT_EQ(detail::floatToHalf(value) & 0x7C00, 0x7C00) << std::hex << half;
+            } else {
+                ASSERT_EQ(detail::floatToHalf(value), half) << std::hex << half << " read as " << value;
+            }
+        }
+        EXPECT_EQ(detail::halfToFloat(0x3C00), 1.0f);
+        EXPECT_EQ(detail::halfToFloat(0xC000), -2.0f);
+        EXPECT_EQ(detail::halfToFloat(0x7BFF), 65504.0f); //largest half
+        EXPECT_EQ(detail::halfToFloat(0x0001), std::ldexp(1.0f, -24)); //smallest subnormal
+        EXPECT_TRUE(std::isinf(detail::halfToFloat(0xFC00)) && detail::halfToFloat(0xFC00) < 0);
+    }
+    TEST(HalfFloat, RoundsToNearestEven) {
+        const float ulpAtOne = std::ldexp(1.0f, -10);
+        EXPECT_EQ(detail::floatToHalf(1.0f + ulpAtOne / 2), 0x3C00); //tie, 0x3C00 is even
+        EXPECT_EQ(detail::floatToHalf(1.0f + ulpAtOne * 1.5f), 0x3C02); //tie, 0x3C02 is even
+        EXPECT_EQ(detail::floatToHalf(1.0f + ulpAtOne * 0.51f), 0x3C01);
+        EXPECT_EQ(detail::floatToHalf(65519.0f), 0x7BFF);
+        EXPECT_EQ(detail::floatToHalf(65520.0f), 0x7C00); //rounds past the largest half to infinity
+        EXPECT_EQ(detail::floatToHalf(1e10f), 0x7C00);
+        EXPECT_EQ(detail::floatToHalf(-1e10f), 0xFC00);
+        EXPECT_EQ(detail::floatToHalf(std::ldexp(1.0f, -25)), 0x0000); //half the smallest subnormal, tie to 0
+        EXPECT_EQ(detail::floatToHalf(std::ldexp(1.5f, -25)), 0x0001);
+        EXPECT_EQ(detail::floatToHalf(std::ldexp(1.0f, -30)), 0x0000);
+        EXPECT_EQ(detail::floatToHalf(-0.0f), 0x8000);
+        EXPECT_EQ(detail::floatToHalf(-std::ldexp(1.0f, -30)), 0x8000);
+    }
+
+    //unit-length like a real embedding, with a dimension that isn't a multiple of the simd width
+    std::vector<float> unitVector(std::mt19937& rng, size_t dimension) {
+        std::normal_distribution<float> normal;
+        std::vector<float> values(dimension);
+        float norm = 0.0f;
+        for (float& value : values) {
+            value = normal(rng);
+            norm += value * value;
+        }
+        for (float& value : values) value /= std::sqrt(norm);
+        return values;
+    }
+
+    TEST(EmbeddingStore, EveryFormatKeepsTheVector) {
+        const size_t dimension = 389;
+        //float16 keeps ~3 significant digits, int8 is within half a step of the vector's largest value / 127
+        for (auto [format, tolerance] : {std::pair{EmbeddingFormat::FLOAT32, 0.0f}, std::pair{EmbeddingFormat::FLOAT16, 1e-3f},
+                                         std::pair{EmbeddingFormat::INT8, 0.0f}}) {
+            SCOPED_TRACE(embeddingFormatToString(format));
+            EmbeddingStore store(format);
+            std::mt19937 rng(5);
+            std::vector<std::vector<float>> vectors;
+            std::vector<EmbeddingRef> refs;
+            for (int i = 0; i < 50; i++) {
+                vectors.push_back(unitVector(rng, dimension));
+                refs.push_back(store.put(StringInterner::global().intern("store-vector-" + std::to_string(i)), vectors.back()));
+                ASSERT_FALSE(refs.back().empty());
+            }
+            std::vector<float> query = unitVector(rng, dimension);
+            std::vector<float> many(refs.size());
+            store.dotMany(query.data(), refs.data(), refs.size(), many.data());
+            for (size_t v = 0; v < vectors.size(); v++) {
+                std::vector<float> stored = store.values(refs[v]);
+                ASSERT_EQ(stored.size(), dimension);
+                float largest = 0.0f;
+                for (float value : vectors[v]) largest = std::max(largest, std::fabs(value));
+                float allowed = format == EmbeddingFormat::INT8 ? largest / 127.0f * 0.5001f : tolerance;
+                double exact = 0.0, decoded = 0.0;
+                for (size_t i = 0; i < dimension; i++) {
+                    ASSERT_NEAR(stored[i], vectors[v][i], allowed) << "element " << i;
+                    exact += static_cast<double>(vectors[v][i]) * query[i];
+                    decoded += static_cast<double>(stored[i]) * query[i];
+                }
+                //the kernel (simd or not) computes the dot product of what was stored, and ranks close to the exact one
+                EXPECT_NEAR(store.dot(refs[v], query.data()), decoded, 1e-5);
+                EXPECT_NEAR(decoded, exact, format == EmbeddingFormat::INT8 ? 0.02 : 1e-3);
+                EXPECT_EQ(many[v], store.dot(refs[v], query.data()));
+            }
+        }
+    }
+    TEST(EmbeddingStore, NamesShareAVectorAndDimensionIsFixed) {
+        EmbeddingStore store(EmbeddingFormat::FLOAT16);
+        InternedString name = StringInterner::global().intern("store-tachisme");
+        EmbeddingRef first = store.put(name, std::vector<float>{0.5f, 0.25f, -1.0f});
+        EmbeddingRef second = store.put(name, std::vector<float>{1.0f, 1.0f, 1.0f}); //the first vector for a name wins
+        EXPECT_EQ(first, second);
+        EXPECT_EQ(store.find(name), first);
+        EXPECT_EQ(store.values(second), (std::vector<float>{0.5f, 0.25f, -1.0f}));
+
+        EXPECT_TRUE(store.put(StringInterner::global().intern("store-wrong-size"), std::vector<float>{1.0f, 0.0f}).empty());
+        EXPECT_TRUE(store.put(name, std::vector<float>{}).empty());
+        EXPECT_TRUE(store.put(InternedString(), std::vector<float>{0, 0, 1}).empty()); //nothing to share it by, it would never be freed
+        EXPECT_EQ(store.getDimension(), 3u);
+        EXPECT_EQ(store.size(), 1u);
+        EXPECT_EQ(store.dot(EmbeddingRef(), std::vector<float>{1, 1, 1}.data()), 0.0f);
+        EXPECT_TRUE(store.values(EmbeddingRef()).empty());
+    }
+    TEST(EmbeddingStore, ForgetNamesStoresFreshVectors) {
+        EmbeddingStore store(EmbeddingFormat::FLOAT32);
+        InternedString name = StringInterner::global().intern("store-reimported");
+        EmbeddingRef before = store.put(name, std::vector<float>{1.0f, 0.0f});
+        store.forgetNames(); //what clear_cache does after weaviate's data was re-imported
+        EXPECT_TRUE(store.find(name).empty());
+        EmbeddingRef after = store.put(name, std::vector<float>{0.0f, 1.0f});
+        EXPECT_NE(after, before);
+        EXPECT_EQ(store.values(after), (std::vector<float>{0.0f, 1.0f}));
+        EXPECT_EQ(store.values(before), (std::vector<float>{1.0f, 0.0f})); //refs still held by in-flight nodes keep working
+        EXPECT_EQ(store.find(name), after);
+    }
+
+    //--- span tracing (tracing.hpp) ---
+
+    TEST(SpanRegistry, ShortLivedThreadsReuseBuffers) {
+        tracing::SpanRegistry& registry = tracing::SpanRegistry::instance();
+        std::atomic<bool> stop{false};
+        size_t exported = 0;
+        std::thread exporter([&]() { //exports while spans are being recorded, like /debug/trace during searches
+            while (!stop.load()) exported += tracing::chromeTraceJson(std::chrono::seconds(60))["traceEvents"].size();
+        });
+        size_t before = registry.bufferCount();
+        for (int round = 0; round < 50; round++) { //like the pinterest fan-out, a few threads per search that each record a span
+            std::vector<std::thread> workers;
+            for (int i = 0; i < 4; i++) {
+                workers.emplace_back([]() {
+                    tracing::setThreadName("unit-test-worker");
+                    tracing::ScopedSpan span("unit_test_span");
+                });
+            }
+            for (std::thread& worker : workers) worker.join();
+        }
+        stop = true;
+        exporter.join();
+        EXPECT_LE(registry.bufferCount(), before + 5); //4 workers and the exporter at most, not one buffer per thread
+        EXPECT_GT(exported, 0u);
+        EXPECT_EQ(registry.dropped(), 0u);
+
+        size_t spans = 0;
+        for (const tracing::SpanRecord& record : registry.collect(0)) {
+            spans += std::string_view(record.name) == "unit_test_span";
+        }
+        EXPECT_GE(spans, 4u); //recycled rings keep their last owners' spans until overwritten
+    }
+
+    //--- logger (logging.hpp) ---
+
+    TEST(Logger, ShortLivedThreadsReuseRings) {
+        logging::Logger& logger = logging::Logger::instance();
+        size_t before = logger.threadBufferCount();
+        for (int round = 0; round < 50; round++) { //like the std::async pinterest fetches that log a warning and exit
+            std::vector<std::thread> workers;
+            for (int i = 0; i < 4; i++) {
+                workers.emplace_back([round]() { LOG_WARN("unit test ring reuse " << round); });
+            }
+            for (std::thread& worker : workers) worker.join();
+        }
+        logger.flush();
+        EXPECT_LE(logger.threadBufferCount(), before + 4); //one ring per concurrent thread, not one per thread ever started
+    }
+
+    //--- engine cache (vector-engine.cpp) ---
+
+    std::vector<PinterestImage> oneImage(const std::string& id) {
+        PinterestImage image;
+        image.id = id;
+        return {image};
+    }
+
+    TEST(EngineCache, RefreshedImagesForUnseenConcepts) {
+        EngineCache cache;
+        size_t strings = StringInterner::global().stringCount();
+        cache.storeImages(std::string_view("cache-never-returned"), oneImage("pin-1"));
+        EXPECT_EQ(StringInterner::global().stringCount(), strings); //user text stays out of the interner
+        ASSERT_EQ(cache.images(std::string_view("cache-never-returned")).size(), 1u);
+        EXPECT_EQ(cache.images(std::string_view("cache-never-returned"))[0].id, "pin-1");
+
+        //a name weaviate has returned goes in the interned map, where searches find it too
+        InternedString known = StringInterner::global().intern("cache-returned");
+        cache.storeImages(std::string_view("cache-returned"), oneImage("pin-2"));
+        EXPECT_EQ(cache.images(known).size(), 1u);
+
+        cache.eraseImages("cache-never-returned");
+        EXPECT_TRUE(cache.images(std::string_view("cache-never-returned")).empty());
+        for (int i = 0; i < 1000; i++) cache.storeImages(std::string_view("cache-refresh-" + std::to_string(i)), oneImage("pin"));
+        EXPECT_LE(cache.size(), 257u); //bounded, plus the interned entry
+        EXPECT_FALSE(cache.images(std::string_view("cache-refresh-999")).empty());
+        cache.eraseImages("");
+        EXPECT_EQ(cache.size(), 0u);
+    }
+
+} //end of namespace UnitTests
@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#if defined(_MSC_VER)
+#include <stdlib.h> //_byteswap_uint64
+#endif
+//UUIDv7 (RFC 9562) generation without locks, syscalls or heap allocation
+//summary:
+//48 bits of unix milliseconds | version 7 | 12 bit counter | variant | 62 random bits
+//ids sort by creation time, so telemetry and mission ids can be ordered by comparing the strings
+//each thread keeps its own generator state, the 12 bit counter keeps ids from one thread strictly increasing within a millisecond
+//(a burst of more than ~2000 ids in one millisecond borrows from the next millisecond, as the RFC allows)
+//formatting writes 36 chars into a fixed buffer, generateUUID() only allocates for the std::string it returns
+
+namespace CoreSystems {
+namespace uuid {
+
+    using UuidText = std::array<char, 36>; //8-4-4-4-12 hex digits, not null terminated
+
+    namespace detail {
+        //trivially constructible so the thread_local needs no init guard, seeded on first use instead
+        struct GeneratorState {
+            uint64_t rngState;
+            uint64_t lastMs;
+            uint32_t counter;
+            bool seeded;
+
+            void seed() {
+                //random_device may be slow or deterministic on some platforms, so mix in the thread and the clock too
+                std::random_device device;
+                rngState = (static_cast<uint64_t>(device()) << 32) ^ device() ^
+                           std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+                           static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+                seeded = true;
+            }
+            //splitmix64, fast and good enough for the random part of an id (not for secrets)
+            uint64_t next() {
+                uint64_t z = (rngState += 0x9E3779B97F4A7C15ULL);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                return z ^ (z >> 31);
+            }
+        };
+        inline thread_local GeneratorState threadState{};
+
+        //the coarse clock is the last timer tick (1-4ms old) but costs a few ns instead of a full clock read,
+        //ids from one thread stay ordered through the counter either way
+        inline uint64_t unixMillis() {
+#if defined(CLOCK_REALTIME_COARSE)
+            timespec now;
+            clock_gettime(CLOCK_REALTIME_COARSE, &now);
+            return static_cast<uint64_t>(now.tv_sec) * 1000 + static_cast<uint64_t>(now.tv_nsec) / 1'000'000;
+#else
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+#endif
+        }
+
+        //8 lowercase hex digits of a 32 bit value, most significant first, without a lookup per digit:
+        //the nibbles are spread into one byte each, then turned into '0'-'9' / 'a'-'f' all at once
+        inline void hex8(uint32_t value, char* out) {
+            uint64_t x = value;
+            x = ((x & 0xFFFF0000ULL) << 16) | (x & 0x0000FFFFULL);
+            x = ((x & 0x0000FF000000FF00ULL) << 8) | (x & 0x000000FF000000FFULL);
+            x = ((x & 0x00F000F000F000F0ULL) << 4) | (x & 0x000F000F000F000FULL);
+            uint64_t letters = ((x + 0x0606060606060606ULL) >> 4) & 0x0101010101010101ULL; //1 in each byte that is >= 10
+            x += 0x3030303030303030ULL + letters * ('a' - '0' - 10);
+#if defined(_MSC_VER)
+            x = _byteswap_uint64(x); //first digit is in the top byte, memory order wants it in the lowest (little endian)
+#else
+            x = __builtin_bswap64(x);
+#endif
+            std::memcpy(out, &x, 8);
+        }
+    } //end of namespace detail
+
+    //the two 64 bit halves of a new v7 id
+    struct UuidBits {
+        uint64_t high; //unix ms | version | counter
+        uint64_t low; //variant | random
+    };
+    inline UuidBits generateV7Bits() {
+        auto& state = detail::threadState;
+        if (!state.seeded) {
+            state.seed();
+        }
+        uint64_t nowMs = detail::unixMillis();
+        if (nowMs > state.lastMs) {
+            state.lastMs = nowMs;
+            state.counter = static_cast<uint32_t>(state.next() & 0x3FF); //random start, leaves room for 3000+ ids this millisecond
+        } else if (++state.counter > 0xFFF) {
+            state.lastMs++; //counter ran out (or the clock went back), keep ordering by moving into the next millisecond
+            state.counter = 0;
+        }
+        return UuidBits{
+            (state.lastMs << 16) | 0x7000 | state.counter,
+            (state.next() & 0x3FFFFFFFFFFFFFFFULL) | 0x8000000000000000ULL //variant 10 + 62 random bits
+        };
+    }
+
+    //writes exactly 36 chars, no null terminator
+    inline void format(const UuidBits& bits, char* out) {
+        char digits[32];
+        detail::hex8(static_cast<uint32_t>(bits.high >> 32), digits);
+        detail::hex8(static_cast<uint32_t>(bits.high), digits + 8);
+        detail::hex8(static_cast<uint32_t>(bits.low >> 32), digits + 16);
+        detail::hex8(static_cast<uint32_t>(bits.low), digits + 24);
+        std::memcpy(out, digits, 8);
+        out[8] = '-';
+        std::memcpy(out + 9, digits + 8, 4);
+        out[13] = '-';
+        std::memcpy(out + 14, digits + 12, 4);
+        out[18] = '-';
+        std::memcpy(out + 19, digits + 16, 4);
+        out[23] = '-';
+        std::memcpy(out + 24, digits + 20, 12);
+    }
+
+    inline UuidText generateV7() {
+        UuidText text;
+        format(generateV7Bits(), text.data());
+        return text;
+    }
+    inline std::string_view view(const UuidText& text) { return std::string_view(text.data(), text.size()); }
+
+} //end of namespace uuid
+} //end of namespace CoreSystems
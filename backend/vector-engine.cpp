@@ -2,23 +2,18 @@
 #include "core-systems.hpp"
 #include <iostream>
 #include <curl/curl.h>
-#include <eigen3/Eigen/Dense>
 #include <algorithm>
 #include <future>
 #include <sstream>
 #include <cstdlib> //for std::getenv
+#include <cmath>
 #include <chrono>
 #include <filesystem>
-#ifdef _WIN32
-    #include <windows.h>
-    #include <psapi.h>
-#else 
-    #include <sys/resource.h>
-#endif
 
 #include <fstream>
 #include <string>
 #include <map>
+#include <charconv> //for std::from_chars
 
 
 namespace CoreSystems { 
@@ -37,29 +32,441 @@ namespace CoreSystems {
             };
         }
     };
+    //streaming parser for weaviate's graphql response
+    //curl hands over the body in chunks, so instead of buffering all of it and building a json DOM
+    //this scans each chunk as it arrives and fills the Node fields directly
+    //only data.Get.Concept[*].name, _additional.certainty and _additional.vector are kept, everything else is skipped
+    class WeaviateResponseParser {
+    public:
+        //nodes are appended to results and allocated from its memory resource
+        WeaviateResponseParser(NodeList& results, const int level, size_t expectedDimension = 0)
+            : results(results), level(level), dimensionHint(expectedDimension) {
+            stack.reserve(16);
+            token.reserve(64);
+        }
+
+        //scans the next chunk of the body, state is kept between calls so a token can be split across chunks
+        void feed(const char* data, size_t length) {
+            for (size_t i = 0; i < length && lex != Lex::ERROR; i++) {
+                consume(data[i]);
+            }
+        }
+        //call once the transfer is done, returns true if the body was complete, well formed json
+        //(numbers in skipped fields are only checked for their characters, the kept ones are converted and must parse)
+        bool finish() {
+            if (lex == Lex::NUMBER) {
+                endNumber();
+            } else if (lex == Lex::LITERAL) {
+                endLiteral();
+            }
+            if (lex == Lex::ERROR || !stack.empty() || !sawValue) {
+                lex = Lex::ERROR;
+                return false;
+            }
+            return true;
+        }
+        bool failed() const { return lex == Lex::ERROR; }
+        bool hasErrors() const { return sawErrors; } //weaviate put an "errors" array in the response
+        size_t dimension() const { return dimensionHint; } //length of the last vector seen, used to reserve() the next one
+
+    private:
+        //what a json container means in weaviate's response
+        enum class Role : uint8_t { OTHER, ROOT, DATA, GET, CONCEPT_ARRAY, CONCEPT, ADDITIONAL, VECTOR };
+        //object keys we care about, anything else is OTHER
+        enum class Field : uint8_t { OTHER, DATA, GET, NAME, ADDITIONAL, CERTAINTY, VECTOR, ERRORS };
+        enum class Lex : uint8_t { VALUE, STRING, STRING_ESCAPE, STRING_UNICODE, NUMBER, LITERAL, ERROR };
+
+        //what may come next inside a container, anything else is a syntax error
+        enum class Expect : uint8_t { KEY_OR_END, KEY, COLON, VALUE, VALUE_OR_END, COMMA_OR_END };
+
+        struct Frame {
+            Role role;
+            bool isObject;
+            Expect expect;
+            Field key; //key of the value currently being read
+        };
+
+        NodeList& results;
+        const int level;
+        size_t dimensionHint;
+
+        std::vector<Frame> stack;
+        std::string token; //string/number/literal being read, reused so it only allocates once
+        std::vector<float> vector; //current concept's vector, goes into the EmbeddingStore when the concept closes
+        Lex lex = Lex::VALUE;
+        bool sawValue = false;
+        bool sawErrors = false;
+        bool stringIsKey = false; //the string being read is an object key
+        uint32_t unicodeValue = 0;
+        int unicodeDigits = 0;
+        uint32_t highSurrogate = 0;
+
+        void consume(char c) {
+            switch (lex) {
+                case Lex::STRING:
+                    if (c == '"') {
+                        lex = Lex::VALUE;
+                        endString();
+                    } else if (c == '\\') {
+                        lex = Lex::STRING_ESCAPE;
+                    } else {
+                        token.push_back(c);
+                    }
+                    return;
+                case Lex::STRING_ESCAPE:
+                    lex = Lex::STRING;
+                    switch (c) {
+                        case '"': token.push_back('"'); break;
+                        case '\\': token.push_back('\\'); break;
+                        case '/': token.push_back('/'); break;
+                        case 'b': token.push_back('\b'); break;
+                        case 'f': token.push_back('\f'); break;
+                        case 'n': token.push_back('\n'); break;
+                        case 'r': token.push_back('\r'); break;
+                        case 't': token.push_back('\t'); break;
+                        case 'u':
+                            lex = Lex::STRING_UNICODE;
+                            unicodeValue = 0;
+                            unicodeDigits = 0;
+                            break;
+                        default: lex = Lex::ERROR; break;
+                    }
+                    return;
+                case Lex::STRING_UNICODE: {
+                    int digit = hexValue(c);
+                    if (digit < 0) {
+                        lex = Lex::ERROR;
+                        return;
+                    }
+                    unicodeValue = (unicodeValue << 4) | static_cast<uint32_t>(digit);
+                    if (++unicodeDigits == 4) {
+                        lex = Lex::STRING;
+                        appendCodePoint(unicodeValue);
+                    }
+                    return;
+                }
+                case Lex::NUMBER:
+                    if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                        token.push_back(c);
+                        return;
+                    }
+                    endNumber();
+                    break; //the char that ended the number still has to be handled as structure
+                case Lex::LITERAL:
+                    if (c >= 'a' && c <= 'z') {
+                        token.push_back(c);
+                        return;
+                    }
+                    endLiteral();
+                    break;
+                case Lex::ERROR:
+                    return;
+                case Lex::VALUE:
+                    break;
+            }
+            if (lex == Lex::ERROR) return;
+
+            switch (c) {
+                case ' ': case '\t': case '\n': case '\r':
+                    return;
+                case ':':
+                    if (stack.empty() || stack.back().expect != Expect::COLON) {
+                        lex = Lex::ERROR;
+                        return;
+                    }
+                    stack.back().expect = Expect::VALUE;
+                    return;
+                case ',':
+                    if (stack.empty() || stack.back().expect != Expect::COMMA_OR_END) {
+                        lex = Lex::ERROR;
+                        return;
+                    }
+                    stack.back().expect = stack.back().isObject ? Expect::KEY : Expect::VALUE;
+                    stack.back().key = Field::OTHER;
+                    return;
+                case '{':
+                case '[':
+                    if (beginValue()) pushFrame(c == '{');
+                    return;
+                case '}':
+                case ']':
+                    popFrame(c == '}');
+                    return;
+                case '"':
+                    stringIsKey = !stack.empty() && stack.back().isObject &&
+                                  (stack.back().expect == Expect::KEY_OR_END || stack.back().expect == Expect::KEY);
+                    if (!stringIsKey && !beginValue()) return;
+                    lex = Lex::STRING;
+                    token.clear();
+                    highSurrogate = 0;
+                    return;
+                default:
+                    token.clear();
+                    token.push_back(c);
+                    if ((c >= '0' && c <= '9') || c == '-') {
+                        lex = Lex::NUMBER;
+                    } else if (c >= 'a' && c <= 'z') {
+                        lex = Lex::LITERAL;
+                    } else {
+                        lex = Lex::ERROR;
+                        return;
+                    }
+                    beginValue();
+                    return;
+            }
+        }
+        //a value is starting, false (and ERROR) if the grammar doesn't allow one here
+        //the enclosing container then waits for a comma or its end, a value at the top level has to be the only one
+        bool beginValue() {
+            if (stack.empty()) {
+                if (sawValue) lex = Lex::ERROR;
+                return !sawValue;
+            }
+            Frame& top = stack.back();
+            if (top.expect != Expect::VALUE && top.expect != Expect::VALUE_OR_END) {
+                lex = Lex::ERROR;
+                return false;
+            }
+            top.expect = Expect::COMMA_OR_END;
+            return true;
+        }
+
+        Role childRole(bool isObject) const {
+            if (stack.empty()) {
+                return isObject ? Role::ROOT : Role::OTHER;
+            }
+            const Frame& parent = stack.back();
+            if (!parent.isObject) {
+                return (parent.role == Role::CONCEPT_ARRAY && isObject) ? Role::CONCEPT : Role::OTHER;
+            }
+            if (parent.role == Role::ROOT && parent.key == Field::DATA && isObject) return Role::DATA;
+            if (parent.role == Role::DATA && parent.key == Field::GET && isObject) return Role::GET;
+            if (parent.role == Role::GET && !isObject) return Role::CONCEPT_ARRAY; //"Concept", or an alias (c0, c1, ...) in a batched request
+            if (parent.role == Role::CONCEPT && parent.key == Field::ADDITIONAL && isObject) return Role::ADDITIONAL;
+            if (parent.role == Role::ADDITIONAL && parent.key == Field::VECTOR && !isObject) return Role::VECTOR;
+            return Role::OTHER;
+        }
+        void pushFrame(bool isObject) {
+            Role role = childRole(isObject);
+            if (!stack.empty() && stack.back().role == Role::ROOT && stack.back().key == Field::ERRORS && !isObject) {
+                sawErrors = true;
+            }
+            if (role == Role::CONCEPT) {
+                //a new concept, the node is created in place and filled in as its fields stream past
+                Node& node = results.emplace_back();
+                uuid::UuidText id = uuid::generateV7();
+                node.id.assign(id.data(), id.size());
+                node.similarityScore = 0.0f;
+                node.timestamp = utils::getCurrentTime();
+                node.healthStatus = SystemHealthEnum::NOMINAL;
+                node.level = level;
+                vector.clear();
+            } else if (role == Role::VECTOR && !results.empty()) {
+                vector.clear();
+                vector.reserve(dimensionHint);
+            }
+            stack.push_back(Frame{role, isObject, isObject ? Expect::KEY_OR_END : Expect::VALUE_OR_END, Field::OTHER});
+            sawValue = true;
+        }
+        void popFrame(bool isObject) {
+            if (stack.empty() || stack.back().isObject != isObject) {
+                lex = Lex::ERROR; //mismatched bracket
+                return;
+            }
+            Expect expect = stack.back().expect;
+            if (expect != Expect::COMMA_OR_END && expect != (isObject ? Expect::KEY_OR_END : Expect::VALUE_OR_END)) {
+                lex = Lex::ERROR; //trailing comma, or a key without its value
+                return;
+            }
+            if (stack.back().role == Role::VECTOR && !results.empty()) {
+                dimensionHint = vector.size();
+            } else if (stack.back().role == Role::CONCEPT && !results.empty() && !vector.empty()) {
+                //name and vector can come in either order, both are known once the concept closes
+                results.back().embedding = EmbeddingStore::global().put(results.back().name, vector);
+                vector.clear();
+            }
+            stack.pop_back();
+        }
+        void endString() {
+            sawValue = true;
+            if (stack.empty()) return;
+            Frame& top = stack.back();
+            if (stringIsKey) {
+                top.key = classifyKey(token);
+                top.expect = Expect::COLON;
+                return;
+            }
+            if (top.role == Role::CONCEPT && top.key == Field::NAME && !results.empty()) {
+                //names come from the dataset, so the interner stays bounded
+                //this runs inside curl's write callback, so a full interner fails the parse instead of throwing through curl
+                try {
+                    results.back().name = StringInterner::global().intern(token);
+                } catch (const std::length_error&) {
+                    lex = Lex::ERROR;
+                }
+            }
+        }
+        void endNumber() {
+            lex = Lex::VALUE;
+            sawValue = true;
+            if (stack.empty()) return;
+            const Frame& top = stack.back();
+            bool isCertainty = top.role == Role::ADDITIONAL && top.key == Field::CERTAINTY;
+            bool isVector = top.role == Role::VECTOR;
+            if (!isCertainty && !isVector) return; //skipped without converting
+            float value = 0.0f;
+            auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+            if (error == std::errc::result_out_of_range && end == token.data() + token.size() && isUnderflow(token)) {
+                //a well-formed number too small for a float, like 1e-46, is read as zero (keeping the sign) instead of failing the
+                //whole response, certainties and normalized embeddings are within [-1, 1] so an overflow is still an error
+                value = token.front() == '-' ? -0.0f : 0.0f;
+                error = std::errc();
+            }
+            if (error != std::errc() || end != token.data() + token.size()) {
+                lex = Lex::ERROR;
+                return;
+            }
+            if (results.empty()) return;
+            if (isCertainty) {
+                results.back().similarityScore = value;
+            } else {
+                vector.push_back(value);
+            }
+        }
+        //for a number float can't hold: whether it's too small rather than too big
+        //double settles almost every case, past double's range the sign of the exponent does (locale independent, unlike strtod)
+        static bool isUnderflow(const std::string& number) {
+            double wide = 0.0;
+            auto [end, error] = std::from_chars(number.data(), number.data() + number.size(), wide);
+            if (error == std::errc()) return std::fabs(wide) < 1.0;
+            size_t exponent = number.find_first_of("eE");
+            if (exponent != std::string::npos) return exponent + 1 < number.size() && number[exponent + 1] == '-';
+            size_t digits = number.front() == '-' ? 1 : 0;
+            return number.compare(digits, 2, "0.") == 0; //hundreds of digits with no exponent, only a leading "0." makes it small
+        }
+        void endLiteral() {
+            lex = Lex::VALUE;
+            sawValue = true;
+            if (token != "null" && token != "true" && token != "false") {
+                lex = Lex::ERROR;
+            }
+        }
+        static Field classifyKey(const std::string& key) {
+            if (key == "data") return Field::DATA;
+            if (key == "Get") return Field::GET;
+            if (key == "name") return Field::NAME;
+            if (key == "_additional") return Field::ADDITIONAL;
+            if (key == "certainty") return Field::CERTAINTY;
+            if (key == "vector") return Field::VECTOR;
+            if (key == "errors") return Field::ERRORS;
+            return Field::OTHER;
+        }
+        static int hexValue(char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+        void appendCodePoint(uint32_t cp) {
+            //\u escapes are utf-16, so characters outside the BMP arrive as a surrogate pair
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                highSurrogate = cp;
+                return;
+            }
+            if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                if (highSurrogate == 0) {
+                    cp = 0xFFFD;
+                } else {
+                    cp = 0x10000 + ((highSurrogate - 0xD800) << 10) + (cp - 0xDC00);
+                }
+            }
+            highSurrogate = 0;
+            if (cp < 0x80) {
+                token.push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                token.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else if (cp < 0x10000) {
+                token.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                token.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else {
+                token.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+                token.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+                token.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+        }
+    };
+    //waits for a client's curl handle until the request's deadline, in short slices so a cancelled request stops waiting too
+    static bool lockForRequest(std::unique_lock<std::timed_mutex>& lock, const SearchContext& context) {
+        static constexpr std::chrono::milliseconds LOCK_SLICE{5};
+        while (!context.expired()) {
+            if (lock.try_lock_until(std::min(SearchContext::Clock::now() + LOCK_SLICE, context.getDeadline()))) {
+                return true;
+            }
+        }
+        return false;
+    }
+    //curl progress callback, a non-zero return aborts the transfer with CURLE_ABORTED_BY_CALLBACK
+    //this is how the losing side of a hedged search gets its connection back
+    static int abortIfCancelled(void* context, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+        return static_cast<const SearchContext*>(context)->isCancelled() ? 1 : 0;
+    }
+    //outcomes that count against an upstream's circuit breaker: the transport failed or the service said it can't serve us
+    //(5xx, 401/403 for a bad key, 429 for rate limiting), other 4xx mean the service is up and the request was wrong
+    static bool isUpstreamFailure(CURLcode res, long responseCode) {
+        if (res != CURLE_OK) return true;
+        return responseCode >= 500 || responseCode == 401 || responseCode == 403 || responseCode == 429;
+    }
+    //call count, failures and latency of one upstream service, shared by every client talking to it
+    struct UpstreamMetrics {
+        metrics::Counter& requests;
+        metrics::Counter& errors;
+        LatencyHistogram& latency;
+
+        explicit UpstreamMetrics(const std::string& upstream)
+            : requests(metrics::Registry::instance().counter("palette_upstream_requests_total",
+                  "Requests sent to an upstream service", {{"upstream", upstream}})),
+              errors(metrics::Registry::instance().counter("palette_upstream_errors_total",
+                  "Upstream requests that failed (transport error, non-200 status or unparseable body)", {{"upstream", upstream}})),
+              latency(metrics::Registry::instance().histogram("palette_upstream_request_duration_seconds",
+                  "Time spent in curl_easy_perform per upstream request", {{"upstream", upstream}})) {}
+    };
+
     class WeaviateClient { //for semantic search
     private:
         std::string baseUrl;
         std::string apiKey; //for authentication
         CURL* curlHandle;
-        std::mutex curlMutex; //to protect curl handle from concurrent access
+        std::timed_mutex curlMutex; //to protect curl handle from concurrent access, timed so waiting for it respects the deadline
+        size_t embeddingDimension = 0; //vector length from the last response, so the next parse can reserve() up front
+        UpstreamMetrics upstreamMetrics{"weaviate"};
+        CircuitBreaker breaker; //one per replica url
         
         struct curlResponse { 
-            std::string data;
-            long responseCode;
+            WeaviateResponseParser parser;
+            std::string errorBody; //start of the body, only kept so failed requests can be logged
+            long responseCode = 0;
+            curlResponse(NodeList& results, const int level, size_t expectedDimension)
+                : parser(results, level, expectedDimension) {}
         };
+        static constexpr size_t MAX_ERROR_BODY = 512;
 
         static size_t writeCallback(void* contents, size_t size, size_t nmemb, curlResponse* response) {
-            //when data comes back from a request it will add it to curlResponse.data
+            //when data comes back from a request it is parsed straight away instead of being appended to a string
             //nmemb is number of elements
             size_t totalSize = size * nmemb;
-            response -> data.append(static_cast<char*>(contents), totalSize);
-                //casting void* contents to char*
+            const char* bytes = static_cast<char*>(contents); //casting void* contents to char*
+            response -> parser.feed(bytes, totalSize);
+            if (response -> errorBody.size() < MAX_ERROR_BODY) {
+                response -> errorBody.append(bytes, std::min(totalSize, MAX_ERROR_BODY - response -> errorBody.size()));
+            }
             return totalSize; //tells curl how many bytes were written
         }
     public: 
         explicit WeaviateClient(std:: string& baseUrl, const std::string& apiKey) //constructor
-            : baseUrl(baseUrl), apiKey(""), curlHandle(nullptr) { //initialziing the baseUrl to the input and curlHandle to nullptr
+            : baseUrl(baseUrl), apiKey(""), curlHandle(nullptr), breaker("weaviate", baseUrl) { //initialziing the baseUrl to the input and curlHandle to nullptr
                 curlHandle = curl_easy_init(); //creates a cURL, retuns nullptr if it fails
                 if (!curlHandle) { //throwing error if curlHandle is nullptr
                     throw std::runtime_error("Failed to initialize CURL for WeaviateClient");
@@ -72,134 +479,245 @@ namespace CoreSystems {
         }
         // Function to perform a semantic search
         //given a search string it will construct a GraphQL query
-        //also takes in level (0=query, 1=first level, 2=second level) to give to parseWeaviateResponse
+        //also takes in level (0=query, 1=first level, 2=second level) for the nodes it creates
         //post to weaviate endpoint
-        //parse results
+        //parse results as they stream in
         //return a vector of Nodes in descending order of closeness to query (most related nodes come first)
-        std::vector<Node> semanticSearch(const std::string& query, const int level) { 
-            //locking curlHandle with curlMutex
-            std::lock_guard<std::mutex> lock(curlMutex);
+        //the request only gets the time left in context, if the deadline hits first the result is empty and context is marked partial
+        //the nodes are allocated from the context's arena
+        NodeList semanticSearch(std::string_view query, const int level, const SearchContext& context) { 
+            return graphqlSearch(conceptSelection("", nearTextClause(query)), query, CONCEPT_LIMIT, level, context);
+        }
+        //the same search for an embedding the caller already has (the local query encoder's), weaviate doesn't vectorize anything
+        //label is only for logs
+        NodeList nearVectorSearch(const float* vector, size_t dimension, std::string_view label, const int level, const SearchContext& context) {
+            return graphqlSearch(conceptSelection("", nearVectorClause(vector, dimension)), label, CONCEPT_LIMIT, level, context);
+        }
+        //level-2 expansion of several nodes in one request, one aliased Concept search per node (c0, c1, ...)
+        //a node with a vector in the EmbeddingStore is searched by that vector, so weaviate doesn't re-embed a concept it just sent us,
+        //a node without one (no vector in the response, or the store was full) falls back to nearText on its name for its alias
+        //the nodes come back in the order of the aliases, each alias's matches closest first
+        NodeList expandConcepts(const Node* nodes, size_t count, const int level, const SearchContext& context) {
+            std::string selections;
+            std::string label; //names of the expanded nodes, for logs
+            for (size_t i = 0; i < count; i++) {
+                std::string nearClause;
+                if (!nodes[i].embedding.empty()) {
+                    std::vector<float> vector = EmbeddingStore::global().values(nodes[i].embedding);
+                    nearClause = nearVectorClause(vector.data(), vector.size());
+                } else {
+                    nearClause = nearTextClause(nodes[i].name);
+                }
+                selections += conceptSelection("c" + std::to_string(i), nearClause);
+                label += (i > 0 ? ", " : "") + std::string(nodes[i].name.view());
+            }
+            return graphqlSearch(selections, label, CONCEPT_LIMIT * count, level, context);
+        }
+    private:
+        static constexpr size_t CONCEPT_LIMIT = 10; //matches asked for per Concept search
+        //the concept is a graphql string inside a json string, nlohmann escapes it for graphql here and for json in graphqlSearch
+        static std::string nearTextClause(std::string_view text) {
+            return "nearText: { concepts: [" + nlohmann::json(text).dump() + "] }";
+        }
+        static std::string nearVectorClause(const float* vector, size_t dimension) {
+            std::string nearClause = "nearVector: { vector: [";
+            nearClause.reserve(nearClause.size() + dimension * 14 + 4);
+            char number[32];
+            for (size_t i = 0; i < dimension; i++) {
+                if (i > 0) nearClause.push_back(',');
+                auto written = std::to_chars(number, number + sizeof(number), vector[i]); //shortest text that reads back as the same float
+                nearClause.append(number, written.ptr);
+            }
+            nearClause += "] }";
+            return nearClause;
+        }
+        //one Concept search inside Get, alias is empty for a single search
+        static std::string conceptSelection(const std::string& alias, const std::string& nearClause) {
+            return (alias.empty() ? "" : alias + ": ") + "Concept(" + nearClause + " limit: " + std::to_string(CONCEPT_LIMIT) +
+                ") { name description _additional { certainty vector } } ";
+        }
+        //POST { Get { <selections> } }, everything semanticSearch describes above except building the selections
+        //expectedNodes only sizes the result up front
+        NodeList graphqlSearch(const std::string& selections, std::string_view query, size_t expectedNodes, const int level,
+                               const SearchContext& context) {
+            if (!breaker.acceptsRequests()) { //open breaker fails fast, before queueing for the curl handle
+                context.markPartial();
+                return {};
+            }
+            //locking curlHandle with curlMutex, giving up if it isn't free before the deadline
+            std::unique_lock<std::timed_mutex> lock(curlMutex, std::defer_lock);
+            if (!lockForRequest(lock, context)) {
+                LOG_WARN("Weaviate request for '" << query << "' skipped, request deadline reached");
+                context.markPartial();
+                return {};
+            }
+            //checked after the lock so a half-open probe is only handed out to a request that will really be sent
+            CircuitBreaker::Admission admission = breaker.allowRequest();
+            if (admission == CircuitBreaker::Admission::REJECTED) {
+                LOG_DEBUG("Weaviate request for '" << query << "' failed fast, circuit breaker for " << baseUrl << " is open");
+                context.markPartial();
+                return {};
+            }
             //constructing the GraphQL query
-            std::stringstream graphqlQuery;
-            graphqlQuery << R"({
-                "query": "{ Get { Concept(nearText: { concepts: [\")" << query << R"(\"] } limit: 10) { 
-                    name 
-                    description 
-                    _additional { 
-                        certainty 
-                        vector 
-                    } 
-                }}}"
-            })";
-            std::string postData = graphqlQuery.str();
-            std::cout << "Weaviate GraphQL Query: " << postData << std::endl;
+            std::string graphqlQuery = "{ Get { " + selections + "} }";
+            std::string postData = nlohmann::json{{"query", graphqlQuery}}.dump();
+            LOG_DEBUG("Weaviate GraphQL Query: " << postData);
             
             std::string url = baseUrl + "/v1/graphql";
 
-            curlResponse response; //curlResponse object to store data
+            NodeList results(context.memory());
+            results.reserve(expectedNodes);
+            curlResponse response(results, level, embeddingDimension); //parser writes nodes into results
     
             //configuring curl
             curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str()); //setting target url
             curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDS, postData.c_str()); //configures the postData query
             curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, writeCallback); //to handle incoming data
             curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, &response); //passes address of response to writeCallback 
+            curl_easy_setopt(curlHandle, CURLOPT_TIMEOUT_MS, static_cast<long>(std::max<int64_t>(1, context.remaining().count()))); //whole transfer must fit in the budget
+            curl_easy_setopt(curlHandle, CURLOPT_NOSIGNAL, 1L); //timeouts without SIGALRM, required when curl runs on several threads
+            curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 0L); //progress callback checks for cancellation
+            curl_easy_setopt(curlHandle, CURLOPT_XFERINFOFUNCTION, abortIfCancelled);
+            curl_easy_setopt(curlHandle, CURLOPT_XFERINFODATA, &context);
 
-            std::cout << "Sending request to Weaviate: " << url << std::endl;
+            LOG_DEBUG("Sending request to Weaviate: " << url);
             //setting headers
             struct curl_slist* headers = nullptr; //linked list of headers
             headers = curl_slist_append(headers, "Content-Type: application/json");
             if (!apiKey.empty()) { //adding API key to headers if it exists
                 std::string authHeader = "Authorization: Bearer " + apiKey;
                 headers = curl_slist_append(headers, authHeader.c_str());
-                std::cout << "added api key to curl headers" << std::endl;
+                LOG_DEBUG("added api key to curl headers");
             }
             curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, headers); //applies headers to curl request
             //executin request
-            CURLcode res = curl_easy_perform(curlHandle);
+            CURLcode res;
+            upstreamMetrics.requests.inc();
+            {
+                tracing::ScopedSpan transferSpan("curl.weaviate");
+                res = curl_easy_perform(curlHandle);
+                upstreamMetrics.latency.record(transferSpan.elapsedNs() / 1000);
+            }
             curl_slist_free_all(headers); //frees memory used by headers
                 //RES VS RESPONSE:
-                //response is the curlResponse struct that stores data from weaviate and the response code
+                //response is the curlResponse struct that holds the parser and the HTTP response code
                 //res is a CURLcode that just indicates if the request worked, not the HTTP response code
-            //checking for errors
-            if (res != CURLE_OK || response.responseCode != 200) {
-                std::cerr << "Weaviate request failed: " << curl_easy_strerror(res) 
-                      << " (HTTP " << response.responseCode << ")" << std::endl;
-            }
 
             //getting HTTP response code
             curl_easy_getinfo(curlHandle, CURLINFO_RESPONSE_CODE, &response.responseCode);
-            std::cout << "Weaviate Response Code: " << response.responseCode << std::endl;
-            std::cout << "Weaviate Response Data: " << response.data << std::endl;
+            LOG_DEBUG("Weaviate Response Code: " << response.responseCode);
+            if (res == CURLE_ABORTED_BY_CALLBACK) {
+                breaker.abandon(admission); //cancelled by us, says nothing about weaviate
+            } else {
+                breaker.record(admission, !isUpstreamFailure(res, response.responseCode));
+            }
 
-            //parsing JSON response
-            try {
-                auto jsonResponse = nlohmann::json::parse(response.data);
-                std::cout << " Weaviate Response: " << jsonResponse.dump(2) << std::endl;
-                return parseWeaviateResponse(jsonResponse, query, level); 
-            } catch (const std::exception& e) {
-                std::cerr << "Failed to parse Weaviate response: " << e.what() << std::endl;
+            //checking for errors
+            if (res == CURLE_ABORTED_BY_CALLBACK) {
+                LOG_DEBUG("Weaviate request for '" << query << "' cancelled");
+                context.markPartial();
                 return {};
             }
-        }
-    private:
-        //function to parse Weaviate JSON response and returns a vector of Nodes
-        std::vector<Node> parseWeaviateResponse (const nlohmann::json& response, const std::string& original_query, const int level) {
-            //using references to inputs to avoid copying and save memory - operations affect the original object
-            std::vector<Node> results;
-
-            if (!response.contains("data") || !response["data"].contains("Get") || !response["data"]["Get"].contains("Concept")) { 
-                return results; //returning empty vector if response doesn't have expected structure
-                std::cout << "Weaviate response missing expected fields, returning an empty vector" << std::endl;
+            if (res == CURLE_OPERATION_TIMEDOUT) {
+                upstreamMetrics.errors.inc();
+                LOG_WARN("Weaviate request for '" << query << "' cut off by the request deadline");
+                context.markPartial();
+                return {};
             }
-            std::cout <<"Raw weaviate response: " << response << std::endl;
-
-            const auto& concepts = response["data"]["Get"]["Concept"];
-                //read only reference to the concepts array in the json response
-                //concepts isnt an array by itself, but its memory spot points to the same spot as response["data"]["Get"]["Concept"] 
-            
-            for (const auto& c : concepts) { //iterating over each concept in the concepts array
-                Node node;
-                node.id = utils::generateUUID(); //generating a unique ID for the node
-                node.name = c.value("name", ""); //getting the name field, defaulting to empty string if not present
-                node.similarityScore = c["_additional"].value("certainty", 0.0f); //getting certainty from _additional field
-                node.timestamp = utils::getCurrentTime(); //setting current time as timestamp
-                node.healthStatus = SystemHealthEnum::NOMINAL; 
-                node.level = level;
-                
-                //extracting embedding vector
-                if (c["_additional"].contains("vector")) { 
-                    const auto& vector = c["_additional"]["vector"]; //reference to vector (ex. [0.1, 0.2, 0.3] - array of floats)
-                    if (vector.is_array()) { //checking if vector is an array 
-                        for (const auto& val : vector) {
-                            node.embedding.push_back(val.get<float>()); //adding each float in the vector array to node.embedding
-                        }
-                    }
-                }
-                results.push_back(std::move(node)); 
-                    //std::move(node) converts noce from lvalue(named object) to rvalue(temp)
-                    //push_back() detects that node is an rvalue and steals the memory+poiters from node instead of copying
-                    //more efficient than copying (which is just push_back(node))
+            if (res != CURLE_OK || response.responseCode != 200) {
+                upstreamMetrics.errors.inc();
+                LOG_ERROR("Weaviate request failed: " << curl_easy_strerror(res) 
+                      << " (HTTP " << response.responseCode << "): " << response.errorBody);
+                return {};
+            }
+            if (!response.parser.finish()) {
+                upstreamMetrics.errors.inc();
+                LOG_ERROR("Failed to parse Weaviate response: " << response.errorBody);
+                return {};
+            }
+            if (response.parser.hasErrors()) {
+                LOG_WARN("Weaviate returned errors: " << response.errorBody);
             }
-            return results; //returning the vector of Nodes
+            embeddingDimension = response.parser.dimension();
+            LOG_DEBUG("Weaviate returned " << results.size() << " concepts");
+            return results;
+        }
+    public:
+        //GET /v1/.well-known/ready on its own handle, so a probe never queues behind searches holding curlMutex
+        bool isReady(std::chrono::milliseconds timeout) {
+            CURL* probeHandle = curl_easy_init();
+            if (!probeHandle) return false;
+            std::string url = baseUrl + "/v1/.well-known/ready";
+            curl_easy_setopt(probeHandle, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(probeHandle, CURLOPT_NOBODY, 1L); //only the status code matters
+            curl_easy_setopt(probeHandle, CURLOPT_TIMEOUT_MS, static_cast<long>(timeout.count()));
+            curl_easy_setopt(probeHandle, CURLOPT_NOSIGNAL, 1L);
+            CURLcode res = curl_easy_perform(probeHandle);
+            long responseCode = 0;
+            curl_easy_getinfo(probeHandle, CURLINFO_RESPONSE_CODE, &responseCode);
+            curl_easy_cleanup(probeHandle);
+            return res == CURLE_OK && responseCode >= 200 && responseCode < 300;
+        }
+        const std::string& getBaseUrl() const { return baseUrl; }
+        bool acceptsRequests() const { return breaker.acceptsRequests(); }
+        nlohmann::json getBreakerStats() const { return breaker.toJson(); }
+        //parses a complete weaviate response body in one go, same result as streaming it through semanticSearch
+        static NodeList parseWeaviateResponse(const std::string& body, const int level, size_t expectedDimension = 0,
+                                              std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+            NodeList results(memory);
+            WeaviateResponseParser parser(results, level, expectedDimension);
+            parser.feed(body.data(), body.size());
+            if (!parser.finish()) {
+                return {}; //returning empty vector if response isn't valid json
+            }
+            return results;
         }
     };
 
     class PinterestClient {
         std::string apiKey;
+        std::string baseUrl; //DEFAULT_BASE_URL unless PINTEREST_API_URL points somewhere else
         CURL* curlHandle;
-        std::mutex curlMutex;
+        std::timed_mutex curlMutex;
+        static constexpr std::chrono::seconds DEFAULT_TIMEOUT{15}; //for calls made outside of a search (refreshPinterestData)
 
         //rate limiting
         std::atomic<uint32_t> requestsMade{0};
             //atomic variables let multiple threads access them without locks
         std::chrono::system_clock::time_point windowStart;
-        static constexpr uint32_t MAX_REQUESTS_PER_DAY = 1000; 
+        static constexpr const char* DEFAULT_BASE_URL = "https://api.pinterest.com";
+        static constexpr uint32_t DEFAULT_REQUESTS_PER_DAY = 1000; //the real api's daily quota
+        uint32_t maxRequestsPerDay; //0 means no daily cap
         std::mutex rateLimitMutex;
+        UpstreamMetrics upstreamMetrics{"pinterest"};
+        metrics::Gauge& remainingRequestsGauge = metrics::Registry::instance().gauge(
+            "palette_pinterest_rate_limit_remaining", "Pinterest requests left in the current daily window");
 
         struct curlResponse { 
             std::string data;
             long responseCode;
         };
+        //every engine has its own PinterestClient but they all call the same api, so they share one breaker
+        //leaked on purpose like the metrics registry, pinterest tasks can outlive static destruction
+        static CircuitBreaker& sharedBreaker() {
+            static CircuitBreaker* breaker = new CircuitBreaker("pinterest", configuredBaseUrl());
+            return *breaker;
+        }
+        //PINTEREST_API_URL (environment or .env) redirects the client, e.g. to mock-upstream for benchmarks
+        static std::string configuredBaseUrl() {
+            const char* configured = std::getenv("PINTEREST_API_URL");
+            std::string url = configured && *configured ? configured : DEFAULT_BASE_URL;
+            while (!url.empty() && url.back() == '/') url.pop_back();
+            return url;
+        }
+        //PALETTE_PINTEREST_DAILY_LIMIT overrides the cap, 0 turns it off
+        //without it only the real api is capped, a mock or proxy at PINTEREST_API_URL has no quota to protect
+        static uint32_t configuredDailyLimit(const std::string& url) {
+            if (const char* configured = std::getenv("PALETTE_PINTEREST_DAILY_LIMIT")) {
+                return static_cast<uint32_t>(std::clamp<long long>(std::atoll(configured), 0, UINT32_MAX));
+            }
+            return url == DEFAULT_BASE_URL ? DEFAULT_REQUESTS_PER_DAY : 0;
+        }
 
         static size_t writeCallback(void* contents, size_t size, size_t nmemb, curlResponse* response) { 
             //when data comes back from a request it will add it to curlResponse.data
@@ -211,11 +729,16 @@ namespace CoreSystems {
         }
     public:
         explicit PinterestClient(const std::string& apiKey) 
-            : apiKey(apiKey), curlHandle(nullptr), windowStart(std::chrono::system_clock::now()) {
+            : apiKey(apiKey), baseUrl(configuredBaseUrl()), curlHandle(nullptr), windowStart(std::chrono::system_clock::now()),
+              maxRequestsPerDay(configuredDailyLimit(baseUrl)) {
                 curlHandle = curl_easy_init(); //creates a cURL, retuns nullptr if it fails
                 if (!curlHandle) {
                     throw std::runtime_error("Failed to initialize CURL for PinterestClient");
                 }
+                if (maxRequestsPerDay == 0) {
+                    LOG_INFO("Pinterest client at " << baseUrl << " has no daily request limit");
+                }
+                remainingRequestsGauge.set(maxRequestsPerDay == 0 ? -1 : static_cast<int64_t>(maxRequestsPerDay)); //-1 when uncapped
         }
         ~PinterestClient() { //destructor
             if (curlHandle) {
@@ -224,6 +747,7 @@ namespace CoreSystems {
         }
 
         bool canMakeRequest() { 
+            if (maxRequestsPerDay == 0) return true;
             std::lock_guard<std::mutex> lock(rateLimitMutex);
             
             auto now = std::chrono::system_clock::now();
@@ -235,30 +759,70 @@ namespace CoreSystems {
             if (daysElapsed >= 1) {
                 requestsMade = 0;
                 windowStart = now;
+                remainingRequestsGauge.set(maxRequestsPerDay);
             }
-            return requestsMade < MAX_REQUESTS_PER_DAY; //returning true if requests made is less than max allowed
+            return requestsMade < maxRequestsPerDay; //returning true if requests made is less than max allowed
         }
-        uint32_t getRemainingRequests() { //requests left that can be made today
+        //counts a request against today's window, false once the cap is reached
+        bool reserveRequest() {
+            if (maxRequestsPerDay == 0) {
+                ++requestsMade;
+                return true;
+            }
             std::lock_guard<std::mutex> lock(rateLimitMutex);
-            return MAX_REQUESTS_PER_DAY - requestsMade.load(); 
+            if (requestsMade >= maxRequestsPerDay) return false;
+            uint32_t made = ++requestsMade;
+            remainingRequestsGauge.set(static_cast<int64_t>(maxRequestsPerDay) - made);
+            return true;
+        }
+        static bool acceptsRequests() { return sharedBreaker().acceptsRequests(); }
+        static nlohmann::json getBreakerStats() { return sharedBreaker().toJson(); }
+        uint32_t getRemainingRequests() { //requests left that can be made today, UINT32_MAX when uncapped
+            if (maxRequestsPerDay == 0) return UINT32_MAX;
+            std::lock_guard<std::mutex> lock(rateLimitMutex);
+            uint32_t made = requestsMade.load();
+            return made < maxRequestsPerDay ? maxRequestsPerDay - made : 0; 
         }
 
-        std::vector<PinterestImage> searchPins (const std::string& query) { //makes request to pinterest for pins
+        std::vector<PinterestImage> searchPins (std::string_view query) {
+            SearchContext context(DEFAULT_TIMEOUT);
+            return searchPins(query, context);
+        }
+        //makes request to pinterest for pins, within whatever time is left in context
+        std::vector<PinterestImage> searchPins (std::string_view query, const SearchContext& context) {
             if (!canMakeRequest()) {
-                std::cout << "Pinterest rate limit exceeded, using cached data instead" << std::endl;
+                LOG_WARN("Pinterest rate limit exceeded, using cached data instead");
+                return {};
+            }
+            if (!sharedBreaker().acceptsRequests()) { //fast path, no waiting for the curl handle while the breaker is open
                 return {};
             }
 
-            std::lock_guard<std::mutex> lock(curlMutex);
-            requestsMade++;
+            std::unique_lock<std::timed_mutex> lock(curlMutex, std::defer_lock);
+            if (!lockForRequest(lock, context)) {
+                LOG_DEBUG("Pinterest request for '" << query << "' skipped, request deadline reached");
+                context.markPartial();
+                return {};
+            }
+            CircuitBreaker::Admission admission = sharedBreaker().allowRequest();
+            if (admission == CircuitBreaker::Admission::REJECTED) {
+                LOG_TRACE("Pinterest request for '" << query << "' failed fast, circuit breaker is open");
+                return {};
+            }
+            if (!reserveRequest()) { //canMakeRequest() above is only a fast path, concurrent searches can all pass it
+                LOG_WARN("Pinterest rate limit exceeded, using cached data instead");
+                sharedBreaker().abandon(admission);
+                return {};
+            }
 
             //constructing the Pinterest API search URL
-            char* escapedQuery = curl_easy_escape(curlHandle, query.c_str(), query.length());
+            char* escapedQuery = curl_easy_escape(curlHandle, query.data(), static_cast<int>(query.length()));
             if (!escapedQuery) {
-                std::cerr << "Failed to escape query for Pinterest API" << std::endl;
+                LOG_ERROR("Failed to escape query for Pinterest API");
+                sharedBreaker().abandon(admission);
                 return {};
             }
-            std::string url = "https://api.pinterest.com/v5/pins/search?query=" + 
+            std::string url = baseUrl + "/v5/pins/search?query=" + 
                          std::string(escapedQuery) + 
                          "&limit=10";
 
@@ -269,7 +833,11 @@ namespace CoreSystems {
             curl_easy_setopt(curlHandle, CURLOPT_HTTPGET, 1L); //making the request a GET request
             curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, writeCallback); //assigning writeCallback to handle incoming data
             curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, &response); //passes address of response (then writeCallback uses response)
-            curl_easy_setopt(curlHandle, CURLOPT_TIMEOUT, 15L); //15 second timeout for api
+            curl_easy_setopt(curlHandle, CURLOPT_TIMEOUT_MS, static_cast<long>(std::max<int64_t>(1, context.remaining().count()))); //whatever is left of the request's budget
+            curl_easy_setopt(curlHandle, CURLOPT_NOSIGNAL, 1L); //timeouts without SIGALRM, these calls run on many threads at once
+            curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 0L);
+            curl_easy_setopt(curlHandle, CURLOPT_XFERINFOFUNCTION, abortIfCancelled);
+            curl_easy_setopt(curlHandle, CURLOPT_XFERINFODATA, &context);
 
             //auth header
             struct curl_slist* headers = nullptr; //headers points to the spot in memory where the actual headers are stored
@@ -278,31 +846,50 @@ namespace CoreSystems {
             curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, headers);
 
             //execute request
-            CURLcode res = curl_easy_perform(curlHandle);
+            CURLcode res;
+            upstreamMetrics.requests.inc();
+            {
+                tracing::ScopedSpan transferSpan("curl.pinterest");
+                res = curl_easy_perform(curlHandle);
+                upstreamMetrics.latency.record(transferSpan.elapsedNs() / 1000);
+            }
                 //RES VS RESPONSE:
                 //response is the curlResponse struct that stores data from weaviate and the HTTP response code
                 //res is a CURLcode that just indicates if the request worked, not the HTTP response code
             curl_easy_getinfo(curlHandle, CURLINFO_RESPONSE_CODE, &response.responseCode);
             curl_slist_free_all(headers);
+            if (res == CURLE_ABORTED_BY_CALLBACK) {
+                sharedBreaker().abandon(admission);
+            } else {
+                sharedBreaker().record(admission, !isUpstreamFailure(res, response.responseCode));
+            }
 
+            if (res == CURLE_OPERATION_TIMEDOUT || res == CURLE_ABORTED_BY_CALLBACK) {
+                if (res == CURLE_OPERATION_TIMEDOUT) upstreamMetrics.errors.inc();
+                LOG_DEBUG("Pinterest request for '" << query << "' cut off by the request deadline");
+                context.markPartial();
+                return {};
+            }
             if (res != CURLE_OK || response.responseCode != 200) {
-                std::cerr << "Pinterest request failed: " << curl_easy_strerror(res) 
-                      << " (HTTP " << response.responseCode << ")" << std::endl;
+                upstreamMetrics.errors.inc();
+                LOG_ERROR("Pinterest request failed: " << curl_easy_strerror(res) 
+                      << " (HTTP " << response.responseCode << ")");
                 return {};
             }
 
             //parse pinterest api response
             try {
                 auto jsonResponse = nlohmann::json::parse(response.data); //converts json string into a C++ nlohmann::json object
-                std::cout << "raw pinterest api response: " << jsonResponse.dump(2) << std::endl;
+                LOG_TRACE("raw pinterest api response: " << jsonResponse.dump());
                 return parsePinterestResponse(jsonResponse);
             } catch (const std::exception& e) {
-                std::cerr << "Failed to parse Pinterest response: " << e.what() << std::endl;
+                upstreamMetrics.errors.inc();
+                LOG_ERROR("Failed to parse Pinterest response: " << e.what());
                 return {};
             }
         }
-    private: 
-            std::vector<PinterestImage> parsePinterestResponse (const nlohmann::json& response) {
+        //static and public so the microbenchmarks can run it on recorded payloads without a client
+            static std::vector<PinterestImage> parsePinterestResponse (const nlohmann::json& response) {
                 std::vector<PinterestImage> images;
                 
                 if (!response.contains("items") || 
@@ -337,10 +924,28 @@ namespace CoreSystems {
         };
 
         //implementing VectorEngine
-        VectorEngine::VectorEngine(const std::string& engineType) //engine type is "primary" or "backup"
+        VectorEngine::VectorEngine(const std::string& engineType, TelemetryProcessor* telemetryProcessor,
+                                   std::shared_ptr<EngineCache> cache, std::string weaviateUrl,
+                                   std::shared_ptr<QueryEncoder> queryEncoder) //engine type is "primary", "backup" or "replica-N"
             : engineId(utils::generateUUID()), //setting up vector engine member variables
             engineType(engineType),
-            lastCacheUpdate(std::chrono::system_clock::now()) {
+            weaviateUrl(std::move(weaviateUrl)),
+            telemetryProcessor(telemetryProcessor),
+            cache(cache ? std::move(cache) : std::make_shared<EngineCache>()),
+            queryEncoder(std::move(queryEncoder)) {
+        }
+        EngineCache::EngineCache()
+            : searchCacheMetrics(registerCacheMetrics("search")),
+              imageCacheMetrics(registerCacheMetrics("image")) {}
+        EngineCache::CacheMetrics EngineCache::registerCacheMetrics(const std::string& cacheName) {
+            auto& registry = metrics::Registry::instance();
+            metrics::Labels labels = {{"cache", cacheName}};
+            return CacheMetrics{
+                &registry.counter("palette_cache_hits_total", "Cache lookups that found a usable entry", labels),
+                &registry.counter("palette_cache_misses_total", "Cache lookups that found nothing usable", labels),
+                &registry.counter("palette_cache_evictions_total", "Entries removed because the cache was full", labels),
+                &registry.gauge("palette_cache_entries", "Entries currently in the cache", labels)
+            };
         }
 
         VectorEngine::~VectorEngine() {
@@ -373,22 +978,32 @@ namespace CoreSystems {
 
                 vars[key] = value;
 
+#ifdef _WIN32
                 std::string assignment = key + "=" + value;
-                 _putenv(assignment.c_str());
+                _putenv(assignment.c_str());
+#else
+                setenv(key.c_str(), value.c_str(), 1);
+#endif
             }
             return vars;
         }
         bool VectorEngine::initialize() {
             try { //initializing weaviate and pinterest clients
-                std::string weaviateUrl = (engineType == "primary") ? "http://localhost:8080" : "http://backup-weaviate:8080";
-                
-                std::cout << "Current working directory: " << std::filesystem::current_path() << std::endl;
-                std::cout << "Looking for .env file..." << std::endl;
+                LOG_INFO("Current working directory: " << std::filesystem::current_path());
+                LOG_INFO("Looking for .env file...");
 
                 //getting weaviate api key from environment variable
                 auto env = load_env("backend/.env"); //loading environment variables from .env file
                 std::string weaviateApiKey = "";
 
+                if (weaviateUrl.empty()) { //WEAVIATE_URL / WEAVIATE_BACKUP_URL, from the environment or .env
+                    const char* configured = std::getenv(engineType == "primary" ? "WEAVIATE_URL" : "WEAVIATE_BACKUP_URL");
+                    weaviateUrl = configured && *configured ? configured
+                        : (engineType == "primary") ? "http://localhost:8080" : "http://backup-weaviate:8080";
+                }
+                while (!weaviateUrl.empty() && weaviateUrl.back() == '/') weaviateUrl.pop_back();
+                LOG_INFO(engineType << " Vector Engine using Weaviate at " << weaviateUrl);
+
                 weaviateClient = std::make_unique<WeaviateClient>(weaviateUrl, weaviateApiKey);
                     //std::make_unique returns a std::unique_ptr<WeaviateClient>
                     //this object will be deleted when unique_ptr goes out of scope (vector engine objecft is deleted or weaviateClient is reset/gets new pointer)
@@ -398,98 +1013,240 @@ namespace CoreSystems {
                 std::string pinterestApiKey = env.count("PINTEREST_API_KEY") ? 
                     env["PINTEREST_API_KEY"] : "" ;
                 if (pinterestApiKey.empty()) {
-                    std::cerr << "PINTEREST_API_KEY is not set" << std::endl;
+                    LOG_WARN("PINTEREST_API_KEY is not set");
                 } else {
-                    std::cout << "PINTEREST_API_KEY loaded from .env file" << std::endl;
+                    LOG_INFO("PINTEREST_API_KEY loaded from .env file");
                 }
 
                 pinterestClient = std::make_unique<PinterestClient>(pinterestApiKey);
                     //weaviateClient and pinterestClient are pointers bc of std::make_unique
                     //they point to the address of the new WeaviateClient/PinterestClient object
                 isOperational.store(true);
-                std::cout << engineType << " Vector Engine initialized: " << engineId << std::endl;
+                LOG_INFO(engineType << " Vector Engine initialized: " << engineId);
 
                 return true;
             } catch (const std::exception& e) {
-                std::cerr << "Failed to initialize " << engineType << " Vector Engine: " << e.what() << std::endl;
+                LOG_ERROR("Failed to initialize " << engineType << " Vector Engine: " << e.what());
                 return false;
             }
         }
         void VectorEngine::shutdown() {
             isOperational = false;
-            clearCache();
+            probeHealthy = false;
+            //the cache is shared with the other engines, so it stays (SystemManager::shutdown clears it)
         }
-        std::vector<Node> VectorEngine::vectorSearch(const std::string& query) {
+        SearchResult VectorEngine::vectorSearch(const std::string& query, const SearchContext& context, DegradationTier tier) {
             if (!isOperational) {
                 throw std::runtime_error(engineType + " Vector Engine is not operational");
             }
-            std::cout << engineType << " Engine: Starting vector search for '" << query << "'" << std::endl;
-            //checking local cache first
-            auto cachedResults = checkCache(query);
+            LOG_DEBUG(engineType << " Engine: Starting vector search for '" << query << "' (tier " << degradationTierToString(tier) << ")");
+            outstandingSearches.fetch_add(1, std::memory_order_relaxed);
+            struct OutstandingGuard {
+                std::atomic<uint32_t>& count;
+                ~OutstandingGuard() { count.fetch_sub(1, std::memory_order_relaxed); }
+            } outstandingGuard{outstandingSearches};
+            SearchResult result(context); //every node below is allocated from the request's arena
+            result.tier = tier;
+            result.servedBy = engineType;
+            //checking local cache first, under MINIMAL an expired entry is still better than another upstream call
+            NodeList cachedResults(context.memory());
+            {
+                auto span = stageSpan(PipelineStage::CACHE_LOOKUP, "vector_engine.cache_lookup");
+                cachedResults = checkCache(query, context.memory(), tier == DegradationTier::MINIMAL, &result.stale);
+            }
             if (!cachedResults.empty()) { //match found in cache
-                std::cout << "Cached result found for query: " << query << std::endl; 
-                return cachedResults;
+                LOG_DEBUG("Cached result found for query: " << query << (result.stale ? " (stale)" : ""));
+                result.nodes = std::move(cachedResults);
+                result.fromCache = true;
+                context.markLevel1Complete();
+                return result;
             }
             
-            auto relatedNodes = weaviateClient -> semanticSearch(query, 1); //using -> bc weaviateClient is a pointer to the acc WeaviateClient object
+            std::vector<float> queryEmbedding; //stays empty without a local encoder, or if the query normalizes to nothing
+            if (queryEncoder) {
+                auto span = stageSpan(PipelineStage::QUERY_ENCODE, "query_encoder.encode");
+                queryEmbedding = queryEncoder -> encode(query);
+            }
+            NodeList relatedNodes(context.memory());
+            {
+                auto span = stageSpan(PipelineStage::WEAVIATE_LEVEL1, "weaviate.level1");
+                if (!queryEmbedding.empty()) {
+                    relatedNodes = weaviateClient -> nearVectorSearch(queryEmbedding.data(), queryEmbedding.size(), query, 1, context);
+                } else {
+                    relatedNodes = weaviateClient -> semanticSearch(query, 1, context); //using -> bc weaviateClient is a pointer to the acc WeaviateClient object
+                }
+                if (!context.isCancelled()) { //a cancelled call says nothing about how fast this engine is
+                    uint64_t latencyUs = span.elapsedNs() / 1000;
+                    level1Latency.record(latencyUs);
+                    recordOutcome(latencyUs, relatedNodes.empty() && !context.isPartial());
+                }
+            }
+            context.markLevel1Complete();
             if (relatedNodes.empty()) {
-                std::cout << "No related concepts found for query: " << query << std::endl;
-                return {};
+                LOG_DEBUG("No related concepts found for query: " << query);
+                result.partial = context.isPartial();
+                return result;
+            }
+            if (context.expired()) { //nothing left for expansion or images, level-1 is the answer
+                context.markPartial();
+                result.nodes = std::move(relatedNodes);
+                result.partial = true;
+                return result;
+            }
+            if (tier == DegradationTier::MINIMAL) {
+                result.nodes = std::move(relatedNodes); //level-1 only, nothing else goes upstream
+                return result;
             }
             
-            std::vector<Node> allNodes = relatedNodes;
+            NodeList allNodes = std::move(relatedNodes); //level-1 nodes stay at the front, level-2 nodes are appended
 
-            //getting second level nodes for top 3 nodes 
-            size_t numTopNodes = std::min(static_cast<size_t>(3), relatedNodes.size());
-                //finds how many top nodes there are(either 3 or less than 3 if relatedConcepts has less than 3)
-            for (size_t i = 0; i < numTopNodes; i++) { 
-                //getting related nodes for each in relatedNodes
-                //semanticSearch returns nodes in descending order of closeness to query, so relatedNodes[0] is the node closest to query
-                auto secondLevelNodes = weaviateClient -> semanticSearch(relatedNodes[i].name, 2);
-                allNodes.insert(allNodes.end(), secondLevelNodes.begin(), secondLevelNodes.end()); //adding second level nodes to end of allNodes
+            //getting second level nodes for the top nodes, 3 normally and 1 when DEGRADED
+            size_t level2Fanout = tier == DegradationTier::FULL ? LEVEL2_NODES_FULL : LEVEL2_NODES_REDUCED;
+            size_t numTopNodes = std::min(level2Fanout, allNodes.size());
+                //finds how many top nodes there are(either the fan-out or less if relatedConcepts has fewer)
+            //semanticSearch returns nodes in descending order of closeness to query, so allNodes[0] is the node closest to query
+            //all the expansions go in one request, searched by the vectors level-1 already returned (see expandConcepts)
+            {
+                auto span = stageSpan(PipelineStage::WEAVIATE_LEVEL2, "weaviate.level2");
+                auto secondLevelNodes = weaviateClient -> expandConcepts(allNodes.data(), numTopNodes, 2, context);
+                allNodes.insert(allNodes.end(), std::make_move_iterator(secondLevelNodes.begin()), std::make_move_iterator(secondLevelNodes.end())); //adding second level nodes to end of allNodes
+            }
+            if (tier == DegradationTier::REDUCED || context.expired()) {
+                //no pinterest fan-out, images for these nodes are whatever the image cache already has
+                if (tier == DegradationTier::FULL) {
+                    context.markPartial(); //the fan-out was meant to run but there's no time left for it
+                }
+                result.nodes = std::move(allNodes);
+                result.partial = context.isPartial();
+                return result;
             }
 
             //adding pinterest images to each node (asynchronous)
-            auto enhancedNodes = enhanceWithPinterestData(std::move(allNodes));;
-            
-            updateCache(query, enhancedNodes);
-            std::cout << engineType << " Engine: Found " << enhancedNodes.size() << " enhanced nodes" << std::endl;
-            return enhancedNodes;
+            {
+                auto span = stageSpan(PipelineStage::PINTEREST_ENRICHMENT, "pinterest.enrichment");
+                result.nodes = enhanceWithPinterestData(std::move(allNodes), context);
+            }
+            result.partial = context.isPartial();
+            if (!result.partial) {
+                updateCache(query, result.nodes); //only full, complete results are cached, so a degraded answer never outlives the overload
+            }
+            LOG_DEBUG(engineType << " Engine: Found " << result.nodes.size() << " enhanced nodes");
+            return result;
 
         }
-        std::vector<Node> VectorEngine::checkCache(const std::string& query) {
+        std::optional<std::chrono::microseconds> VectorEngine::level1LatencyQuantile(double quantile, size_t minSamples) const {
+            HistogramSnapshot recent = level1Latency.window(std::chrono::minutes(1));
+            if (recent.count < minSamples) {
+                return std::nullopt;
+            }
+            return std::chrono::microseconds(recent.valueAtQuantile(quantile));
+        }
+        tracing::ScopedSpan VectorEngine::stageSpan(PipelineStage stage, const char* name) {
+            //returned as a prvalue so the span is constructed directly in the caller's scope
+            return tracing::ScopedSpan(name, stage, telemetryProcessor ? telemetryProcessor->stageHistogram(stage) : nullptr);
+        }
+        void VectorEngine::recordOutcome(uint64_t latencyUs, bool failed) {
+            double sample = static_cast<double>(failed ? std::max(latencyUs, FAILURE_PENALTY_US) : latencyUs);
+            double current = latencyEwmaUs.load(std::memory_order_relaxed);
+            latencyEwmaUs.store(current <= 0.0 ? sample : current + (sample - current) * LATENCY_EWMA_WEIGHT, std::memory_order_relaxed);
+            completedSearches.fetch_add(1, std::memory_order_relaxed);
+        }
+        bool VectorEngine::probe() {
+            if (!isOperational || !weaviateClient) {
+                return false;
+            }
+            bool ready = weaviateClient->isReady(PROBE_TIMEOUT);
+            if (ready) {
+                consecutiveProbeFailures = 0;
+                if (!probeHealthy.exchange(true)) {
+                    LOG_INFO(engineType << " Vector Engine passed its readiness probe, taking traffic");
+                }
+            } else if (++consecutiveProbeFailures >= PROBE_FAILURE_THRESHOLD && probeHealthy.exchange(false)) {
+                LOG_WARN(engineType << " Vector Engine failed " << PROBE_FAILURE_THRESHOLD << " readiness probes, taking it out of rotation");
+            }
+            return ready;
+        }
+        bool VectorEngine::acceptsSearches() const {
+            return isOperational.load() && weaviateClient && weaviateClient->acceptsRequests();
+        }
+        nlohmann::json VectorEngine::getBreakerStats() const {
+            return weaviateClient ? weaviateClient->getBreakerStats() : nlohmann::json(nullptr);
+        }
+        nlohmann::json VectorEngine::getStats() const {
+            return nlohmann::json{
+                {"engine", engineType},
+                {"weaviate_url", weaviateUrl},
+                {"operational", isEngineOperational()},
+                {"probe_healthy", isProbeHealthy()},
+                {"outstanding_searches", getOutstandingSearches()},
+                {"latency_ewma_ms", getLatencyEwmaUs() / 1000.0},
+                {"completed_searches", getCompletedSearches()},
+                {"weaviate_breaker", getBreakerStats()}
+            };
+        }
+        NodeList VectorEngine::checkCache(std::string_view query, std::pmr::memory_resource* memory, bool allowStale, bool* stale) {
+            return cache->lookup(query, memory, allowStale, stale);
+        }
+        void VectorEngine::updateCache(std::string_view query, const NodeList& nodes) {
+            cache->store(query, nodes);
+        }
+        NodeList EngineCache::lookup(std::string_view query, std::pmr::memory_resource* memory, bool allowStale, bool* stale) {
+            std::string key(query); //built before the lock, the map has no string_view lookup in C++17
             std::lock_guard<std::mutex> lock(cacheMutex); 
             
-            auto result = searchCache.find(query);
+            auto result = searchCache.find(key);
                 //if the query doesn't exist in the cache, then result will be a pointer to the end of searchCache container
 
             if (result != searchCache.end()) { //if false, them result points to searchCache.end() which means its not in cache
                 //checking if cache is valid
                 auto now = std::chrono::system_clock::now();
-                if (now - lastCacheUpdate < CACHE_EXPIRY_TIME) {
-                    //returning the value of the query key
-                    return result -> second; 
-                } else { //cache has expired
-                    searchCache.erase(result);
+                bool expired = now - result->second.storedAt >= CACHE_EXPIRY_TIME;
+                //expired entries are kept (as a fallback for CRITICAL) until they're refreshed or trimmed
+                if (!expired || allowStale) {
+                    if (stale) *stale = expired;
+                    searchCacheMetrics.hits->inc();
+                    return NodeList(result -> second.nodes, memory); //copied into the caller's arena
                 }
             }
-            return {};
+            searchCacheMetrics.misses->inc();
+            return NodeList(memory);
         }
-        void VectorEngine::updateCache(const std::string& query, const std::vector<Node>& nodes) {
+        void EngineCache::store(std::string_view query, const NodeList& nodes) {
+            std::string key(query);
+            NodeList heapCopy(nodes, std::pmr::new_delete_resource()); //copied before taking the lock, the request's arena dies with the request
             std::lock_guard<std::mutex> lock(cacheMutex);
             //assiging the new nodes as the value to the key/query
-            searchCache[query] = nodes;
-            lastCacheUpdate = std::chrono::system_clock::now();
+            searchCache[std::move(key)] = SearchCacheEntry{std::move(heapCopy), std::chrono::system_clock::now()};
 
             //limiting cache size
-            if (searchCache.size() > 1000) {
-                //removing the 100 oldest queries
-                auto oldest = searchCache.begin();
-                searchCache.erase(oldest, std::next(oldest, 100));
+            if (searchCache.size() > MAX_SEARCH_CACHE_ENTRIES) {
+                //removing the oldest queries, found with a partial sort of the timestamps
+                std::vector<std::chrono::system_clock::time_point> ages;
+                ages.reserve(searchCache.size());
+                for (const auto& [key, entry] : searchCache) {
+                    ages.push_back(entry.storedAt);
+                }
+                std::nth_element(ages.begin(), ages.begin() + (SEARCH_CACHE_TRIM - 1), ages.end());
+                auto cutoff = ages[SEARCH_CACHE_TRIM - 1];
+                size_t removed = 0;
+                for (auto it = searchCache.begin(); it != searchCache.end() && removed < SEARCH_CACHE_TRIM;) {
+                    if (it->second.storedAt <= cutoff) {
+                        it = searchCache.erase(it);
+                        removed++;
+                    } else {
+                        ++it;
+                    }
+                }
+                searchCacheMetrics.evictions->inc(removed);
             }
+            searchCacheMetrics.entries->set(static_cast<int64_t>(searchCache.size()));
         }
-        std::vector<Node> VectorEngine::enhanceWithPinterestData(std::vector<Node> nodes) {
-            std::cout << "Enhancing " << nodes.size() << " nodes with Pinterest data" << std::endl;
+        NodeList VectorEngine::enhanceWithPinterestData(NodeList nodes, const SearchContext& context) {
+            LOG_DEBUG("Enhancing " << nodes.size() << " nodes with Pinterest data");
+            if (!PinterestClient::acceptsRequests()) { //open breaker: no point starting a task per node just to fail each one
+                LOG_DEBUG("Pinterest circuit breaker is open, skipping image fan-out");
+                return nodes;
+            }
             
             //Pinterest requests done asynchronously for better performance
             std::vector<std::future<std::vector<PinterestImage>>> pinterestFutures;
@@ -497,12 +1254,16 @@ namespace CoreSystems {
                 //returns std::vector<PinterestImage>, a lost of PinterestImage objects
                 //need to call .get() on pinterestFutures to get the result
             for (const auto& node : nodes) {//for node in nodes
-                auto future = std::async(std::launch::async, [this, &node]() {
-                    return pinterestClient->searchPins(node.name);
+                auto future = std::async(std::launch::async, [this, conceptName = node.name, &context, traceContext = tracing::currentContext()]() {
+                    tracing::setThreadName("pinterest-task");
+                    tracing::ScopedContext traceScope(traceContext); //spans in this thread belong to the same request
+                    auto span = stageSpan(PipelineStage::PINTEREST_REQUEST, "pinterest.search");
+                    return pinterestClient->searchPins(conceptName, context); //context outlives the task, the futures are all waited on below
                 });
                 //std::async runs the task in the background
                 //std::launch::async tells the program to launch the task in a new thread
-                //[this, &node] gives the current class and access to node by reference
+                //[this, conceptName = node.name] gives the current class and the node's interned name (4 bytes, no string copy)
+                //every task gets the same deadline, so a slow pinterest can't hold the request past it
 
                 pinterestFutures.push_back(std::move(future));
             }
@@ -513,70 +1274,154 @@ namespace CoreSystems {
                     //each future is a bunch of pinterest images related to that node
                     auto images = pinterestFutures[i].get();
                     if (!images.empty()) {
-                        std::lock_guard<std::mutex> lock(cacheMutex); //preventing other threads from accessing imageCache
-                            //^locks the cacheMutex so if other threads try to lock that mutex they will be blocked until cacheMutex is unlocked by og thread
-                        imageCache[nodes[i].name] = std::move(images); //adding images to cache
+                        cache->storeImages(nodes[i].name, std::move(images)); //adding images to cache
                     }
                 } catch (const std::exception& e) {
-                    std::cerr << "Pinterest enhancement failed for '" << nodes[i].name << "': " << e.what() << std::endl;
+                    LOG_WARN("Pinterest enhancement failed for '" << nodes[i].name << "': " << e.what());
                 }
             }
             return nodes;
         }
-        void VectorEngine::clearCache() {
+        void EngineCache::clear() {
             std::lock_guard<std::mutex> lock(cacheMutex);
             searchCache.clear();
             imageCache.clear();
+            refreshedImages.clear();
+            searchCacheMetrics.entries->set(0);
+            imageCacheMetrics.entries->set(0);
         }
-        size_t VectorEngine::getCacheSize() {
+        size_t EngineCache::size() {
             std::lock_guard<std::mutex> lock(cacheMutex);
-            return searchCache.size() + imageCache.size();
+            return searchCache.size() + imageCache.size() + refreshedImages.size();
         }
-
-        std::vector<PinterestImage> VectorEngine::getPinterestImages(const std::string& conceptName)  {
+        std::vector<PinterestImage> EngineCache::images(std::string_view conceptName) {
+            if (std::optional<InternedString> key = StringInterner::global().find(conceptName)) {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                if (auto it = imageCache.find(*key); it != imageCache.end()) {
+                    imageCacheMetrics.hits->inc();
+                    return it->second;
+                }
+            }
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (auto it = refreshedImages.find(std::string(conceptName)); it != refreshedImages.end()) {
+                imageCacheMetrics.hits->inc();
+                return it->second;
+            }
+            imageCacheMetrics.misses->inc();
+            return {};
+        }
+        std::vector<PinterestImage> EngineCache::images(InternedString conceptName) {
             std::lock_guard<std::mutex> lock(cacheMutex);
             auto it = imageCache.find(conceptName);
             if (it != imageCache.end()) { //if conceptName is in the cache
+                imageCacheMetrics.hits->inc();
                 return it->second; //returning the vector of pinterest images for that concept
             }
+            imageCacheMetrics.misses->inc();
             return {};
         }
+        void EngineCache::storeImages(InternedString conceptName, std::vector<PinterestImage> images) {
+            std::lock_guard<std::mutex> lock(cacheMutex); //the pinterest tasks of every engine write here
+            imageCache[conceptName] = std::move(images);
+            imageCacheMetrics.entries->set(static_cast<int64_t>(imageCache.size() + refreshedImages.size()));
+        }
+        void EngineCache::storeImages(std::string_view conceptName, std::vector<PinterestImage> images) {
+            if (std::optional<InternedString> key = StringInterner::global().find(conceptName)) {
+                storeImages(*key, std::move(images));
+                return;
+            }
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto it = refreshedImages.find(std::string(conceptName));
+            if (it == refreshedImages.end() && refreshedImages.size() >= MAX_REFRESHED_IMAGE_ENTRIES) {
+                refreshedImages.erase(refreshedImages.begin());
+                imageCacheMetrics.evictions->inc();
+            }
+            refreshedImages[std::string(conceptName)] = std::move(images);
+            imageCacheMetrics.entries->set(static_cast<int64_t>(imageCache.size() + refreshedImages.size()));
+        }
+        void EngineCache::eraseImages(std::string_view conceptName) {
+            std::optional<InternedString> key = StringInterner::global().find(conceptName);
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (conceptName.empty()) {
+                imageCache.clear();
+                refreshedImages.clear();
+            } else {
+                if (key) imageCache.erase(*key);
+                refreshedImages.erase(std::string(conceptName));
+            }
+            imageCacheMetrics.entries->set(static_cast<int64_t>(imageCache.size() + refreshedImages.size()));
+        }
+
+        void VectorEngine::clearCache() {
+            cache->clear();
+            EmbeddingStore::global().forgetNames(); //weaviate may have been re-imported, the next responses' vectors replace the stored ones
+        }
+        size_t VectorEngine::getCacheSize() {
+            return cache->size();
+        }
+        std::vector<PinterestImage> VectorEngine::getPinterestImages(const std::string& conceptName)  {
+            return cache->images(conceptName);
+        }
         bool VectorEngine::refreshPinterestData(const std::string& conceptName) {
             try {
                 if (conceptName.empty()) {
                     //clearing entire pinterest cache
-                    std::lock_guard<std::mutex> lock(cacheMutex);
-                    imageCache.clear();
-                    std::cout << "All Pinterest image cache cleared" << std::endl;
+                    cache->eraseImages("");
+                    LOG_INFO("All Pinterest image cache cleared");
                     return true;
                 } else {
                     //removing concept from cache then fetching fresh data
-                    {
-                        std::lock_guard<std::mutex> lock(cacheMutex);
-                        imageCache.erase(conceptName);
-                    }
-                    //fetching fresh Pinterest data
+                    cache->eraseImages(conceptName);
+                    //fetching fresh Pinterest data, stored under the interned name if weaviate has returned this concept,
+                    //otherwise in the cache's bounded by-name map (user text is never interned, the interner only grows)
                     if (pinterestClient && pinterestClient->canMakeRequest()) {
                         auto images = pinterestClient->searchPins(conceptName);
                         if (!images.empty()) {
-                            std::lock_guard<std::mutex> lock(cacheMutex);
-                            imageCache[conceptName] = std::move(images);
-                            std::cout << "Pinterest data refreshed for: " << conceptName << std::endl;
+                            cache->storeImages(std::string_view(conceptName), std::move(images));
+                            LOG_INFO("Pinterest data refreshed for: " << conceptName);
                             return true;
                         }
                     }
                 }
             } catch (const std::exception& e) {
-                std::cerr << "Failed to refresh Pinterest data: " << e.what() << std::endl;
+                LOG_ERROR("Failed to refresh Pinterest data: " << e.what());
             }
             return false;
         }
 
         //system manager functions
+        //everything a hedged search shares with its hedge attempt, which can outlive the hedgedSearch call
+        struct SystemManager::HedgeRace {
+            std::string query;
+            DegradationTier tier;
+            VectorEngine* second;
+            tracing::TraceContext traceContext;
+            SearchContext::Clock::time_point deadline;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::shared_ptr<SearchContext> original; //the caller's attempt, dropped once it has returned
+            std::shared_ptr<SearchContext> hedge; //set with hedgeLaunched
+            bool firstDone = false;
+            bool hedgeLaunched = false;
+            bool hedgeDone = false;
+            bool hedgeFirst = false; //the hedge came back with nodes while the original was still running
+            std::optional<SearchResult> hedgeResult; //empty if the hedge attempt threw
+        };
         SystemManager::SystemManager() : startTime(std::chrono::system_clock::now()) {
             healthMetrics = std::make_unique<SystemHealthMetrics>();
+            if (const char* configured = std::getenv("PALETTE_HEDGE_PERCENTILE")) {
+                double value = std::atof(configured);
+                hedgePercentile = std::clamp(value > 1.0 ? value / 100.0 : value, 0.0, 0.999); //accepts 0.95 or 95
+            }
+            if (const char* configured = std::getenv("PALETTE_HEDGE_MAX_RATE")) {
+                hedgeMaxRate = std::clamp(std::atof(configured), 0.0, 1.0);
+            }
+            if (const char* configured = std::getenv("PALETTE_BALANCING")) {
+                balancingMode = balancingModeFromString(configured, balancingMode);
+            }
         }
         SystemManager::~SystemManager() {
+            metrics::Registry::instance().removeOwner(this); //scrapes must stop reading this object before it goes away
             shutdown();
         }
         bool SystemManager::initialize() {
@@ -585,37 +1430,86 @@ namespace CoreSystems {
                 telemetryProcessor = std::make_unique<TelemetryProcessor>();
                 telemetryProcessor->start();
 
-                //initializing vector engines
-                primaryVectorEngine = std::make_unique<VectorEngine>("primary");
-                backupVectorEngine = std::make_unique<VectorEngine>("backup");
+                //local query encoder, read from the process environment like the other PALETTE_ settings
+                //a file that won't load is logged and the engines fall back to nearText, search still works without it
+                try {
+                    queryEncoder = QueryEncoder::fromEnvironment();
+                    if (queryEncoder) {
+                        LOG_INFO("Local query encoder loaded, " << queryEncoder->dimension() << " dimensions, "
+                                 << (queryEncoder->usesSimd() ? "avx2" : "scalar") << " kernels");
+                    }
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Failed to load local query encoder, level-1 searches will use nearText: " << e.what());
+                    queryEncoder.reset();
+                }
+
+                //initializing vector engines, all of them share one cache and the encoder
+                engineCache = std::make_shared<EngineCache>();
+                primaryVectorEngine = std::make_unique<VectorEngine>("primary", telemetryProcessor.get(), engineCache, "", queryEncoder);
+                backupVectorEngine = std::make_unique<VectorEngine>("backup", telemetryProcessor.get(), engineCache, "", queryEncoder);
 
                 if (!primaryVectorEngine->initialize()) {
-                    std::cerr << "Failed to initialize primary vector engine" << std::endl;
+                    LOG_ERROR("Failed to initialize primary vector engine");
                     return false;
                 }
                 if (!backupVectorEngine->initialize()) {
-                    std::cerr << "Warning: Failed to initialize backup vector engine, continuing with primary only" << std::endl;
+                    LOG_WARN("Failed to initialize backup vector engine, continuing with primary only");
+                }
+                //extra weaviate replicas, comma separated urls (read after the primary loaded .env)
+                if (const char* replicas = std::getenv("PALETTE_WEAVIATE_REPLICAS")) {
+                    std::stringstream list(replicas);
+                    std::string url;
+                    while (std::getline(list, url, ',')) {
+                        url.erase(0, url.find_first_not_of(" \t"));
+                        url.erase(url.find_last_not_of(" \t") + 1);
+                        if (url.empty()) continue;
+                        auto replica = std::make_unique<VectorEngine>("replica-" + std::to_string(replicaEngines.size() + 1),
+                                                                      telemetryProcessor.get(), engineCache, url, queryEncoder);
+                        if (replica->initialize()) {
+                            replicaEngines.push_back(std::move(replica));
+                        } else {
+                            LOG_WARN("Failed to initialize vector engine for replica " << url << ", skipping it");
+                        }
+                    }
                 }
+                LOG_INFO("Balancing searches over " << allEngines().size() << " engines (" << balancingModeToString(balancingMode) << ")");
+                registerMetrics();
+
                 //starting background threads
                 telemetryThread = std::thread([this]() { telemetryWorker(); });
                 healthMonitorThread = std::thread([this]() { healthMonitorWorker(); });
+                probeThread = std::thread([this]() { probeWorker(); });
+                hedgeThread = std::thread([this]() { hedgeWorker(); });
 
-                std::cout << "SystemManager initialized successfully" << std::endl;
+                LOG_INFO("SystemManager initialized successfully");
                 return true;
             } catch (const std::exception& e) {
-                std::cerr << "Failed to initialize SystemManager: " << e.what() << std::endl;
+                LOG_ERROR("Failed to initialize SystemManager: " << e.what());
                 return false;
             }
         }
         void SystemManager::shutdown() {
-             std::cout << "SystemManager shutting down..." << std::endl;
+             LOG_INFO("SystemManager shutting down...");
 
-             shutdownRequested.store(true);
-             //stop telemetry processor
-            if (telemetryProcessor) {
-                telemetryProcessor->stop();
-            }
+             {
+                std::lock_guard<std::mutex> lock(telemetryMutex);
+                shutdownRequested.store(true);
+             }
+             telemetryCv.notify_all(); //wakes telemetryWorker so it drains and exits
             
+            //hedge attempts reference the engines, so they're cancelled and joined before the engines shut down
+            {
+                std::lock_guard<std::mutex> lock(hedgeMutex); //hedgeWorker checks shutdownRequested under this lock
+            }
+            hedgeCv.notify_all();
+            if (hedgeThread.joinable()) {
+                hedgeThread.join();
+            }
+            for (auto& [attempt, race] : hedgeAttempts) {
+                race->hedge->cancel(); //set before the thread was started, hedgeWorker is gone so nothing else touches the list
+                attempt.join();
+            }
+            hedgeAttempts.clear();
             //shutdown vector engines
             if (primaryVectorEngine) {
                 primaryVectorEngine->shutdown();
@@ -623,6 +1517,12 @@ namespace CoreSystems {
             if (backupVectorEngine) {
                 backupVectorEngine->shutdown();
             }
+            for (auto& replica : replicaEngines) {
+                replica->shutdown();
+            }
+            if (engineCache) {
+                engineCache->clear();
+            }
             //join threads
             //joining threads will make the thread that called it wait until the thread being joined finishes execution
             //then the thread that was called on its reasources are freed
@@ -630,31 +1530,334 @@ namespace CoreSystems {
             if (telemetryThread.joinable()) {
                 telemetryThread.join();
             }
+            //stop telemetry processor, only once telemetryWorker has handed it the last of the queue
+            if (telemetryProcessor) {
+                telemetryProcessor->stop();
+            }
             if (healthMonitorThread.joinable()) {
                 healthMonitorThread.join();
             }
-            std::cout << "SystemManager shutdown complete" << std::endl;
+            if (probeThread.joinable()) {
+                probeThread.join();
+            }
+            LOG_INFO("SystemManager shutdown complete");
         }
-        std::vector<Node> SystemManager::search(const std::string& query) {
-            std::cout << "SystemManager: Processing search for '" << query << "'" << std::endl;
+        void SystemManager::registerMetrics() {
+            //everything here is read on the scraping thread, so it only touches atomics and lock-free histograms
+            auto& registry = metrics::Registry::instance();
+            TelemetryProcessor* processor = telemetryProcessor.get();
+            registry.histogramFunction("palette_search_duration_seconds", "End to end search_concepts latency", {}, this,
+                [processor]() { return processor->getSearchLatency().total(); });
+            for (size_t i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+                PipelineStage stage = static_cast<PipelineStage>(i);
+                registry.histogramFunction("palette_stage_duration_seconds", "Latency of each search pipeline stage",
+                    {{"stage", pipelineStageToString(stage)}}, this,
+                    [processor, stage]() { return processor->getStageLatency(stage).total(); });
+            }
+            registry.valueFunction("palette_telemetry_queue_depth", "Telemetry records waiting for telemetryWorker",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(telemetryQueue.approximateSize()); });
+            registry.valueFunction("palette_telemetry_dropped_total", "Telemetry records dropped because the queue was full",
+                metrics::MetricType::COUNTER, {}, this, [this]() { return static_cast<double>(telemetryQueue.droppedCount()); });
+            registry.valueFunction("palette_cpu_usage_percent", "Process CPU usage normalized to the available cores, as last sampled by healthMonitorWorker",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(healthMetrics->cpuUsage.load()); });
+            registry.valueFunction("palette_error_rate", "Error rate used for the health status",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(healthMetrics->errorRate.load()); });
+            registry.valueFunction("palette_health_status", "0 = NOMINAL, 1 = DEGRADED, 2 = CRITICAL",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(healthMetrics->getHealthStatus()); });
+            registry.valueFunction("palette_uptime_seconds", "Time since SystemManager was created",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(getUptimeMs()) / 1000.0; });
+            registry.valueFunction("palette_process_resident_memory_bytes", "Current resident set size of the process",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(healthMetrics->residentMemoryBytes.load()); });
+            registry.valueFunction("palette_memory_usage_percent", "Resident memory as a percent of the cgroup limit or physical memory",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(healthMetrics->memoryUsage.load()); });
+            registry.valueFunction("palette_heap_in_use_bytes", "Bytes handed out by malloc (mallinfo2)",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(healthMetrics->heapInUseBytes.load()); });
+            registry.valueFunction("palette_available_cores", "CPU cores the process may use (affinity and cgroup quota)",
+                metrics::MetricType::GAUGE, {}, this, [this]() { return static_cast<double>(healthMetrics->availableCores.load()); });
+            hedgesIssued = &registry.counter("palette_hedges_total", "Searches also sent to the backup engine because the primary was slow");
+            hedgesSkippedBudget = &registry.counter("palette_hedges_skipped_total",
+                "Searches that were slow enough to hedge but the hedge budget was used up");
+            hedgeWinsOriginal = &registry.counter("palette_hedge_wins_total", "Which attempt answered first in a hedged search", {{"winner", "original"}});
+            hedgeWinsHedge = &registry.counter("palette_hedge_wins_total", "Which attempt answered first in a hedged search", {{"winner", "hedge"}});
+            for (VectorEngine* engine : allEngines()) {
+                metrics::Labels labels = {{"engine", engine->getEngineType()}};
+                registry.valueFunction("palette_engine_outstanding_searches", "Searches in flight on each vector engine",
+                    metrics::MetricType::GAUGE, labels, this, [engine]() { return static_cast<double>(engine->getOutstandingSearches()); });
+                registry.valueFunction("palette_engine_latency_ewma_seconds", "Smoothed level-1 latency the balancer scores each engine by",
+                    metrics::MetricType::GAUGE, labels, this, [engine]() { return engine->getLatencyEwmaUs() / 1e6; });
+                registry.valueFunction("palette_engine_searches_total", "Searches each vector engine sent upstream",
+                    metrics::MetricType::COUNTER, labels, this, [engine]() { return static_cast<double>(engine->getCompletedSearches()); });
+                registry.valueFunction("palette_engine_probe_healthy", "1 if the engine passes its readiness probe",
+                    metrics::MetricType::GAUGE, labels, this, [engine]() { return engine->isProbeHealthy() ? 1.0 : 0.0; });
+            }
+        }
+        std::vector<VectorEngine*> SystemManager::allEngines() const {
+            std::vector<VectorEngine*> engines;
+            engines.reserve(2 + replicaEngines.size());
+            if (primaryVectorEngine) engines.push_back(primaryVectorEngine.get());
+            if (backupVectorEngine) engines.push_back(backupVectorEngine.get());
+            for (const auto& replica : replicaEngines) {
+                engines.push_back(replica.get());
+            }
+            return engines;
+        }
+        VectorEngine* SystemManager::pickEngine(const VectorEngine* exclude) const {
+            //lower is better
+            auto score = [this](const VectorEngine* engine) {
+                double outstanding = static_cast<double>(engine->getOutstandingSearches());
+                double latency = engine->getLatencyEwmaUs();
+                if (balancingMode == BalancingMode::EWMA_LATENCY) {
+                    return std::make_pair(latency * (outstanding + 1.0), outstanding);
+                }
+                return std::make_pair(outstanding, latency);
+            };
+            VectorEngine* best = nullptr;
+            VectorEngine* bestUnprobed = nullptr; //fallback when no engine passes its probe (probes can be wrong too)
+            for (VectorEngine* engine : allEngines()) {
+                if (engine == exclude || !engine->acceptsSearches()) continue;
+                VectorEngine*& slot = engine->isProbeHealthy() ? best : bestUnprobed;
+                if (!slot || score(engine) < score(slot)) {
+                    slot = engine;
+                }
+            }
+            return best ? best : bestUnprobed;
+        }
+        nlohmann::json SystemManager::getCircuitBreakerReport() const {
+            nlohmann::json weaviate = nlohmann::json::object();
+            for (VectorEngine* engine : allEngines()) {
+                weaviate[engine->getEngineType()] = engine->getBreakerStats();
+            }
+            return nlohmann::json{
+                {"weaviate", weaviate},
+                {"pinterest", PinterestClient::getBreakerStats()}
+            };
+        }
+        nlohmann::json SystemManager::getEngineReport() const {
+            nlohmann::json engines = nlohmann::json::array();
+            for (VectorEngine* engine : allEngines()) {
+                engines.push_back(engine->getStats());
+            }
+            return engines;
+        }
+        void SystemManager::probeWorker() {
+            tracing::setThreadName("probeWorker");
+            while (!shutdownRequested.load()) {
+                for (VectorEngine* engine : allEngines()) {
+                    if (shutdownRequested.load()) break;
+                    tracing::ScopedSpan probeSpan("engine.probe");
+                    engine->probe();
+                }
+                std::unique_lock<std::mutex> lock(telemetryMutex);
+                if (telemetryCv.wait_for(lock, PROBE_INTERVAL, [this]() { return shutdownRequested.load(); })) {
+                    break;
+                }
+            }
+        }
+        SearchResult SystemManager::search(const std::string& query, const SearchContext& context) {
+            LOG_DEBUG("SystemManager: Processing search for '" << query << "'");
+            tracing::ScopedSpan span("system_manager.search");
+            searchAttempts.fetch_add(1, std::memory_order_relaxed);
+            DegradationTier tier = degradationTierForHealth(getSystemHealth());
 
             try {
-                //try searching w/ primary engine first
-                if (primaryVectorEngine && primaryVectorEngine->isEngineOperational()) {
-                    return primaryVectorEngine->vectorSearch(query);
+                SearchResult result = routeSearch(query, context, tier);
+                //weaviate always has a nearest concept, so no level-1 nodes means the upstream failed
+                //(the engines turn weaviate errors into empty results rather than exceptions)
+                //an open breaker also marks the search partial, so partial only excuses it when the deadline really ran out
+                bool partial = result.partial || context.isPartial();
+                if (result.nodes.empty() && (!partial || !context.expired())) {
+                    searchFailures.fetch_add(1, std::memory_order_relaxed);
                 }
-                //fallback to backup engine
-                else if (backupVectorEngine && backupVectorEngine->isEngineOperational()) {
-                    std::cout << "Primary engine unavailable, using backup" << std::endl;
-                    return backupVectorEngine->vectorSearch(query);
-                }
-                else {
+                return result;
+            } catch (const std::exception& e) {
+                LOG_ERROR("Search failed: " << e.what());
+                searchFailures.fetch_add(1, std::memory_order_relaxed);
+                SearchResult failed;
+                failed.tier = tier;
+                return failed;
+            }
+        }
+        SearchResult SystemManager::routeSearch(const std::string& query, const SearchContext& context, DegradationTier tier) {
+            bool hedging = hedgePercentile > 0.0 && hedgesIssued;
+            if (balancingMode != BalancingMode::FAILOVER) {
+                //spread over every engine, the next best one is the hedge target
+                VectorEngine* engine = pickEngine();
+                if (!engine) {
                     throw std::runtime_error("No operational vector engines available");
                 }
-            } catch (const std::exception& e) {
-                std::cerr << "Search failed: " << e.what() << std::endl;
-                healthMetrics->errorRate.store(healthMetrics->errorRate.load() + 0.01f);
-                return {};
+                VectorEngine* hedgeTarget = hedging ? pickEngine(engine) : nullptr;
+                if (hedgeTarget) {
+                    return hedgedSearch(query, context, tier, engine, hedgeTarget);
+                }
+                return engine->vectorSearch(query, context, tier);
+            }
+            //try searching w/ primary engine first, hedged to the backup when both are up
+            //an engine with an open circuit breaker counts as down, so failover doesn't wait on a dead weaviate
+            if (primaryVectorEngine && primaryVectorEngine->acceptsSearches()) {
+                if (hedging && backupVectorEngine && backupVectorEngine->acceptsSearches()) {
+                    return hedgedSearch(query, context, tier, primaryVectorEngine.get(), backupVectorEngine.get());
+                }
+                return primaryVectorEngine->vectorSearch(query, context, tier);
+            }
+            //fallback to backup engine
+            else if (backupVectorEngine && backupVectorEngine->acceptsSearches()) {
+                LOG_WARN("Primary engine unavailable, using backup");
+                return backupVectorEngine->vectorSearch(query, context, tier);
+            }
+            else {
+                throw std::runtime_error("No operational vector engines available");
+            }
+        }
+        bool SystemManager::takeHedgeToken() {
+            int64_t tokens = hedgeTokens.load(std::memory_order_relaxed);
+            while (tokens >= HEDGE_TOKEN_UNIT) {
+                if (hedgeTokens.compare_exchange_weak(tokens, tokens - HEDGE_TOKEN_UNIT, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        SearchResult SystemManager::hedgedSearch(const std::string& query, const SearchContext& context, DegradationTier tier,
+                                                 VectorEngine* first, VectorEngine* second) {
+            //every search earns hedgeMaxRate of a hedge, so over time at most that share of searches is sent twice
+            int64_t earned = static_cast<int64_t>(hedgeMaxRate * HEDGE_TOKEN_UNIT);
+            int64_t tokens = hedgeTokens.load(std::memory_order_relaxed);
+            while (tokens < HEDGE_BURST && !hedgeTokens.compare_exchange_weak(tokens, std::min(HEDGE_BURST, tokens + earned), std::memory_order_relaxed)) {
+                //another search added its share first, tokens was reloaded by compare_exchange
+            }
+
+            auto hedgeDelay = first->level1LatencyQuantile(hedgePercentile, HEDGE_MIN_SAMPLES);
+            if (!hedgeDelay) { //not enough recent samples to know what slow means yet
+                return first->vectorSearch(query, context, tier);
+            }
+            auto hedgeAt = SearchContext::Clock::now() + std::max<std::chrono::microseconds>(*hedgeDelay, HEDGE_MIN_DELAY);
+
+            //each attempt works on its own context (same deadline) so the loser can be cancelled without touching the winner
+            auto original = std::make_shared<SearchContext>(context.getDeadline());
+            auto race = std::make_shared<HedgeRace>();
+            race->query = query;
+            race->tier = tier;
+            race->second = second;
+            race->traceContext = tracing::currentContext();
+            race->deadline = context.getDeadline();
+            race->original = original;
+            {
+                std::lock_guard<std::mutex> lock(hedgeMutex);
+                pendingHedges.push(PendingHedge{hedgeAt, race});
+            }
+            hedgeCv.notify_one();
+
+            //an exception is kept until we know whether the hedge answered, search() counts it as a failure if it didn't
+            std::exception_ptr error;
+            //constructed straight from vectorSearch's return, assigning into a default SearchResult would copy the nodes out of the arena
+            SearchResult result = [&]() {
+                try {
+                    return first->vectorSearch(query, *original, tier);
+                } catch (const std::exception& e) {
+                    error = std::current_exception();
+                    return SearchResult();
+                }
+            }();
+            result.servedBy = first->getEngineType();
+
+            bool hedgeWon;
+            {
+                std::unique_lock<std::mutex> lock(race->mutex);
+                race->firstDone = true; //a pending hedge that comes due now is dropped
+                race->original.reset();
+                if (!race->hedgeLaunched) {
+                    lock.unlock();
+                    if (error) std::rethrow_exception(error);
+                    if (original->isPartial()) context.markPartial();
+                    return result;
+                }
+                if (result.nodes.empty()) { //the hedge may still answer, its result replaces an empty or failed one
+                    race->cv.wait(lock, [&]() { return race->hedgeDone; });
+                }
+                hedgeWon = race->hedgeDone && race->hedgeResult && !race->hedgeResult->nodes.empty() &&
+                           (result.nodes.empty() || race->hedgeFirst);
+            }
+            if (!hedgeWon) {
+                race->hedge->cancel(); //its thread unwinds on its own, hedgeWorker or shutdown() joins it
+                hedgeWinsOriginal->inc();
+                if (error) std::rethrow_exception(error);
+                result.hedged = true;
+                if (original->isPartial()) context.markPartial();
+                return result;
+            }
+            hedgeWinsHedge->inc();
+            SearchResult hedgeResult = std::move(*race->hedgeResult);
+            hedgeResult.hedged = true;
+            if (race->hedge->isPartial()) context.markPartial();
+            return hedgeResult;
+        }
+        //runs on hedgeWorker when a race's hedgeAt comes, the hedge is only started if the original still has no level-1 answer
+        void SystemManager::launchHedge(const std::shared_ptr<HedgeRace>& race) {
+            {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                //the engine is only considered slow while its level-1 answer is missing, level-2 and images take as long as they take
+                if (race->firstDone || race->original->isLevel1Complete() || SearchContext::Clock::now() >= race->deadline) {
+                    return;
+                }
+                if (!takeHedgeToken()) {
+                    hedgesSkippedBudget->inc();
+                    return;
+                }
+                race->hedge = std::make_shared<SearchContext>(race->deadline);
+                race->hedgeLaunched = true;
+            }
+            hedgesIssued->inc();
+            LOG_DEBUG("Hedging search for '" << race->query << "' to " << race->second->getEngineType());
+            std::thread attempt([race]() {
+                tracing::setThreadName("search-attempt");
+                tracing::ScopedContext scope(race->traceContext);
+                std::optional<SearchResult> result;
+                try {
+                    result.emplace(race->second->vectorSearch(race->query, *race->hedge, race->tier));
+                    result->servedBy = race->second->getEngineType();
+                } catch (const std::exception& e) {
+                    LOG_WARN(race->second->getEngineType() << " hedged search attempt failed: " << e.what());
+                }
+                {
+                    std::lock_guard<std::mutex> lock(race->mutex);
+                    if (result && !result->nodes.empty() && !race->firstDone) {
+                        race->hedgeFirst = true;
+                        race->original->cancel(); //the caller's attempt returns early and picks up this result
+                    }
+                    race->hedgeResult = std::move(result);
+                    race->hedgeDone = true;
+                }
+                race->cv.notify_all();
+            });
+            hedgeAttempts.emplace_back(std::move(attempt), race);
+        }
+        void SystemManager::hedgeWorker() {
+            tracing::setThreadName("hedgeWorker");
+            std::unique_lock<std::mutex> lock(hedgeMutex);
+            while (!shutdownRequested.load()) {
+                //attempts that have finished are joined here, so there's never more than the running hedges to join at shutdown
+                hedgeAttempts.erase(std::remove_if(hedgeAttempts.begin(), hedgeAttempts.end(), [](auto& attempt) {
+                    {
+                        std::lock_guard<std::mutex> raceLock(attempt.second->mutex);
+                        if (!attempt.second->hedgeDone) return false;
+                    }
+                    attempt.first.join(); //it's past the last thing it does, this doesn't wait
+                    return true;
+                }), hedgeAttempts.end());
+
+                if (pendingHedges.empty()) {
+                    hedgeCv.wait(lock);
+                    continue;
+                }
+                PendingHedge next = pendingHedges.top();
+                if (SearchContext::Clock::now() < next.hedgeAt) {
+                    hedgeCv.wait_until(lock, next.hedgeAt);
+                    continue;
+                }
+                pendingHedges.pop();
+                lock.unlock();
+                launchHedge(next.race);
+                lock.lock();
             }
         }
         SystemHealthEnum SystemManager::getSystemHealth() const {
@@ -664,16 +1867,15 @@ namespace CoreSystems {
             SystemHealthMetrics& metrics = *healthMetrics; //dereferencing the unique_ptr to get the actual object
             return metrics;
         }
-        void SystemManager::recordTelemetry(const SearchTelemetry& telemetry) {
-            std::lock_guard<std::mutex> lock(telemetryMutex);
-            telemetryQueue.push(telemetry); //adding data to queue
-            telemetryCv.notify_one();
-            //notify_one() tells the telemetryWorker thread that new data is available
-            //if the thread is waiting, it will wake up and process the new data
-
+        void SystemManager::recordTelemetry(SearchTelemetry telemetry) {
+            if (!telemetryQueue.tryPush(std::move(telemetry))) { //adding data to queue
+                LOG_DEBUG("Telemetry queue full, record dropped");
+            }
+            //no notify here, telemetryWorker wakes up on its own every TELEMETRY_DRAIN_INTERVAL
+            //so the request thread doesn't touch a mutex or a condition variable
         }
         bool SystemManager::emergencySubsystemRestart(const std::string& subsystemName) {
-            std::cout << "System Manager: EMERGENCY RESTART: " << subsystemName << std::endl;
+            LOG_WARN("System Manager: EMERGENCY RESTART: " << subsystemName);
             try {
                  if (subsystemName == "primary" || subsystemName == "primary_engine") {
                     if (primaryVectorEngine) {
@@ -693,7 +1895,7 @@ namespace CoreSystems {
                     }
                 }
             } catch (const std::exception& e) {
-                std::cerr << "System Manager: Failed to emergency restart subsystem '" << subsystemName << "': " << e.what() << std::endl;
+                LOG_ERROR("System Manager: Failed to emergency restart subsystem '" << subsystemName << "': " << e.what());
             }
             return false;
         }
@@ -702,84 +1904,123 @@ namespace CoreSystems {
             return std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count();
         }
         void SystemManager::telemetryWorker() {
-            std::cout << "System Manager: Telemetry worker started" << std::endl;
-            while(!shutdownRequested.load()) { //goes until shutdownRequested
-                std::unique_lock<std::mutex> lock(telemetryMutex);
-                telemetryCv.wait(lock, [this]() { return !telemetryQueue.empty() || shutdownRequested.load(); });
-                    //thread will wait until either telemetryQueue is not empty or shutdownRequested is true
-
-                while (!telemetryQueue.empty()) {
-                    auto telemetry = telemetryQueue.front(); //getting the front of the queue
-                    telemetryQueue.pop(); //removing the front of the queue
-                    lock.unlock(); //unlocking the mutex so other threads can access telemetryQueue
-                    if (telemetryProcessor) {
+            LOG_INFO("System Manager: Telemetry worker started");
+            tracing::setThreadName("telemetryWorker");
+            std::vector<SearchTelemetry> batch;
+            batch.reserve(TELEMETRY_BATCH_SIZE);
+            while(true) { //goes until shutdownRequested, then drains what's left
+                bool stopping = shutdownRequested.load();
+                batch.clear();
+                telemetryQueue.popBatch(std::back_inserter(batch), TELEMETRY_BATCH_SIZE);
+                if (telemetryProcessor && !batch.empty()) {
+                    tracing::ScopedSpan drainSpan("telemetry.process_batch");
+                    for (const auto& telemetry : batch) {
                         telemetryProcessor->processTelemetry(telemetry);
                     }
-                    lock.lock(); //locking the mutex again
                 }
+                if (batch.size() == TELEMETRY_BATCH_SIZE) {
+                    continue; //more waiting, keep draining without sleeping
+                }
+                if (stopping) {
+                    break;
+                }
+                //sleeping between drains so each wakeup handles everything that piled up in the meantime
+                std::unique_lock<std::mutex> lock(telemetryMutex);
+                telemetryCv.wait_for(lock, TELEMETRY_DRAIN_INTERVAL, [this]() { return shutdownRequested.load(); });
             }
         }
         void SystemManager::healthMonitorWorker() {
+            tracing::setThreadName("healthMonitorWorker");
+            ResourceSampler sampler; //first cpu% is measured from here
+            uint64_t lastAttempts = searchAttempts.load();
+            uint64_t lastFailures = searchFailures.load();
             while(!shutdownRequested.load()) {
-                try{
-                    healthMetrics->cpuUsage.store(utils::calculateSystemLoad());
-                        //calculateSystemLoad() calculates how busy the cpu is
-                    #ifdef _WIN32 //for windows
-                        PROCESS_MEMORY_COUNTERS pmc;
-                        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
-                            float memoryMB = static_cast<float>(pmc.WorkingSetSize) / (1024.0f * 1024.0f);
-                            healthMetrics->memoryUsage.store(memoryMB);
-                        }
-                    
-                    #else //for linux
-                    struct rusage useage;
-                        //rusage is a struct that contains resource usage information
-
-                    if (getrusage(RUSAGE_SELF, &useage) == 0) { //gets useage info for current program
-                        //getrusage() returns 0 on success, -1 on error
-                        float memoryMB = usage.ru_maxrss / 1024.0f; //KB to MB
-                        healthMetrics->memoryUsage.store(memoryMB);
+                {
+                    //sleeping first so the first sample covers a full interval
+                    std::unique_lock<std::mutex> lock(telemetryMutex);
+                    if (telemetryCv.wait_for(lock, HEALTH_SAMPLE_INTERVAL, [this]() { return shutdownRequested.load(); })) {
+                        break;
                     }
-                    #endif
+                }
+                try{
+                    tracing::ScopedSpan sampleSpan("health.sample");
+                    ResourceSample sample = sampler.sample();
+                    healthMetrics->cpuUsage.store(sample.cpuPercent);
+                    healthMetrics->memoryUsage.store(sample.memoryPercent);
+                    healthMetrics->residentMemoryBytes.store(sample.residentBytes);
+                    healthMetrics->heapInUseBytes.store(sample.heapInUseBytes);
+                    healthMetrics->availableCores.store(sample.availableCores);
+
+                    //error rate: share of searches that failed since the last sample, smoothed so one bad interval
+                    //doesn't flip the tier on its own, and decaying back once searches succeed again
+                    //an interval without searches counts as error free, otherwise an outage followed by silence would keep the tier down
+                    uint64_t attempts = searchAttempts.load();
+                    uint64_t failures = searchFailures.load();
+                    float intervalRate = attempts > lastAttempts
+                        ? static_cast<float>(failures - lastFailures) / static_cast<float>(attempts - lastAttempts)
+                        : 0.0f;
+                    float previous = healthMetrics->errorRate.load();
+                    healthMetrics->errorRate.store(previous + ERROR_RATE_SMOOTHING * (intervalRate - previous));
+                    lastAttempts = attempts;
+                    lastFailures = failures;
                     healthMetrics->lastHeartbeat.store(utils::getTimestampMs());
                 }catch (const std::exception& e) {
-                    std::cerr << "Health monitor worker error: " << e.what() << std::endl;
+                    LOG_ERROR("Health monitor worker error: " << e.what());
                 }
-                std::this_thread::sleep_for(std::chrono::seconds(5)); //sleep for 5 seconds before next update
             }
         }
         void TelemetryProcessor::start() {
             isRunning.store(true);
-            std::cout << "TelemetryProcessor started" << std::endl;
+            LOG_INFO("TelemetryProcessor started");
         }
         void TelemetryProcessor::stop() {
             isRunning.store(false);
-            std::cout << "TelemetryProcessor stopped" << std::endl;
+            LOG_INFO("TelemetryProcessor stopped");
         }
         void TelemetryProcessor::processTelemetry(const SearchTelemetry& telemetry) {
             if (!isRunning.load()) return; //if not running, do nothing
 
-            std::lock_guard<std::mutex> lock(processingMutex);
-
             totalQueries.fetch_add(1);
             totalResponseTime.fetch_add(telemetry.processingTime);
 
-            if (telemetryHistory.size() >= MAX_TELEMETRY_RECORDS) {
-                telemetryHistory.erase(telemetryHistory.begin());
-                //removing the oldest record if we have reached the max size
+            telemetryHistory.push(TelemetryRecord::fromTelemetry(telemetry));
+                //overwrites the oldest record once MAX_TELEMETRY_RECORDS is reached, nothing gets shifted
+            LOG_DEBUG("Telemetry processed: " << telemetry.searchPhrase << " in " 
+                      << telemetry.processingTime<< "ms");
+        }
+        std::vector<SearchTelemetry> TelemetryProcessor::getRecentTelemetry(size_t maxRecords) const {
+            std::vector<TelemetryRecord> records;
+            telemetryHistory.snapshot(records, maxRecords);
+            std::vector<SearchTelemetry> recent;
+            recent.reserve(records.size());
+            for (const auto& record : records) {
+                recent.push_back(record.toTelemetry());
             }
-            telemetryHistory.push_back(telemetry); //adding new telemetry record to history
-            std::cout << "Telemetry processed: " << telemetry.searchPhrase << " in " 
-                      << telemetry.processingTime<< "ms" << std::endl;
+            return recent;
+        }
+        nlohmann::json TelemetryProcessor::getLatencyReport() const {
+            nlohmann::json stages = nlohmann::json::object();
+            for (size_t i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+                stages[pipelineStageToString(static_cast<PipelineStage>(i))] = stageLatency[i].toJson();
+            }
+            return nlohmann::json{
+                {"search", searchLatency.toJson()},
+                {"stages", stages}
+            };
         }
         nlohmann::json TelemetryProcessor::getPerformanceReport() const {
-            std::lock_guard<std::mutex> lock(processingMutex);
-            //auto telemetryHistory
+            //no lock needed, the counters are atomics and the history is snapshotted without stopping the writer
+            nlohmann::json recentSearches = nlohmann::json::array();
+            for (const auto& telemetry : getRecentTelemetry(RECENT_SEARCHES_IN_REPORT)) {
+                recentSearches.push_back(telemetry.toJson());
+            }
             return nlohmann::json{
                 {"total_queries", getTotalQueries()},
                 {"average_response_time", getAverageResponseTime()},
                 {"error_rate", getErrorRate()},
                 {"telemetry_records", telemetryHistory.size()},
+                {"recent_searches", recentSearches},
+                {"latency", getLatencyReport()},
                 {"timestamp", utils::getTimestampMs()}
 
             };
@@ -787,18 +2028,8 @@ namespace CoreSystems {
         //utils implementations
         namespace utils {
             inline std::string generateUUID() {
-                UUID uuid;
-                UuidCreate(&uuid);
-                //convert UUID to string
-                RPC_CSTR strUuid = nullptr;
-                UuidToStringA(&uuid, &strUuid);
-
-                std::string uuidStr;
-                if (strUuid) {
-                    uuidStr = reinterpret_cast<char*>(strUuid);
-                    RpcStringFreeA(&strUuid);
-                }
-                return uuidStr;
+                uuid::UuidText text = uuid::generateV7();
+                return std::string(text.data(), text.size());
             }
             std::chrono::system_clock::time_point getCurrentTime() {
                 return std::chrono::system_clock::now(); //returns current time as a time_point
@@ -811,17 +2042,5 @@ namespace CoreSystems {
                 //std::chrono::duration_cast<std::chrono::milliseconds>() converts it to milliseconds
                 //.count() returns the number of milliseconds as an integer
             }
-            float calculateSystemLoad() {
-                std::ifstream loadavg("/proc/loadavg"); 
-                    //creates input file stream ifstream object loadavg
-                    //opens the /proc/loadavg file which contains system load averages
-                if (loadavg.is_open()) {
-                    float load;
-                    loadavg >> load;
-                    return load * 100.0f; // Convert to percentage
-                }
-                return 0.0f;
-
-            }
         }
     };
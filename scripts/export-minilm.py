@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+#writes the weights file the backend's local query encoder loads (backend/text-encoder.hpp, PALETTE_LOCAL_ENCODER)
+#summary:
+#loads a MiniLM-L6 sentence-transformers checkpoint from huggingface (default: the one docker-compose.yml runs in t2v-transformers)
+#every linear layer and the word embeddings are quantized to int8 per output row (scale = max |w| / 127), the rest stays float32
+#q, k and v are stacked into one matrix so the encoder runs one gemm for all three
+#the layout is the "PLTMLM01" format described at the top of text-encoder.hpp, vocab.txt is embedded in the file
+#
+#usage: scripts/export-minilm.py [output, default minilm-l6.bin] [--model sentence-transformers/multi-qa-MiniLM-L6-cos-v1]
+#then: PALETTE_LOCAL_ENCODER=minilm-l6.bin palette-server
+#needs torch and transformers (pip install torch transformers)
+import argparse
+import struct
+import sys
+
+import numpy as np
+import torch
+from transformers import AutoModel, AutoTokenizer
+
+MAGIC = b"PLTMLM01"
+
+
+def quantize_rows(weight):
+    #int8 values and one float scale per row, an all-zero row gets scale 1
+    weight = weight.detach().float().cpu().numpy()
+    largest = np.abs(weight).max(axis=1)
+    scales = np.where(largest > 0, largest / 127.0, 1.0).astype(np.float32)
+    values = np.clip(np.rint(weight / scales[:, None]), -127, 127).astype(np.int8)
+    return values, scales
+
+
+def write_matrix(out, weight, bias):
+    values, scales = quantize_rows(weight)
+    out.write(values.tobytes())
+    out.write(scales.tobytes())
+    if bias is not None:
+        out.write(bias.detach().float().cpu().numpy().astype(np.float32).tobytes())
+
+
+def write_floats(out, tensor):
+    out.write(tensor.detach().float().cpu().numpy().astype(np.float32).tobytes())
+
+
+def write_layer_norm(out, norm):
+    write_floats(out, norm.weight)
+    write_floats(out, norm.bias)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="export a MiniLM sentence encoder for PALETTE_LOCAL_ENCODER")
+    parser.add_argument("output", nargs="?", default="minilm-l6.bin")
+    parser.add_argument("--model", default="sentence-transformers/multi-qa-MiniLM-L6-cos-v1")
+    args = parser.parse_args()
+
+    tokenizer = AutoTokenizer.from_pretrained(args.model)
+    model = AutoModel.from_pretrained(args.model).eval()
+    config = model.config
+    if config.model_type != "bert" or config.hidden_act != "gelu":
+        sys.exit(f"{args.model} is a {config.model_type} model with {config.hidden_act}, the encoder only runs bert with gelu")
+    if not getattr(tokenizer, "do_lower_case", True):
+        sys.exit(f"{args.model} is cased, the backend's tokenizer is bert's uncased one")
+
+    vocab = tokenizer.get_vocab()
+    tokens = sorted(vocab, key=vocab.get)
+    if [vocab[token] for token in tokens] != list(range(len(tokens))):
+        sys.exit("vocab ids aren't 0..n-1, can't write it as vocab.txt lines")
+    vocab_text = ("\n".join(tokens) + "\n").encode("utf-8")
+
+    embeddings = model.embeddings
+    with open(args.output, "wb") as out:
+        out.write(MAGIC)
+        out.write(struct.pack("<7I", len(tokens), config.hidden_size, config.num_hidden_layers, config.num_attention_heads,
+                              config.intermediate_size, config.max_position_embeddings, config.type_vocab_size))
+        out.write(struct.pack("<f", config.layer_norm_eps))
+        out.write(struct.pack("<I", len(vocab_text)))
+        out.write(vocab_text)
+        write_matrix(out, embeddings.word_embeddings.weight, None)
+        write_floats(out, embeddings.position_embeddings.weight)
+        write_floats(out, embeddings.token_type_embeddings.weight)
+        write_layer_norm(out, embeddings.LayerNorm)
+        for layer in model.encoder.layer:
+            attention = layer.attention.self
+            qkv_weight = torch.cat([attention.query.weight, attention.key.weight, attention.value.weight])
+            qkv_bias = torch.cat([attention.query.bias, attention.key.bias, attention.value.bias])
+            write_matrix(out, qkv_weight, qkv_bias)
+            write_matrix(out, layer.attention.output.dense.weight, layer.attention.output.dense.bias)
+            write_layer_norm(out, layer.attention.output.LayerNorm)
+            write_matrix(out, layer.intermediate.dense.weight, layer.intermediate.dense.bias)
+            write_matrix(out, layer.output.dense.weight, layer.output.dense.bias)
+            write_layer_norm(out, layer.output.LayerNorm)
+        size = out.tell()
+    print(f"wrote {args.output}: {args.model}, {len(tokens)} tokens, {config.num_hidden_layers} layers, "
+          f"{config.hidden_size} dimensions, {size / 1e6:.1f} MB")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env bash
+#profile-guided build of palette-server, trained on the load generator's request mix against mock-upstream
+#summary:
+#1. configure build-pgo with PALETTE_PGO=GENERATE and build the instrumented server, mock-upstream and load-generator
+#2. run the server against mock-upstream and drive it with load-generator (open loop, then closed loop)
+#3. stop the server with SIGINT so it writes its profile, merge it (clang only)
+#4. reconfigure the same build directory with PALETTE_PGO=USE and rebuild the server
+#gcc names profile files after the object paths, so both phases have to use the same build directory
+#
+#usage: scripts/pgo.sh [training seconds per phase, default 60] [open loop rate, default 200]
+#the optimized server ends up in build-pgo/palette-server, extra cmake arguments can be passed in PALETTE_CMAKE_ARGS
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+DURATION="${1:-60}"
+RATE="${2:-200}"
+BUILD="$ROOT/build-pgo"
+PROFILE="$BUILD/profile"
+MOCK_PORT="${MOCK_PORT:-18090}"
+SERVER_PORT="${SERVER_PORT:-18080}"
+JOBS="$(nproc 2>/dev/null || echo 4)"
+
+configure() {
+    # shellcheck disable=SC2086
+    cmake -S "$ROOT" -B "$BUILD" -DCMAKE_BUILD_TYPE=Release -DPALETTE_PGO="$1" -DPALETTE_PGO_DIR="$PROFILE" \
+          -DPALETTE_BUILD_BENCHMARKS=OFF ${PALETTE_CMAKE_ARGS:-}
+}
+wait_for() { #url, seconds
+    for _ in $(seq 1 $(( $2 * 10 ))); do
+        if curl -sf -o /dev/null "$1"; then return 0; fi
+        sleep 0.1
+    done
+    echo "timed out waiting for $1" >&2
+    return 1
+}
+
+MOCK_PID=""
+SERVER_PID=""
+cleanup() {
+    [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null || true
+    [ -n "$MOCK_PID" ] && kill "$MOCK_PID" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+echo "== instrumented build"
+rm -rf "$PROFILE"
+mkdir -p "$PROFILE"
+configure GENERATE
+cmake --build "$BUILD" -j"$JOBS" --target palette-server mock-upstream load-generator
+
+echo "== training for ${DURATION}s per phase"
+"$BUILD/mock-upstream" --port "$MOCK_PORT" --seed "$ROOT/backend/mock-upstream-seed.json" > "$BUILD/mock-upstream.log" 2>&1 &
+MOCK_PID=$!
+wait_for "http://127.0.0.1:$MOCK_PORT/v1/.well-known/ready" 10
+
+(cd "$ROOT" && PALETTE_PORT="$SERVER_PORT" \
+    WEAVIATE_URL="http://127.0.0.1:$MOCK_PORT" WEAVIATE_BACKUP_URL="http://127.0.0.1:$MOCK_PORT" \
+    PINTEREST_API_URL="http://127.0.0.1:$MOCK_PORT" \
+    exec "$BUILD/palette-server") > "$BUILD/server-training.log" 2>&1 &
+SERVER_PID=$!
+wait_for "http://127.0.0.1:$SERVER_PORT/health" 30
+
+#the production mix: mostly cache hits on popular queries, some cold searches, a few health checks
+"$BUILD/load-generator" --url "http://127.0.0.1:$SERVER_PORT" --mode open --rate "$RATE" --duration "$DURATION" \
+    --cache-hit-ratio 0.8 --zipf 1.0 --health-ratio 0.05 --seed "$ROOT/backend/mock-upstream-seed.json" \
+    --json "$BUILD/training-open.json"
+#and a saturating phase so admission control, shedding and degraded tiers get profiled too
+"$BUILD/load-generator" --url "http://127.0.0.1:$SERVER_PORT" --mode closed --concurrency 64 --duration "$DURATION" \
+    --cache-hit-ratio 0.5 --no-prewarm --seed "$ROOT/backend/mock-upstream-seed.json" \
+    --json "$BUILD/training-closed.json"
+
+kill -INT "$SERVER_PID" #the server exits through exit(0), which writes the profile
+wait "$SERVER_PID" || true
+SERVER_PID=""
+kill "$MOCK_PID" 2>/dev/null || true
+wait "$MOCK_PID" 2>/dev/null || true
+MOCK_PID=""
+
+if ls "$PROFILE"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -output="$PROFILE/palette.profdata" "$PROFILE"/*.profraw
+elif [ -z "$(find "$PROFILE" -name '*.gcda' -print -quit)" ]; then
+    echo "no profile was written to $PROFILE" >&2
+    exit 1
+fi
+
+echo "== optimized build"
+configure USE
+cmake --build "$BUILD" -j"$JOBS" --target palette-server
+echo "profile-optimized server: $BUILD/palette-server (training reports in $BUILD/training-*.json)"